@@ -0,0 +1,247 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <omp.h>
+
+#include "coord_fifo.h"
+#include "profiling.h"
+#include "task_pool.h"
+#include "visited_set.h"
+#include "zncc_operations.h"
+
+/*
+ * Benchmark for filling empty regions of a depthmap with a per-pixel BFS, both
+ * with a static round-robin row split (OpenMP) and with the work-stealing task
+ * pool, the same BFS with an epoch visited set on a single thread, and the
+ * linear time distance transform `fill_zero_regions`.
+ *
+ * The depthmap has a few big holes, so some rows need long BFS runs while
+ * most need none. Reports total time and for the BFS when each worker
+ * finished, the gap between the first and last worker is the time threads
+ * sit idle.
+ *
+ * usage: bench_fill [width height]
+ */
+
+#define DEFAULT_WIDTH 735u
+#define DEFAULT_HEIGHT 504u
+#define MAX_WORKERS 256u
+
+typedef struct {
+    int32_t      *img;
+    uint32_t      W;
+    uint32_t      H;
+    uint8_t     **visited;
+    coord_fifo_t *fifo;
+    double        start;
+    double        finished[MAX_WORKERS];  // seconds since start, per worker
+} fill_arg_t;
+
+static double now_s(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return (double)t.tv_sec + ((double)t.tv_nsec * 1e-9);
+}
+
+static void fill_row(fill_arg_t *arg, uint32_t y, uint32_t worker_id) {
+    for (uint32_t x = 0; x < arg->W; ++x) {
+        if (arg->img[(y * arg->W) + x] == 0) {
+            arg->img[(y * arg->W) + x] = find_nearest_nonzero_neighbour(
+                arg->img,
+                arg->W,
+                arg->H,
+                x,
+                y,
+                arg->visited[worker_id],
+                &arg->fifo[worker_id]
+            );
+        }
+    }
+}
+
+static void fill_rows_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+) {
+    fill_arg_t *arg = p;
+    for (uint32_t y = begin; y < end; ++y) {
+        fill_row(arg, y, worker_id);
+    }
+    // last task of the worker wins
+    arg->finished[worker_id] = now_s() - arg->start;
+}
+
+// depthmap with big rectangular holes in the upper half
+static void generate_depthmap(int32_t *img, uint32_t W, uint32_t H) {
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            img[(y * W) + x] = 1 + (int32_t)((x + y) % 64);
+        }
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        const uint32_t x0 = (W / 8) + (i * W / 4);
+        const uint32_t y0 = H / 16;
+        for (uint32_t y = y0; y < y0 + (H / 3); ++y) {
+            for (uint32_t x = x0; x < x0 + (W / 6); ++x) {
+                img[(y * W) + x] = 0;
+            }
+        }
+    }
+}
+
+static void print_finish_times(const fill_arg_t *arg, uint32_t num_workers) {
+    double first = arg->finished[0];
+    double last  = arg->finished[0];
+    for (uint32_t i = 1; i < num_workers; ++i) {
+        first = (arg->finished[i] < first) ? arg->finished[i] : first;
+        last  = (arg->finished[i] > last) ? arg->finished[i] : last;
+    }
+    printf(
+        "    first worker done %0.3f ms, last %0.3f ms\n",
+        first * 1000.0,
+        last * 1000.0
+    );
+}
+
+int main(int argc, char **argv) {
+    uint32_t W = DEFAULT_WIDTH;
+    uint32_t H = DEFAULT_HEIGHT;
+
+    if (argc == 3) {
+        W = (uint32_t)strtoul(argv[1], NULL, 10);
+        H = (uint32_t)strtoul(argv[2], NULL, 10);
+    } else if (argc != 1) {
+        printf("usage: %s [width height]\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t num_workers = (uint32_t)omp_get_max_threads();
+    if (num_workers > MAX_WORKERS) {
+        num_workers = MAX_WORKERS;
+    }
+    omp_set_num_threads((int)num_workers);
+
+    printf("image %u x %u, %u workers\n", W, H, num_workers);
+
+    fill_arg_t arg = {
+        .img     = malloc(sizeof(int32_t) * W * H),
+        .W       = W,
+        .H       = H,
+        .visited = malloc(sizeof(uint8_t *) * num_workers),
+        .fifo    = malloc(sizeof(coord_fifo_t) * num_workers)
+    };
+    assert(arg.img != NULL && arg.visited != NULL && arg.fifo != NULL);
+
+    for (uint32_t i = 0; i < num_workers; ++i) {
+        arg.visited[i]       = malloc(W * H * sizeof(uint8_t));
+        arg.fifo[i].storage  = malloc(W * H * sizeof(coord_t));
+        arg.fifo[i].read     = 0;
+        arg.fifo[i].write    = 0;
+        arg.fifo[i].capacity = W * H;
+        assert(arg.visited[i] != NULL && arg.fifo[i].storage != NULL);
+    }
+
+    {
+        PROFILING_BLOCK_DECLARE(round_robin);
+
+        generate_depthmap(arg.img, W, H);
+        memset(arg.finished, 0, sizeof(arg.finished));
+        arg.start = now_s();
+
+        PROFILING_BLOCK_BEGIN(round_robin);
+#pragma omp parallel
+        {
+            uint32_t num_threads = (uint32_t)omp_get_num_threads();
+            uint32_t thread_id   = (uint32_t)omp_get_thread_num();
+
+            for (uint32_t y = thread_id; y < H; y += num_threads) {
+                fill_row(&arg, y, thread_id);
+            }
+            arg.finished[thread_id] = now_s() - arg.start;
+        }
+        PROFILING_BLOCK_END(round_robin);
+
+        printf("\nOpenMP round-robin rows:\n");
+        PROFILING_BLOCK_PRINT_MS(round_robin);
+        print_finish_times(&arg, num_workers);
+    }
+
+    {
+        PROFILING_BLOCK_DECLARE(task_pool);
+
+        task_pool_t pool;
+        task_pool_init(&pool, num_workers);
+
+        generate_depthmap(arg.img, W, H);
+        memset(arg.finished, 0, sizeof(arg.finished));
+        arg.start = now_s();
+
+        PROFILING_BLOCK_BEGIN(task_pool);
+        task_pool_parallel_for(&pool, 0, H, 1, fill_rows_task, &arg);
+        PROFILING_BLOCK_END(task_pool);
+
+        printf("\nwork-stealing task pool:\n");
+        PROFILING_BLOCK_PRINT_MS(task_pool);
+        print_finish_times(&arg, num_workers);
+
+        task_pool_destroy(&pool);
+    }
+
+    {
+        PROFILING_BLOCK_DECLARE(visited_set);
+
+        visited_set_t visited;
+        visited_set_init(&visited, W * H);
+
+        generate_depthmap(arg.img, W, H);
+
+        PROFILING_BLOCK_BEGIN(visited_set);
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                if (arg.img[(y * W) + x] == 0) {
+                    arg.img[(y * W) + x] =
+                        find_nearest_nonzero_neighbour_visited_set(
+                            arg.img, W, H, x, y, &visited, &arg.fifo[0]
+                        );
+                }
+            }
+        }
+        PROFILING_BLOCK_END(visited_set);
+
+        printf("\nBFS with visited set, single thread:\n");
+        PROFILING_BLOCK_PRINT_MS(visited_set);
+
+        visited_set_free(&visited);
+    }
+
+    {
+        PROFILING_BLOCK_DECLARE(distance_transform);
+
+        uint32_t *dist = malloc(sizeof(uint32_t) * W * H);
+        assert(dist != NULL);
+
+        generate_depthmap(arg.img, W, H);
+
+        PROFILING_BLOCK_BEGIN(distance_transform);
+        fill_zero_regions(arg.img, dist, W, H);
+        PROFILING_BLOCK_END(distance_transform);
+
+        printf("\ndistance transform, single thread:\n");
+        PROFILING_BLOCK_PRINT_MS(distance_transform);
+
+        free(dist);
+    }
+
+    for (uint32_t i = 0; i < num_workers; ++i) {
+        free(arg.visited[i]);
+        free(arg.fifo[i].storage);
+    }
+    free(arg.visited);
+    free(arg.fifo);
+    free(arg.img);
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "integral_image.h"
+#include "profiling.h"
+#include "zncc_cost_volume.h"
+#include "zncc_operations.h"
+
+/*
+ * Benchmark for the column tiling of the cost volume ZNCC driver.
+ *
+ * Runs the fused search on a synthetic stereo pair with different tile widths
+ * and reports run time and hardware cache counters. Counters are read with
+ * perf_event_open, they show up as "n/a" where that isn't available (e.g. in
+ * most virtual machines, or with kernel.perf_event_paranoid > 2).
+ *
+ * usage: bench_main [width height max_disp]
+ */
+
+#define DEFAULT_WIDTH 1470u
+#define DEFAULT_HEIGHT 1008u
+#define DEFAULT_MAX_DISP 130u
+
+#define WINDOW_WIDTH 9u
+#define WINDOW_HEIGHT 9u
+#define BAND_HEIGHT 16u
+
+typedef struct {
+    const char *name;
+    uint32_t    type;
+    uint64_t    config;
+} counter_desc_t;
+
+#define CACHE_EVENT(cache, op, result)                                  \
+    (PERF_COUNT_HW_CACHE_##cache | (PERF_COUNT_HW_CACHE_OP_##op << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+#ifdef __linux__
+static const counter_desc_t counters[] = {
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"L1d-load-misses", PERF_TYPE_HW_CACHE, CACHE_EVENT(L1D, READ, MISS)},
+    {"LLC-load-misses", PERF_TYPE_HW_CACHE, CACHE_EVENT(LL, READ, MISS)},
+};
+#define NUM_COUNTERS (sizeof(counters) / sizeof(counters[0]))
+#else
+#define NUM_COUNTERS 0
+#endif
+
+typedef struct {
+    int      fd[NUM_COUNTERS + 1];
+    uint64_t value[NUM_COUNTERS + 1];
+} counter_set_t;
+
+static void counters_open(counter_set_t *set) {
+    for (uint32_t i = 0; i < NUM_COUNTERS; ++i) {
+        set->fd[i]    = -1;
+        set->value[i] = 0;
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = counters[i].type;
+        attr.config         = counters[i].config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        // count all threads created after opening, e.g. OpenMP workers
+        attr.inherit = 1;
+
+        set->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+}
+
+static void counters_start(counter_set_t *set) {
+    for (uint32_t i = 0; i < NUM_COUNTERS; ++i) {
+#ifdef __linux__
+        if (set->fd[i] >= 0) {
+            ioctl(set->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(set->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+}
+
+static void counters_stop(counter_set_t *set) {
+    for (uint32_t i = 0; i < NUM_COUNTERS; ++i) {
+#ifdef __linux__
+        if (set->fd[i] >= 0) {
+            ioctl(set->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(set->fd[i], &set->value[i], sizeof(uint64_t)) !=
+                sizeof(uint64_t)) {
+                set->value[i] = 0;
+            }
+        }
+#endif
+    }
+}
+
+static void counters_print(const counter_set_t *set) {
+    for (uint32_t i = 0; i < NUM_COUNTERS; ++i) {
+#ifdef __linux__
+        if (set->fd[i] >= 0) {
+            printf("    %-18s %15lu\n", counters[i].name, set->value[i]);
+        } else {
+            printf("    %-18s %15s\n", counters[i].name, "n/a");
+        }
+#endif
+    }
+}
+
+static void counters_close(counter_set_t *set) {
+    for (uint32_t i = 0; i < NUM_COUNTERS; ++i) {
+#ifdef __linux__
+        if (set->fd[i] >= 0) {
+            close(set->fd[i]);
+        }
+#endif
+    }
+}
+
+// textured pair with a constant disparity, values are 8-bit integers
+static void generate_stereo_pair(
+    double *left, double *right, uint32_t W, uint32_t H, uint32_t shift
+) {
+    uint32_t state = 12345;
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W + shift; ++x) {
+            state    = (state * 1103515245u) + 12345u;
+            double v = (double)((state >> 16) % 256);
+            if (x < W) {
+                left[(y * W) + x] = v;
+            }
+            if (x >= shift) {
+                right[(y * W) + (x - shift)] = v;
+            }
+        }
+    }
+}
+
+static zncc_input_t prepare_input(double *img, uint32_t W, uint32_t H) {
+    zncc_input_t in = {
+        .img         = img,
+        .mean        = malloc(sizeof(double) * W * H),
+        .inv_std_dev = malloc(sizeof(double) * W * H),
+        .width       = W,
+        .height      = H
+    };
+    assert(in.mean != NULL);
+    assert(in.inv_std_dev != NULL);
+
+    calculate_window_statistics(
+        img, W, H, WINDOW_WIDTH, WINDOW_HEIGHT, in.mean, in.inv_std_dev
+    );
+    invert_standard_deviation(in.inv_std_dev, in.inv_std_dev, W * H);
+
+    return in;
+}
+
+static void run_fused(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    uint32_t            max_disp,
+    uint32_t            tile_width,
+    int32_t            *out_ltr,
+    int32_t            *out_rtl
+) {
+    const uint32_t H         = left->height;
+    const uint32_t num_bands = (H + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    const uint32_t scratch_size = zncc_cost_volume_scratch_size(
+        left->width, BAND_HEIGHT, WINDOW_WIDTH, WINDOW_HEIGHT
+    );
+
+#pragma omp parallel
+    {
+        double *scratch = malloc(sizeof(double) * scratch_size);
+        assert(scratch != NULL);
+
+#pragma omp for schedule(dynamic)
+        for (uint32_t b = 0; b < num_bands; ++b) {
+            const uint32_t y_begin = b * BAND_HEIGHT;
+            const uint32_t y_end =
+                (y_begin + BAND_HEIGHT < H) ? (y_begin + BAND_HEIGHT) : H;
+            calculate_zncc_cost_volume_fused(
+                left,
+                right,
+                y_begin,
+                y_end,
+                WINDOW_WIDTH,
+                WINDOW_HEIGHT,
+                max_disp,
+                tile_width,
+                scratch,
+                out_ltr,
+                out_rtl
+            );
+        }
+
+        free(scratch);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t W        = DEFAULT_WIDTH;
+    uint32_t H        = DEFAULT_HEIGHT;
+    uint32_t max_disp = DEFAULT_MAX_DISP;
+
+    if (argc == 4) {
+        W        = (uint32_t)strtoul(argv[1], NULL, 10);
+        H        = (uint32_t)strtoul(argv[2], NULL, 10);
+        max_disp = (uint32_t)strtoul(argv[3], NULL, 10);
+    } else if (argc != 1) {
+        printf("usage: %s [width height max_disp]\n", argv[0]);
+        return 1;
+    }
+
+    printf("image %u x %u, max disparity %u\n", W, H, max_disp);
+
+    double  *left     = malloc(sizeof(double) * W * H);
+    double  *right    = malloc(sizeof(double) * W * H);
+    int32_t *ref_ltr  = malloc(sizeof(int32_t) * W * H);
+    int32_t *ref_rtl  = malloc(sizeof(int32_t) * W * H);
+    int32_t *out_ltr  = malloc(sizeof(int32_t) * W * H);
+    int32_t *out_rtl  = malloc(sizeof(int32_t) * W * H);
+    assert(left != NULL && right != NULL);
+    assert(ref_ltr != NULL && ref_rtl != NULL);
+    assert(out_ltr != NULL && out_rtl != NULL);
+
+    generate_stereo_pair(left, right, W, H, max_disp / 3);
+
+    zncc_input_t in_left  = prepare_input(left, W, H);
+    zncc_input_t in_right = prepare_input(right, W, H);
+
+    const uint32_t auto_tile = zncc_cost_volume_tile_width(
+        BAND_HEIGHT, WINDOW_WIDTH, WINDOW_HEIGHT, max_disp
+    );
+
+    // 0 == untiled, i.e. whole rows
+    const uint32_t tile_widths[] = {0, auto_tile, 2 * auto_tile, 128};
+    const uint32_t num_tile_widths =
+        sizeof(tile_widths) / sizeof(tile_widths[0]);
+
+    counter_set_t set;
+    counters_open(&set);
+
+    for (uint32_t i = 0; i < num_tile_widths; ++i) {
+        PROFILING_BLOCK_DECLARE(zncc);
+
+        int32_t *ltr = (i == 0) ? ref_ltr : out_ltr;
+        int32_t *rtl = (i == 0) ? ref_rtl : out_rtl;
+
+        counters_start(&set);
+        PROFILING_BLOCK_BEGIN(zncc);
+        run_fused(&in_left, &in_right, max_disp, tile_widths[i], ltr, rtl);
+        PROFILING_BLOCK_END(zncc);
+        counters_stop(&set);
+
+        if (tile_widths[i] == 0) {
+            printf("\nuntiled:\n");
+        } else {
+            printf(
+                "\ntile width %u%s:\n",
+                tile_widths[i],
+                (tile_widths[i] == auto_tile) ? " (L2 sized)" : ""
+            );
+        }
+        PROFILING_BLOCK_PRINT_MS(zncc);
+        counters_print(&set);
+
+        // tiling must not change the result
+        if (i > 0 && (memcmp(ref_ltr, ltr, sizeof(int32_t) * W * H) != 0 ||
+                      memcmp(ref_rtl, rtl, sizeof(int32_t) * W * H) != 0)) {
+            printf("    result differs from untiled run!\n");
+        }
+    }
+
+    counters_close(&set);
+
+    free(in_left.mean);
+    free(in_left.inv_std_dev);
+    free(in_right.mean);
+    free(in_right.inv_std_dev);
+    free(left);
+    free(right);
+    free(ref_ltr);
+    free(ref_rtl);
+    free(out_ltr);
+    free(out_rtl);
+
+    return 0;
+}
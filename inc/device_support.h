@@ -3,7 +3,9 @@
 
 #include <CL/cl.h>
 
-#define MAX_NUM_CL_PLATFORMS 1
+#include "work_size_tuning.h"
+
+#define MAX_NUM_CL_PLATFORMS 4
 
 /*!
  * @brief Checks given error. If it is not CL_SUCCESS, calls panic.
@@ -32,6 +34,144 @@ cl_program compile_program_from_file(
     const char *path, cl_context ctx, cl_device_id dev, cl_int *err
 );
 
+/*!
+ * @brief Like `compile_program_from_file`, but keeps the device binary of the
+ * program in an on-disk cache, so later runs skip compiling the source.
+ * Cache files are named by a hash of the source, build options, device name,
+ * device version and driver version, so changing any of these rebuilds from
+ * source. Unusable cache files are ignored and overwritten.
+ * @param path : path to source file
+ * @param options : build options, e.g. "-Werror"
+ * @param cache_dir : directory for cached binaries, created if missing, or
+ * NULL to always compile from source
+ * @param ctx : OpenCL context
+ * @param dev : OpenCL device
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return program structure or NULL
+ */
+cl_program compile_program_from_file_cached(
+    const char  *path,
+    const char  *options,
+    const char  *cache_dir,
+    cl_context   ctx,
+    cl_device_id dev,
+    cl_int      *err
+);
+
+// built variants of one program kept by `program_variants_t`
+#define MAX_PROGRAM_VARIANTS 8
+#define MAX_PROGRAM_OPTIONS_LEN 512
+
+typedef struct {
+    char       options[MAX_PROGRAM_OPTIONS_LEN];
+    cl_program program;
+} program_variant_t;
+
+/*
+ * Variants of one OpenCL program built with different build options, e.g.
+ * kernels specialised with -D options. Each variant is built once, through
+ * `compile_program_from_file_cached`, and reused for the same options.
+ */
+typedef struct {
+    const char       *path;
+    const char       *cache_dir;
+    cl_context        ctx;
+    cl_device_id      dev;
+    cl_uint           num_variants;
+    program_variant_t variants[MAX_PROGRAM_VARIANTS];
+} program_variants_t;
+
+/*!
+ * @brief Initializes an empty set of program variants
+ * @param[out] variants : variants to initialize
+ * @param path : path to source file
+ * @param cache_dir : directory for cached binaries, or NULL
+ * @param ctx : OpenCL context
+ * @param dev : OpenCL device
+ */
+void program_variants_init(
+    program_variants_t *variants,
+    const char         *path,
+    const char         *cache_dir,
+    cl_context          ctx,
+    cl_device_id        dev
+);
+
+/*!
+ * @brief Returns the program built with the given options, building it on
+ * first use. The program is owned by `variants`.
+ * @param variants : program variants
+ * @param options : build options
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return program structure or NULL
+ */
+cl_program get_program_variant(
+    program_variants_t *variants, const char *options, cl_int *err
+);
+
+/*!
+ * @brief Releases all built programs
+ * @param variants : program variants
+ */
+void program_variants_release(program_variants_t *variants);
+
+// compile time constants of the zncc.cl kernels, shared by all variants
+typedef struct {
+    const char *base_options;  // e.g. "-Werror"
+    uint32_t    window_width;
+    uint32_t    window_height;
+    uint32_t    max_disparity;
+    int32_t     crosscheck_threshold;
+} zncc_program_constants_t;
+
+/*!
+ * @brief Formats build options of a zncc.cl variant. Calls panic if they
+ * don't fit.
+ * @param[out] options : MAX_PROGRAM_OPTIONS_LEN characters
+ * @param constants : compile time constants
+ * @param W : image width, 0 to leave it a runtime value
+ * @param direction : search direction, 0 to leave it a runtime value
+ */
+void format_zncc_program_options(
+    char                           *options,
+    const zncc_program_constants_t *constants,
+    const uint32_t                  W,
+    const int32_t                   direction
+);
+
+/*!
+ * @brief Builds kernel of zncc.cl, specialised with the given constants,
+ * image width and search direction
+ * @param variants : built variants of zncc.cl
+ * @param name : kernel name
+ * @param constants : compile time constants
+ * @param W : image width, 0 to leave it a runtime value
+ * @param direction : search direction, 0 to leave it a runtime value
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return kernel structure or NULL
+ */
+cl_kernel build_zncc_kernel(
+    program_variants_t             *variants,
+    const char                     *name,
+    const zncc_program_constants_t *constants,
+    const uint32_t                  W,
+    const int32_t                   direction,
+    cl_int                         *err
+);
+
+/*
+ * Sets argument idx of `kernel` to the value at v of type t. On failure sets
+ * *err and returns from the calling function, which must return void and
+ * have `kernel`, `err` and a cl_int `internal_err` in scope.
+ */
+#define SET_KERNEL_ARG(idx, t, v)                                 \
+    internal_err = clSetKernelArg(kernel, (idx), sizeof(t), (v)); \
+    if (internal_err != CL_SUCCESS) {                             \
+        printf("error setting argument %d\n", (idx));             \
+        *err = internal_err;                                      \
+        return;                                                   \
+    }
+
 /*!
  * @brief Prints build log
  * @param program : program which built
@@ -57,6 +197,17 @@ cl_kernel build_kernel(
  */
 cl_device_id get_device(cl_int *err);
 
+/*!
+ * @brief Finds all OpenCL devices of all platforms, of any type
+ * @param[out] devices : found devices
+ * @param max_devices : capacity of devices
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return number of devices found, at most max_devices
+ */
+cl_uint get_all_devices(
+    cl_device_id *devices, const cl_uint max_devices, cl_int *err
+);
+
 /*!
  * @brief Create OpenCL context
  * @param[out] err : CL_SUCCESS for success, error code otherwise
@@ -73,6 +224,19 @@ cl_context create_context(cl_device_id device, cl_int *err);
  */
 cl_command_queue create_queue(cl_context ctx, cl_device_id device, cl_int *err);
 
+/*!
+ * @brief Create OpenCL work queue that may execute commands out of order, in
+ * an order allowed by their wait events. Falls back to an in-order queue if
+ * the device doesn't support out-of-order execution.
+ * @param ctx : OpenCL context
+ * @param device : OpenCL device
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return Work queue struct or NULL
+ */
+cl_command_queue create_out_of_order_queue(
+    cl_context ctx, cl_device_id device, cl_int *err
+);
+
 /*!
  * @brief Gets profiling data from CL runtime
  * @param evt : profiling event
@@ -81,29 +245,131 @@ cl_command_queue create_queue(cl_context ctx, cl_device_id device, cl_int *err);
 uint64_t get_exec_ns(cl_event evt);
 
 /*!
- * @brief Allocates an image on device side, optionally also copying data to it.
+ * @brief Gets profiling data from CL runtime for a group of commands, without
+ * the time they spent queued. Commands that overlap are counted once.
+ * @param evts : profiling events, NULL entries are skipped
+ * @param num_evts : number of events
+ * @return nanoseconds from the earliest start to the latest end
+ */
+uint64_t get_span_ns(const cl_event *evts, cl_uint num_evts);
+
+/*!
+ * @brief Describes device for keying tuned parameters, e.g. work sizes. The
+ * description changes with the device, the driver version and the number of
+ * compute units.
+ * @param dev : OpenCL device
+ * @param[out] buf : description
+ * @param len : size of buf
+ */
+void get_device_identity(cl_device_id dev, char *buf, size_t len);
+
+/*!
+ * @brief Gets the options the program of a kernel was built with
+ * @param kernel : kernel
+ * @param dev : device the program was built for
+ * @param[out] buf : options, empty if they can't be queried
+ * @param len : size of buf
+ */
+void get_kernel_build_options(
+    cl_kernel kernel, cl_device_id dev, char *buf, size_t len
+);
+
+/*!
+ * @brief Times one launch of the kernel with each candidate work size and
+ * returns the fastest. Kernel arguments must be set, and the kernel outputs
+ * must not depend on how many times it has been run.
+ * @param queue : work queue with profiling enabled
+ * @param kernel : kernel to launch
+ * @param n_arg : index of a cl_uint argument set to global[0] of each
+ * candidate, e.g. the number of row sections, -1 for none
+ * @param candidates : work sizes to try
+ * @param num_candidates : number of candidates
+ * @param num_wait_events : number of events in wait_events
+ * @param wait_events : events to wait for before the first launch
+ * @param[out] err : CL_SUCCESS for success, error code otherwise, e.g. if no
+ * candidate could be launched
+ * @return index of the fastest candidate
+ */
+uint32_t tune_work_size(
+    cl_command_queue   queue,
+    cl_kernel          kernel,
+    const int32_t      n_arg,
+    const work_size_t *candidates,
+    const uint32_t     num_candidates,
+    const cl_uint      num_wait_events,
+    const cl_event    *wait_events,
+    cl_int            *err
+);
+
+/*!
+ * @brief Allocates an image on device side, optionally initialized from data.
+ * The image uses data as its host memory (CL_MEM_USE_HOST_PTR), so there is no
+ * copy if the device shares memory with the host and data is allocated with
+ * `allocate_host_memory`. data must stay valid until the image is released.
  * @param ctx : OpenCL context
- * @param queue : device command queue which owns the memory, can be null if
- * only allocating
  * @param format : image format
  * @param W : width
  * @param H : height
- * @param elem_sz : size of a pixel (e.g. sizeof(float), sizeof(rgba_t), ...)
  * @param data : image data or NULL
  * @param[out] err : CL_SUCCESS for success, error code otherwise
  * @return cl_mem
  */
 cl_mem allocate_2D_image(
     cl_context             ctx,
-    cl_command_queue       queue,
     const cl_image_format *format,
     size_t                 W,
     size_t                 H,
-    size_t                 elem_sz,
     void                  *data,
     cl_int                *err
 );
 
+// OpenCL implementations sharing memory with the host can use host memory
+// aligned to a page without copying
+#define HOST_MEMORY_ALIGNMENT 4096u
+
+/*!
+ * @brief Allocates host memory that can be given to CL_MEM_USE_HOST_PTR
+ * buffers and images without copying, aligned to HOST_MEMORY_ALIGNMENT and
+ * padded to a multiple of it. Calls panic if out of memory.
+ * @param sz : number of bytes
+ * @return pointer to memory, release with free()
+ */
+void *allocate_host_memory(size_t sz);
+
+/*!
+ * @brief Maps device buffer into host address space once the given events are
+ * complete. If the device shares memory with the host this doesn't copy, and
+ * for CL_MEM_USE_HOST_PTR buffers the pointer is into the host memory.
+ * @param queue : device command queue which owns the memory
+ * @param mem : device buffer
+ * @param flags : CL_MAP_READ and/or CL_MAP_WRITE
+ * @param sz : number of bytes to map
+ * @param num_wait_events : number of events in wait_events
+ * @param wait_events : events to wait for, can be NULL if num_wait_events is 0
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return pointer to mapped memory, valid until `unmap_device_memory`
+ */
+void *map_device_memory(
+    cl_command_queue queue,
+    cl_mem           mem,
+    cl_map_flags     flags,
+    size_t           sz,
+    cl_uint          num_wait_events,
+    const cl_event  *wait_events,
+    cl_int          *err
+);
+
+/*!
+ * @brief Unmaps memory mapped with `map_device_memory`
+ * @param queue : device command queue which owns the memory
+ * @param mem : device buffer
+ * @param ptr : pointer returned by `map_device_memory`
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ */
+void unmap_device_memory(
+    cl_command_queue queue, cl_mem mem, void *ptr, cl_int *err
+);
+
 /*!
  * @brief Read device memory into host side buffer and return a pointer to it
  * @param queue : device command queue which owns the memory
@@ -116,6 +382,26 @@ void *read_device_memory(
     cl_command_queue queue, cl_mem mem, size_t sz, cl_int *err
 );
 
+/*!
+ * @brief Like `read_device_memory`, but the read waits for the given events
+ * first, e.g. the kernel that produces the data
+ * @param queue : device command queue which owns the memory
+ * @param mem : device memory
+ * @param sz : number of bytes to read
+ * @param num_wait_events : number of events in wait_events
+ * @param wait_events : events to wait for, can be NULL if num_wait_events is 0
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return pointer to host buffer containing copy of device memory
+ */
+void *read_device_memory_after(
+    cl_command_queue queue,
+    cl_mem           mem,
+    size_t           sz,
+    cl_uint          num_wait_events,
+    const cl_event  *wait_events,
+    cl_int          *err
+);
+
 /*!
  * @brief Read device image into host side buffer and return a pointer to it
  * @param queue : device command queue which owns the memory
@@ -1,6 +1,7 @@
 #ifndef _IMAGE_OPERATIONS_H_
 #define _IMAGE_OPERATIONS_H_
 
+#include "padded_image.h"
 #include "types.h"
 
 /* Defines */
@@ -9,9 +10,18 @@
 #define SCALE_G 0.7152
 #define SCALE_B 0.0722
 
+// SCALE_R, SCALE_G and SCALE_B in units of 1 / GRAY_FX_ONE
+#define GRAY_FX_R 2126
+#define GRAY_FX_G 7152
+#define GRAY_FX_B 722
+#define GRAY_FX_ONE 10000
+
 #define SMOOTHING_KERNEL_ORDER 5
 #define SMOOTHING_KERNEL_RADIUS 2
 
+// keeps window sums of 8-bit pixels within 32 bits
+#define BOX_FILTER_MAX_RADIUS 2047
+
 /* Function declarations */
 
 void load_image(const char* path, img_load_result_t* result);
@@ -24,8 +34,72 @@ void scale_down_image(rgba_img_t* in, rgba_img_t* out);
 
 void convert_to_grayscale(rgba_img_t* in, gray_img_t* out);
 
+/*!
+ * @brief Grayscale value of one pixel, the same as truncating
+ * SCALE_R * R + SCALE_G * G + SCALE_B * B computed in double
+ * @param rgba : pixel
+ */
+gray_t rgba_to_gray(rgba_t rgba);
+
 void convert_to_double(gray_img_t* in, double_img_t* out);
 
+/*!
+ * @brief scale_down_image, convert_to_grayscale and then convert_to_double (or
+ * a float conversion) in one pass, with the same results. Rows are
+ * independent, so row ranges can be processed in parallel.
+ * @param in : full resolution image
+ * @param[out] out : whole W x H image of the palette's type, rows
+ * begin..end-1 are written
+ * @param palette : output type, GS, GS_FLOAT or GS_DOUBLE
+ * @param W : output width
+ * @param H : output height
+ * @param begin : first output row
+ * @param end : one past last output row
+ */
+void downscale_to_grayscale(
+    const rgba_img_t* in,
+    void*             out,
+    palette_e         palette,
+    uint32_t          W,
+    uint32_t          H,
+    uint32_t          begin,
+    uint32_t          end
+);
+
+/*!
+ * @brief 5x5 mean filter, `apply_box_filter` with SMOOTHING_KERNEL_RADIUS
+ * @param in : input image
+ * @param[out] out : filtered image, same size as in
+ */
 void apply_filter(gray_img_t* in, gray_img_t* out);
 
+/*!
+ * @brief Mean of the (2 * radius + 1) x (2 * radius + 1) window around each
+ * pixel, clamped to the image borders. Uses running sums down the columns and
+ * along the rows, so the cost per pixel doesn't depend on the radius.
+ * @param in : input image
+ * @param[out] out : filtered image, same size as in
+ * @param radius : window radius, at most BOX_FILTER_MAX_RADIUS
+ */
+void apply_box_filter(gray_img_t* in, gray_img_t* out, uint32_t radius);
+
+/*!
+ * @brief `apply_filter` on a padded image, with the same results
+ * @param in : input image, the apron must be larger than
+ * SMOOTHING_KERNEL_RADIUS, it replaces all clamping
+ * @param[out] out : filtered image, same size as in
+ */
+void apply_filter_padded(const padded_gray_img_t* in, gray_img_t* out);
+
+/*!
+ * @brief `apply_box_filter` on a padded image, with the same results
+ * @param in : input image, the apron must be larger than radius, it replaces
+ * all clamping
+ * @param[out] out : filtered image, same size as in
+ * @param radius : window radius, at most BOX_FILTER_MAX_RADIUS
+ */
+void apply_box_filter_padded(
+    const padded_gray_img_t* in, gray_img_t* out, uint32_t radius
+);
+
 #endif  // _IMAGE_OPERATIONS_H_
\ No newline at end of file
@@ -0,0 +1,118 @@
+#ifndef _IMAGE_OPERATIONS_SIMD_H_
+#define _IMAGE_OPERATIONS_SIMD_H_
+
+#include <stdint.h>
+
+#include "task_pool.h"
+#include "types.h"
+
+/*
+ * Vectorized and multithreaded variants of `scale_down_image`,
+ * `convert_to_grayscale` and `apply_filter`, with bit-identical results.
+ *
+ * Each operation has a row range function, which writes output rows
+ * begin..end-1 into an image the caller has allocated, so that drivers can
+ * split rows between their own threads. The `_parallel` functions allocate
+ * the output like the originals and split the rows between the workers of a
+ * task pool in bands of IMAGE_SIMD_ROWS_PER_TASK rows.
+ *
+ * Grayscale values are computed with the integer weights GRAY_FX_R/G/B like
+ * `rgba_to_gray`. The 5x5 filter sums 16 pixels at a time in 16-bit lanes
+ * and divides by a multiply and shift, only the border columns are clamped.
+ *
+ * The instruction set is picked at runtime like in zncc_simd.h.
+ */
+
+typedef enum {
+    IMAGE_SIMD_SCALAR,  // plain C
+    IMAGE_SIMD_AVX2     // AVX2
+} image_simd_level_e;
+
+// rows per task of the `_parallel` functions
+#define IMAGE_SIMD_ROWS_PER_TASK 16u
+
+/*!
+ * @brief Detects best instruction set supported by the CPU
+ * @return instruction set level
+ */
+image_simd_level_e image_simd_detect(void);
+
+/*!
+ * @brief Returns the instruction set used by the functions below. Defaults to
+ * `image_simd_detect()`.
+ * @return instruction set level
+ */
+image_simd_level_e image_simd_get_level(void);
+
+/*!
+ * @brief Overrides the instruction set used, e.g. to compare implementations.
+ * Levels not supported by the CPU fall back to the best supported one.
+ * @param level : instruction set level
+ */
+void image_simd_set_level(image_simd_level_e level);
+
+/*!
+ * @brief Rows begin..end-1 of `scale_down_image`
+ * @param in : input image
+ * @param[out] out : output image with dimensions and memory set, smaller
+ * than the input
+ * @param begin : first output row
+ * @param end : one past last output row
+ */
+void scale_down_image_rows(
+    const rgba_img_t *in, rgba_img_t *out, uint32_t begin, uint32_t end
+);
+
+/*!
+ * @brief Rows begin..end-1 of `convert_to_grayscale`
+ * @param in : input image
+ * @param[out] out : output image with memory for in->width * in->height
+ * pixels
+ * @param begin : first row
+ * @param end : one past last row
+ */
+void convert_to_grayscale_rows(
+    const rgba_img_t *in, gray_img_t *out, uint32_t begin, uint32_t end
+);
+
+/*!
+ * @brief Rows begin..end-1 of `apply_filter`
+ * @param in : input image
+ * @param[out] out : output image with memory for in->width * in->height
+ * pixels, must not be the input
+ * @param begin : first row
+ * @param end : one past last row
+ */
+void apply_filter_rows(
+    const gray_img_t *in, gray_img_t *out, uint32_t begin, uint32_t end
+);
+
+/*!
+ * @brief `scale_down_image` on all workers of a pool
+ * @param in : input image
+ * @param[out] out : output image with dimensions set, memory is allocated
+ * @param pool : task pool, or NULL to run on the calling thread only
+ */
+void scale_down_image_parallel(
+    rgba_img_t *in, rgba_img_t *out, task_pool_t *pool
+);
+
+/*!
+ * @brief `convert_to_grayscale` on all workers of a pool
+ * @param in : input image
+ * @param[out] out : output image, memory is allocated
+ * @param pool : task pool, or NULL to run on the calling thread only
+ */
+void convert_to_grayscale_parallel(
+    rgba_img_t *in, gray_img_t *out, task_pool_t *pool
+);
+
+/*!
+ * @brief `apply_filter` on all workers of a pool
+ * @param in : input image
+ * @param[out] out : output image, memory is allocated
+ * @param pool : task pool, or NULL to run on the calling thread only
+ */
+void apply_filter_parallel(gray_img_t *in, gray_img_t *out, task_pool_t *pool);
+
+#endif  // _IMAGE_OPERATIONS_SIMD_H_
@@ -0,0 +1,102 @@
+#ifndef _INTEGRAL_IMAGE_H_
+#define _INTEGRAL_IMAGE_H_
+
+#include <stdint.h>
+
+/*
+ * Summed-area tables of I and I^2 for computing window statistics in O(1).
+ *
+ * The tables are built over a copy of the image which has been extended by
+ * replicating the edge pixels, so a window centered on any pixel is a plain
+ * rectangle in the table and gives the same result as `extract_window`, which
+ * clamps coordinates.
+ */
+typedef struct {
+    double  *sum;     // summed-area table of I
+    double  *sum_sq;  // summed-area table of I^2
+    uint32_t width;   // table width, (image width + 2 * apron_x + 1)
+    uint32_t height;  // table height, (image height + 2 * apron_y + 1)
+    uint32_t apron_x; // replicated columns on left and right sides
+    uint32_t apron_y; // replicated rows on top and bottom sides
+} integral_image_t;
+
+/*!
+ * @brief Builds summed-area tables for windows of given size
+ * @param img : input image
+ * @param W : image width
+ * @param H : image height
+ * @param win_width : width of windows which will be queried
+ * @param win_height : height of windows which will be queried
+ * @param[out] out : summed-area tables, free with `free_integral_image`
+ */
+void build_integral_image(
+    double           *img,
+    const uint32_t    W,
+    const uint32_t    H,
+    const uint32_t    win_width,
+    const uint32_t    win_height,
+    integral_image_t *out
+);
+
+/*!
+ * @brief Frees tables allocated by `build_integral_image`
+ * @param sat : summed-area tables
+ */
+void free_integral_image(integral_image_t *sat);
+
+/*!
+ * @brief Calculates mean and standard deviation of the window centered on
+ * (x, y). Window size is the one given to `build_integral_image`.
+ * @param sat : summed-area tables
+ * @param x : window center x
+ * @param y : window center y
+ * @param[out] mean : window mean
+ * @param[out] std_dev : window standard deviation
+ */
+void integral_window_statistics(
+    const integral_image_t *sat,
+    const uint32_t          x,
+    const uint32_t          y,
+    double                 *mean,
+    double                 *std_dev
+);
+
+/*!
+ * @brief Calculates window mean and standard deviation maps for rows
+ * y_begin..y_end-1. Rows are independent, so bands of rows can be computed in
+ * parallel from the same tables.
+ * @param sat : summed-area tables
+ * @param y_begin : first row
+ * @param y_end : one past last row
+ * @param[out] mean : image width * height values, can be NULL
+ * @param[out] std_dev : image width * height values, can be NULL
+ */
+void integral_window_statistics_rows(
+    const integral_image_t *sat,
+    const uint32_t          y_begin,
+    const uint32_t          y_end,
+    double                 *mean,
+    double                 *std_dev
+);
+
+/*!
+ * @brief Calculates per-pixel window mean and standard deviation maps
+ * @param img : input image
+ * @param W : image width
+ * @param H : image height
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param[out] mean : W * H values, can be NULL
+ * @param[out] std_dev : W * H values, can be NULL
+ */
+void calculate_window_statistics(
+    double        *img,
+    const uint32_t W,
+    const uint32_t H,
+    const uint32_t win_width,
+    const uint32_t win_height,
+    double        *mean,
+    double        *std_dev
+);
+
+#endif  // _INTEGRAL_IMAGE_H_
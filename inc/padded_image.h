@@ -0,0 +1,118 @@
+#ifndef _PADDED_IMAGE_H_
+#define _PADDED_IMAGE_H_
+
+#include <stdint.h>
+
+#include "types.h"
+
+/*
+ * Planar images with a border apron and aligned rows.
+ *
+ * The image is surrounded by `apron` pixels on each side, filled with copies
+ * of the nearest edge pixel. Reading up to `apron` pixels outside the image
+ * then gives the same value as clamping the coordinates, so window loops need
+ * no bounds checks.
+ *
+ * Pixel (x, y) is at img[(y * stride) + x], for x and y from -apron to
+ * width - 1 + apron and height - 1 + apron. The first pixel of every row is
+ * aligned to PADDED_IMAGE_ALIGNMENT bytes and the row pitch,
+ * stride * sizeof(pixel), is a multiple of it.
+ */
+
+#define PADDED_IMAGE_ALIGNMENT 64u
+
+typedef struct {
+    gray_t  *mem;     // allocation
+    gray_t  *img;     // pixel (0, 0)
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;  // pixels from one row to the next
+    uint32_t apron;   // pixels outside the image on each side
+} padded_gray_img_t;
+
+typedef struct {
+    double  *mem;     // allocation
+    double  *img;     // pixel (0, 0)
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;  // pixels from one row to the next
+    uint32_t apron;   // pixels outside the image on each side
+} padded_double_img_t;
+
+/*!
+ * @brief Allocates image, contents are undefined
+ * @param[out] p : image
+ * @param width : image width
+ * @param height : image height
+ * @param apron : pixels outside the image on each side
+ */
+void padded_gray_img_alloc(
+    padded_gray_img_t *p,
+    const uint32_t     width,
+    const uint32_t     height,
+    const uint32_t     apron
+);
+
+/*!
+ * @brief Allocates image and copies a packed image into it, the apron is
+ * filled
+ * @param[out] p : image
+ * @param in : packed image
+ * @param apron : pixels outside the image on each side
+ */
+void padded_gray_img_from(
+    padded_gray_img_t *p, const gray_img_t *in, const uint32_t apron
+);
+
+/*!
+ * @brief Fills the apron with copies of the edge pixels, call after writing
+ * the image
+ * @param p : image
+ */
+void padded_gray_img_fill_apron(padded_gray_img_t *p);
+
+/*!
+ * @brief Frees image
+ * @param p : image
+ */
+void padded_gray_img_free(padded_gray_img_t *p);
+
+/*!
+ * @brief Allocates image, contents are undefined
+ * @param[out] p : image
+ * @param width : image width
+ * @param height : image height
+ * @param apron : pixels outside the image on each side
+ */
+void padded_double_img_alloc(
+    padded_double_img_t *p,
+    const uint32_t       width,
+    const uint32_t       height,
+    const uint32_t       apron
+);
+
+/*!
+ * @brief Allocates image and copies a packed image into it, the apron is
+ * filled
+ * @param[out] p : image
+ * @param in : packed image
+ * @param apron : pixels outside the image on each side
+ */
+void padded_double_img_from(
+    padded_double_img_t *p, const double_img_t *in, const uint32_t apron
+);
+
+/*!
+ * @brief Fills the apron with copies of the edge pixels, call after writing
+ * the image
+ * @param p : image
+ */
+void padded_double_img_fill_apron(padded_double_img_t *p);
+
+/*!
+ * @brief Frees image
+ * @param p : image
+ */
+void padded_double_img_free(padded_double_img_t *p);
+
+#endif  // _PADDED_IMAGE_H_
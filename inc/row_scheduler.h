@@ -0,0 +1,64 @@
+#ifndef _ROW_SCHEDULER_H_
+#define _ROW_SCHEDULER_H_
+
+#include <stdint.h>
+
+/*
+ * Splits the rows of an image between workers of different speed, e.g.
+ * several OpenCL devices processing one image.
+ *
+ * Each worker gets one strip of consecutive rows, sized in proportion to its
+ * measured throughput (rows per second). Workers that haven't been measured
+ * yet are assumed to be as fast as the average measured worker, or all equal
+ * if nothing has been measured.
+ */
+
+#define ROW_SCHEDULER_MAX_WORKERS 16u
+
+typedef struct {
+    uint32_t num_workers;
+    uint32_t align;  // strip boundaries are multiples of align rows
+    double   throughput[ROW_SCHEDULER_MAX_WORKERS];  // rows/s, 0 if unmeasured
+} row_scheduler_t;
+
+/*!
+ * @brief Initializes scheduler with no measurements
+ * @param[out] s : scheduler to initialize
+ * @param num_workers : number of workers, 1..ROW_SCHEDULER_MAX_WORKERS
+ * @param align : strip boundaries are multiples of this many rows from the
+ * beginning of the split range, e.g. work group height, 0 is treated as 1
+ */
+void row_scheduler_init(
+    row_scheduler_t *s, const uint32_t num_workers, const uint32_t align
+);
+
+/*!
+ * @brief Records a measurement, averaged with the previous one if any
+ * @param s : scheduler
+ * @param worker : worker index
+ * @param rows : number of rows processed
+ * @param ns : time taken in nanoseconds
+ */
+void row_scheduler_record(
+    row_scheduler_t *s,
+    const uint32_t   worker,
+    const uint32_t   rows,
+    const uint64_t   ns
+);
+
+/*!
+ * @brief Splits rows begin..end-1 into one strip per worker
+ * @param s : scheduler
+ * @param begin : first row
+ * @param end : one past last row
+ * @param[out] bounds : num_workers + 1 values, worker i gets rows
+ * bounds[i]..bounds[i+1]-1, which may be empty
+ */
+void row_scheduler_split(
+    const row_scheduler_t *s,
+    const uint32_t         begin,
+    const uint32_t         end,
+    uint32_t              *bounds
+);
+
+#endif  // _ROW_SCHEDULER_H_
@@ -0,0 +1,89 @@
+#ifndef _TASK_POOL_H_
+#define _TASK_POOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * Work-stealing pool of worker threads for loops with uneven iteration costs,
+ * e.g. filling occluded regions where one pixel can take a long BFS.
+ *
+ * The index range of a loop is split evenly between the workers. Each worker
+ * takes `grain` indices at a time from the front of its own range, and once
+ * that is empty steals the back half of the largest remaining range of
+ * another worker. Workers that finish early thus keep helping until nothing
+ * is left, instead of idling like with a static split.
+ *
+ * Plain pthreads, so it can be used from any driver with or without OpenMP.
+ * The calling thread works as worker 0 and the pool threads as 1..N-1, so
+ * per-worker scratch memory can be indexed with the worker id.
+ */
+
+/*!
+ * @brief Task function, processes indices begin..end-1
+ * @param begin : first index
+ * @param end : one past last index
+ * @param worker_id : 0..num_workers-1, unique among concurrently running tasks
+ * @param arg : user pointer given to `task_pool_parallel_for`
+ */
+typedef void (*task_fn_t)(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *arg
+);
+
+// range of indices still to be processed by one worker. Written under the
+// lock with atomic stores, so that thieves can read it without the lock.
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t        begin;
+    uint32_t        end;
+} __attribute__((aligned(64))) task_range_t;
+
+typedef struct {
+    pthread_t      *threads;      // num_workers - 1 threads, worker 0 is caller
+    task_range_t   *ranges;       // one per worker
+    uint32_t        num_workers;
+    pthread_mutex_t lock;         // protects everything below
+    pthread_cond_t  work_ready;
+    pthread_cond_t  work_done;
+    uint64_t        generation;   // incremented for each parallel_for
+    uint32_t        active;       // pool threads still working on current job
+    int             shutdown;
+    task_fn_t       fn;
+    void           *arg;
+    uint32_t        grain;
+} task_pool_t;
+
+/*!
+ * @brief Starts the worker threads
+ * @param[out] pool : pool to initialize
+ * @param num_workers : number of workers including the calling thread, 0 for
+ * number of online CPUs
+ */
+void task_pool_init(task_pool_t *pool, uint32_t num_workers);
+
+/*!
+ * @brief Stops the worker threads and frees resources
+ * @param pool : pool to destroy
+ */
+void task_pool_destroy(task_pool_t *pool);
+
+/*!
+ * @brief Runs fn over indices begin..end-1 on all workers and returns once
+ * every index has been processed. Must not be called from inside a task.
+ * @param pool : initialized pool
+ * @param begin : first index
+ * @param end : one past last index
+ * @param grain : maximum number of indices per fn call, 0 is treated as 1
+ * @param fn : task function
+ * @param arg : passed to fn
+ */
+void task_pool_parallel_for(
+    task_pool_t   *pool,
+    const uint32_t begin,
+    const uint32_t end,
+    const uint32_t grain,
+    task_fn_t      fn,
+    void          *arg
+);
+
+#endif  // _TASK_POOL_H_
@@ -0,0 +1,51 @@
+#ifndef _VISITED_SET_H_
+#define _VISITED_SET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Set of visited pixels for repeated BFS runs over the same image.
+ *
+ * Each pixel stores the epoch it was last visited in, and a pixel is visited
+ * if that equals the current epoch. Clearing the set just starts a new epoch,
+ * so a BFS that touches a dozen pixels doesn't have to clear W * H bytes
+ * first. The whole array is only cleared when the epoch counter wraps around.
+ */
+
+typedef struct visited_set {
+    uint32_t *epoch;     // epoch each pixel was last visited in
+    uint32_t  current;   // current epoch, never 0
+    uint32_t  capacity;  // number of pixels
+} visited_set_t;
+
+/*!
+ * @brief Allocates an empty set
+ * @param[out] set : set to initialize
+ * @param capacity : number of pixels
+ */
+void visited_set_init(visited_set_t *set, uint32_t capacity);
+
+/*!
+ * @brief Frees the memory of the set
+ * @param set : set to free
+ */
+void visited_set_free(visited_set_t *set);
+
+/*!
+ * @brief Removes all pixels from the set in O(1)
+ * @param set : set to clear
+ */
+void visited_set_clear(visited_set_t *set);
+
+static inline bool visited_set_contains(
+    const visited_set_t *set, uint32_t idx
+) {
+    return set->epoch[idx] == set->current;
+}
+
+static inline void visited_set_insert(visited_set_t *set, uint32_t idx) {
+    set->epoch[idx] = set->current;
+}
+
+#endif  // _VISITED_SET_H_
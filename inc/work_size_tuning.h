@@ -0,0 +1,132 @@
+#ifndef _WORK_SIZE_TUNING_H_
+#define _WORK_SIZE_TUNING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Work sizes of kernel launches, picked by timing candidates on the device
+ * and stored in a text file so that later runs can skip the timing.
+ *
+ * Each line of the file is
+ *     <key> <work_dim> <global[0]> <global[1]> <local[0]> <local[1]>
+ * where key identifies the kernel, its build options, the device and the
+ * problem size, see `work_size_key`. Lines starting with '#' are comments.
+ */
+
+#define WORK_SIZE_KEY_LEN 192u
+#define WORK_SIZE_TABLE_MAX_ENTRIES 64u
+#define WORK_SIZE_MAX_CANDIDATES 32u
+// row sections are at most this many rows, launches with fewer work items
+// are too slow to be worth timing
+#define WORK_SIZE_MAX_SECTION_ROWS 32u
+
+// work size of a kernel launch, a local size of 0 lets the runtime choose
+typedef struct {
+    uint32_t work_dim;   // 1 or 2
+    size_t   global[2];  // unused dimensions are 1
+    size_t   local[2];
+} work_size_t;
+
+typedef struct {
+    char        key[WORK_SIZE_KEY_LEN];
+    work_size_t ws;
+} work_size_entry_t;
+
+typedef struct {
+    uint32_t          num_entries;
+    work_size_entry_t entries[WORK_SIZE_TABLE_MAX_ENTRIES];
+} work_size_table_t;
+
+typedef enum {
+    // work item per section of rows, global[0] is the number of sections
+    WORK_SIZE_ROW_SECTIONS,
+    // work item per row, column or pixel, the kernel ignores work items
+    // outside the problem so global sizes are rounded up to the local size
+    WORK_SIZE_PER_ITEM,
+} work_size_kind_t;
+
+/*!
+ * @brief Initializes empty table
+ * @param[out] t : table
+ */
+void work_size_table_init(work_size_table_t *t);
+
+/*!
+ * @brief Adds entries of a tuning file to the table, replacing entries with
+ * the same key. Malformed lines are skipped.
+ * @param t : table
+ * @param path : file path
+ * @return 0 on success, -1 if the file can't be read
+ */
+int32_t work_size_table_load(work_size_table_t *t, const char *path);
+
+/*!
+ * @brief Writes all entries of the table to a tuning file
+ * @param t : table
+ * @param path : file path
+ * @return 0 on success, -1 if the file can't be written
+ */
+int32_t work_size_table_save(const work_size_table_t *t, const char *path);
+
+/*!
+ * @brief Finds work size by key
+ * @param t : table
+ * @param key : key
+ * @return work size, NULL if there is no entry for the key
+ */
+const work_size_t *work_size_table_find(
+    const work_size_table_t *t, const char *key
+);
+
+/*!
+ * @brief Adds entry to the table, or replaces the one with the same key
+ * @param t : table, panics if full
+ * @param key : key
+ * @param ws : work size
+ */
+void work_size_table_set(
+    work_size_table_t *t, const char *key, const work_size_t *ws
+);
+
+/*!
+ * @brief Formats key of a kernel launch, whitespace is replaced by '_'. The
+ * build options are hashed, so that kernels built differently, e.g. for
+ * another image format, are tuned separately.
+ * @param[out] key : WORK_SIZE_KEY_LEN characters
+ * @param kernel : kernel name, including any variant
+ * @param options : build options of the kernel's program, or NULL
+ * @param device : device description, e.g. from `get_device_identity`
+ * @param W : problem width
+ * @param H : problem height
+ */
+void work_size_key(
+    char          *key,
+    const char    *kernel,
+    const char    *options,
+    const char    *device,
+    const uint32_t W,
+    const uint32_t H
+);
+
+/*!
+ * @brief Generates candidate work sizes for a kernel
+ * @param kind : how the kernel maps work items to the problem
+ * @param work_dim : 1 or 2, always 1 for WORK_SIZE_ROW_SECTIONS
+ * @param n0 : number of rows for WORK_SIZE_ROW_SECTIONS, number of items in
+ * the first dimension otherwise
+ * @param n1 : number of items in the second dimension, ignored for 1D
+ * @param max_local : largest work group size to try
+ * @param[out] out : WORK_SIZE_MAX_CANDIDATES values
+ * @return number of candidates, at least 1
+ */
+uint32_t work_size_candidates(
+    const work_size_kind_t kind,
+    const uint32_t         work_dim,
+    const uint32_t         n0,
+    const uint32_t         n1,
+    const uint32_t         max_local,
+    work_size_t           *out
+);
+
+#endif  // _WORK_SIZE_TUNING_H_
@@ -0,0 +1,124 @@
+#ifndef _ZNCC_COST_VOLUME_H_
+#define _ZNCC_COST_VOLUME_H_
+
+#include <stdint.h>
+
+#include "zncc_streaming.h"
+
+/*
+ * Disparity-space ZNCC driver.
+ *
+ * Instead of computing sum(L * R) separately for every (x, y, d), the product
+ * image L(x, y) * R(x - d, y) of one disparity is box filtered with running
+ * column sums. Each window sum is then updated from its neighbour in O(1),
+ * independent of window size. Scores are the same as `calculate_zncc_row`.
+ *
+ * Left to right and right to left searches score the same window pairs, the
+ * fused variant computes each score once and updates both disparity images.
+ *
+ * Work is split into bands of rows, each band only needs its own scratch
+ * memory so bands can be processed in parallel. Within a band, columns are
+ * processed in tiles narrow enough that everything touched while looping over
+ * the disparities stays in L2 cache.
+ */
+
+/*!
+ * @brief Number of doubles needed as scratch memory by
+ * `calculate_zncc_cost_volume`
+ * @param W : image width
+ * @param band_height : maximum number of rows processed in one call
+ * @param win_width : window width
+ * @param win_height : window height
+ * @return number of doubles
+ */
+uint32_t zncc_cost_volume_scratch_size(
+    const uint32_t W,
+    const uint32_t band_height,
+    const uint32_t win_width,
+    const uint32_t win_height
+);
+
+/*!
+ * @brief Picks a tile width for `calculate_zncc_cost_volume` so that the data
+ * of one tile fits in half of the L2 cache of the CPU. The width is never
+ * below 64 columns, so with tall bands or a small L2 a tile and its apron
+ * can take more than half of it.
+ * @param band_height : maximum number of rows processed in one call
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param max_disp : disparities 0..max_disp-1 are searched
+ * @return tile width in pixels
+ */
+uint32_t zncc_cost_volume_tile_width(
+    const uint32_t band_height,
+    const uint32_t win_width,
+    const uint32_t win_height,
+    const uint32_t max_disp
+);
+
+/*!
+ * @brief Finds best disparity for each pixel on rows y_begin..y_end-1
+ * @param left : left image and its window statistics
+ * @param right : right image and its window statistics
+ * @param y_begin : first row to process
+ * @param y_end : one past last row to process
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param max_disp : disparities 0..max_disp-1 are searched
+ * @param direction : positive for left to right, negative for right to left
+ * @param tile_width : number of columns processed at a time, 0 for the whole
+ * row. Doesn't change the result.
+ * @param scratch : `zncc_cost_volume_scratch_size` doubles, or NULL to
+ * allocate internally
+ * @param[out] out : disparity image, W * H values, only the given rows are
+ * written
+ */
+void calculate_zncc_cost_volume(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y_begin,
+    const uint32_t      y_end,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const int32_t       direction,
+    const uint32_t      tile_width,
+    double             *scratch,
+    int32_t            *out
+);
+
+/*!
+ * @brief Finds best disparity for each pixel on rows y_begin..y_end-1 in both
+ * directions at once, same result as calling `calculate_zncc_cost_volume`
+ * with direction 1 and -1
+ * @param left : left image and its window statistics
+ * @param right : right image and its window statistics
+ * @param y_begin : first row to process
+ * @param y_end : one past last row to process
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param max_disp : disparities 0..max_disp-1 are searched
+ * @param tile_width : number of columns processed at a time, 0 for the whole
+ * row. Doesn't change the result.
+ * @param scratch : `zncc_cost_volume_scratch_size` doubles, or NULL to
+ * allocate internally
+ * @param[out] out_ltr : left to right disparity image, W * H values, only the
+ * given rows are written
+ * @param[out] out_rtl : right to left disparity image, W * H values, only the
+ * given rows are written
+ */
+void calculate_zncc_cost_volume_fused(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y_begin,
+    const uint32_t      y_end,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const uint32_t      tile_width,
+    double             *scratch,
+    int32_t            *out_ltr,
+    int32_t            *out_rtl
+);
+
+#endif  // _ZNCC_COST_VOLUME_H_
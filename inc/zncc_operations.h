@@ -4,7 +4,9 @@
 #include <stdint.h>
 
 #include "coord_fifo.h"
+#include "padded_image.h"
 #include "types.h"
+#include "visited_set.h"
 
 void extract_window(
     double        *in,
@@ -17,6 +19,26 @@ void extract_window(
     const uint32_t in_height
 );
 
+/*!
+ * @brief Like `extract_window`, but the apron stands in for the clamped
+ * pixels, so rows are copied without bounds checks
+ * @param in : image with an apron of at least (win_width - 1) / 2 and
+ * (win_height - 1) / 2 pixels
+ * @param[out] out : win_width * win_height values
+ * @param x_offset : x coordinate of the window centre
+ * @param y_offset : y coordinate of the window centre
+ * @param win_width : window width
+ * @param win_height : window height
+ */
+void extract_window_padded(
+    const padded_double_img_t *in,
+    double                    *out,
+    const uint32_t             x_offset,
+    const uint32_t             y_offset,
+    const uint32_t             win_width,
+    const uint32_t             win_height
+);
+
 double calculate_window_mean(double *img, const uint32_t W, const uint32_t H);
 
 double calculate_window_standard_deviation(
@@ -35,6 +57,10 @@ double window_dot_product(
     double *left, double *right, const uint32_t W, const uint32_t H
 );
 
+void invert_standard_deviation(
+    double *std_dev, double *inv_std_dev, const uint32_t N
+);
+
 int32_t find_nearest_nonzero_neighbour(
     int32_t      *img,
     uint32_t      W,
@@ -45,4 +71,100 @@ int32_t find_nearest_nonzero_neighbour(
     coord_fifo_t *fifo
 );
 
+/*!
+ * @brief Like `find_nearest_nonzero_neighbour`, but with a visited set that is
+ * cleared in O(1) instead of a W * H byte map cleared on every call
+ * @param img : image, W * H values
+ * @param W : image width
+ * @param H : image height
+ * @param x : x coordinate of the pixel
+ * @param y : y coordinate of the pixel
+ * @param visited : visited set with capacity W * H, reused between calls
+ * @param fifo : BFS queue with capacity W * H, reused between calls
+ * @return nearest nonzero value, 0 if there is none or x, y is out of bounds
+ */
+int32_t find_nearest_nonzero_neighbour_visited_set(
+    int32_t       *img,
+    uint32_t       W,
+    uint32_t       H,
+    uint32_t       x,
+    uint32_t       y,
+    visited_set_t *visited,
+    coord_fifo_t  *fifo
+);
+
+/*
+ * Filling zero regions in linear time.
+ *
+ * Every zero pixel gets the value of the nearest nonzero pixel of the input,
+ * measured in Manhattan distance like the BFS of
+ * `find_nearest_nonzero_neighbour`. This is a distance transform with label
+ * propagation in two separable passes: the row pass finds the nearest nonzero
+ * pixel on the same row, and the column pass combines the row results since
+ * |dx| + |dy| = min over rows y' of (row distance on y' + |y - y'|).
+ * Each pass is two linear scans, so the whole image costs O(W * H) no matter
+ * how large the holes are.
+ *
+ * Rows are independent in the row pass and columns in the column pass, so the
+ * passes can be split between threads, as long as the row pass is finished
+ * for every row before the column pass starts.
+ *
+ * Ties are resolved towards the left and then upwards, so results can differ
+ * from the BFS where two nonzero pixels are equally near. Unlike filling pixel
+ * by pixel with the BFS, filled pixels are never used as sources, so the
+ * result doesn't depend on the processing order.
+ */
+
+/*!
+ * @brief Row pass of `fill_zero_regions`
+ * @param img : image, W * H values, zeros on rows y_begin..y_end-1 are filled
+ * with the nearest nonzero value on the same row, if there is one
+ * @param[out] dist : W * H values, distance to the source of each pixel on
+ * rows y_begin..y_end-1
+ * @param W : image width
+ * @param H : image height
+ * @param y_begin : first row
+ * @param y_end : one past last row
+ */
+void fill_zero_regions_rows(
+    int32_t       *img,
+    uint32_t      *dist,
+    const uint32_t W,
+    const uint32_t H,
+    const uint32_t y_begin,
+    const uint32_t y_end
+);
+
+/*!
+ * @brief Column pass of `fill_zero_regions`, the row pass must be complete for
+ * all rows
+ * @param img : image after the row pass, columns x_begin..x_end-1 are updated
+ * @param dist : distances from the row pass, columns x_begin..x_end-1 are
+ * updated
+ * @param W : image width
+ * @param H : image height
+ * @param x_begin : first column
+ * @param x_end : one past last column
+ */
+void fill_zero_regions_columns(
+    int32_t       *img,
+    uint32_t      *dist,
+    const uint32_t W,
+    const uint32_t H,
+    const uint32_t x_begin,
+    const uint32_t x_end
+);
+
+/*!
+ * @brief Replaces every zero pixel with the nearest nonzero pixel. If the
+ * image is all zeros it is left as is.
+ * @param img : image, W * H values
+ * @param dist : scratch memory, W * H values, or NULL to allocate internally
+ * @param W : image width
+ * @param H : image height
+ */
+void fill_zero_regions(
+    int32_t *img, uint32_t *dist, const uint32_t W, const uint32_t H
+);
+
 #endif  // _ZNCC_OPERATIONS_H_
\ No newline at end of file
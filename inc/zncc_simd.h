@@ -0,0 +1,184 @@
+#ifndef _ZNCC_SIMD_H_
+#define _ZNCC_SIMD_H_
+
+#include <stdint.h>
+
+#include "types.h"
+#include "zncc_streaming.h"
+
+/*
+ * Single precision ZNCC with SIMD dot products.
+ *
+ * Normalized windows of the row being processed are packed as floats, each
+ * window padded with zeros to a multiple of 16 floats (64 bytes) and aligned
+ * to 64 bytes. A 9x9 window then takes 96 floats, and its dot product is
+ * 6 AVX-512 or 12 AVX2 FMA instructions with no remainder loop.
+ *
+ * There is also an integer variant working directly on 8-bit grayscale pixels.
+ * Windows are packed as raw uint8 (8x less memory traffic than double),
+ * sum(L * R) is computed exactly with pmaddwd and the score is normalized at
+ * the end with the double mean and inverse std dev, so the result matches the
+ * double drivers exactly.
+ *
+ * The instruction set is picked at runtime based on what the CPU supports,
+ * the binary itself doesn't need to be built with -mavx2 etc.
+ */
+
+typedef enum {
+    ZNCC_SIMD_SCALAR,  // plain C
+    ZNCC_SIMD_AVX2,    // AVX2 + FMA
+    ZNCC_SIMD_AVX512   // AVX-512F + AVX-512BW
+} zncc_simd_level_e;
+
+// alignment of packed windows and scratch memory
+#define ZNCC_SIMD_ALIGNMENT 64u
+
+/*!
+ * @brief Detects best instruction set supported by the CPU
+ * @return instruction set level
+ */
+zncc_simd_level_e zncc_simd_detect(void);
+
+/*!
+ * @brief Returns the instruction set used by the functions below. Defaults to
+ * `zncc_simd_detect()`.
+ * @return instruction set level
+ */
+zncc_simd_level_e zncc_simd_get_level(void);
+
+/*!
+ * @brief Overrides the instruction set used, e.g. to compare implementations.
+ * Levels not supported by the CPU fall back to the best supported one.
+ * @param level : instruction set level
+ */
+void zncc_simd_set_level(zncc_simd_level_e level);
+
+/*!
+ * @brief Number of floats used for one packed window
+ * @param win_width : window width
+ * @param win_height : window height
+ * @return window size rounded up to a multiple of 16
+ */
+uint32_t zncc_simd_window_stride(
+    const uint32_t win_width, const uint32_t win_height
+);
+
+/*!
+ * @brief Dot product of two packed windows
+ * @param a : packed window, aligned to ZNCC_SIMD_ALIGNMENT
+ * @param b : packed window, aligned to ZNCC_SIMD_ALIGNMENT
+ * @param stride : `zncc_simd_window_stride()`
+ * @return dot product
+ */
+float window_dot_product_f32(
+    const float *a, const float *b, const uint32_t stride
+);
+
+/*!
+ * @brief Number of floats needed as scratch memory by
+ * `calculate_zncc_row_f32`
+ * @param W : image width
+ * @param win_width : window width
+ * @param win_height : window height
+ * @return number of floats
+ */
+uint32_t zncc_row_f32_scratch_size(
+    const uint32_t W, const uint32_t win_width, const uint32_t win_height
+);
+
+/*!
+ * @brief Finds best disparity for each pixel on one row, like
+ * `calculate_zncc_row` but in single precision
+ * @param left : left image and its window statistics
+ * @param right : right image and its window statistics
+ * @param y : row to process
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param max_disp : disparities 0..max_disp-1 are searched
+ * @param direction : positive for left to right, negative for right to left
+ * @param scratch : `zncc_row_f32_scratch_size` floats aligned to
+ * ZNCC_SIMD_ALIGNMENT, or NULL to allocate internally
+ * @param[out] out : best disparity for each pixel on the row, W values
+ */
+void calculate_zncc_row_f32(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const int32_t       direction,
+    float              *scratch,
+    int32_t            *out
+);
+
+/*
+ * Input for the integer driver, like `zncc_input_t` but with 8-bit pixels.
+ */
+typedef struct {
+    gray_t  *img;          // image, W * H values
+    double  *mean;         // window mean, W * H values
+    double  *inv_std_dev;  // inverse window standard deviation, W * H values
+    uint32_t width;
+    uint32_t height;
+} zncc_gray_input_t;
+
+/*!
+ * @brief Number of bytes used for one packed 8-bit window
+ * @param win_width : window width
+ * @param win_height : window height
+ * @return window size rounded up to a multiple of 32
+ */
+uint32_t zncc_simd_window_stride_u8(
+    const uint32_t win_width, const uint32_t win_height
+);
+
+/*!
+ * @brief Integer dot product of two packed 8-bit windows
+ * @param a : packed window, aligned to ZNCC_SIMD_ALIGNMENT
+ * @param b : packed window, aligned to ZNCC_SIMD_ALIGNMENT
+ * @param stride : `zncc_simd_window_stride_u8()`
+ * @return dot product
+ */
+int32_t window_dot_product_u8(
+    const gray_t *a, const gray_t *b, const uint32_t stride
+);
+
+/*!
+ * @brief Number of bytes needed as scratch memory by `calculate_zncc_row_u8`
+ * @param W : image width
+ * @param win_width : window width
+ * @param win_height : window height
+ * @return number of bytes
+ */
+uint32_t zncc_row_u8_scratch_size(
+    const uint32_t W, const uint32_t win_width, const uint32_t win_height
+);
+
+/*!
+ * @brief Finds best disparity for each pixel on one row, like
+ * `calculate_zncc_row` but with integer window sums
+ * @param left : left image and its window statistics
+ * @param right : right image and its window statistics
+ * @param y : row to process
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param max_disp : disparities 0..max_disp-1 are searched
+ * @param direction : positive for left to right, negative for right to left
+ * @param scratch : `zncc_row_u8_scratch_size` bytes aligned to
+ * ZNCC_SIMD_ALIGNMENT, or NULL to allocate internally
+ * @param[out] out : best disparity for each pixel on the row, W values
+ */
+void calculate_zncc_row_u8(
+    const zncc_gray_input_t *left,
+    const zncc_gray_input_t *right,
+    const uint32_t           y,
+    const uint32_t           win_width,
+    const uint32_t           win_height,
+    const uint32_t           max_disp,
+    const int32_t            direction,
+    gray_t                  *scratch,
+    int32_t                 *out
+);
+
+#endif  // _ZNCC_SIMD_H_
@@ -0,0 +1,81 @@
+#ifndef _ZNCC_STREAMING_H_
+#define _ZNCC_STREAMING_H_
+
+#include <stdint.h>
+
+/*
+ * Input for the ZNCC drivers: an image together with the mean and inverse
+ * standard deviation of the window centered on each pixel.
+ *
+ * Scores are computed as (sum(L * R) - N * mean_L * mean_R) * inv_L * inv_R,
+ * which is the same as the dot product of the normalized windows, without
+ * ever storing the normalized windows themselves.
+ */
+typedef struct {
+    double  *img;         // image, W * H values
+    double  *mean;        // window mean, W * H values
+    double  *inv_std_dev; // inverse window standard deviation, W * H values
+    uint32_t width;
+    uint32_t height;
+} zncc_input_t;
+
+/*!
+ * @brief Copies image rows first_row..first_row+num_rows-1 into `rows`, with
+ * rx replicated pixels on both sides of every row. Rows outside the image are
+ * clamped like in `extract_window`, so the window of pixel x starts at column
+ * x of each copied row and needs no clamping.
+ * @param img : input image
+ * @param W : image width
+ * @param H : image height
+ * @param first_row : first row to copy, can be negative
+ * @param num_rows : number of rows to copy
+ * @param rx : horizontal window radius
+ * @param[out] rows : num_rows * (W + 2 * rx) values
+ */
+void copy_padded_rows(
+    const double  *img,
+    const uint32_t W,
+    const uint32_t H,
+    const int32_t  first_row,
+    const uint32_t num_rows,
+    const uint32_t rx,
+    double        *rows
+);
+
+/*!
+ * @brief Number of doubles needed as scratch memory by `calculate_zncc_row`
+ * @param W : image width
+ * @param win_width : window width
+ * @param win_height : window height
+ * @return number of doubles
+ */
+uint32_t zncc_row_scratch_size(
+    const uint32_t W, const uint32_t win_width, const uint32_t win_height
+);
+
+/*!
+ * @brief Finds best disparity for each pixel on one row
+ * @param left : left image and its window statistics
+ * @param right : right image and its window statistics
+ * @param y : row to process
+ * @param win_width : window width
+ * @param win_height : window height
+ * @param max_disp : disparities 0..max_disp-1 are searched
+ * @param direction : positive for left to right, negative for right to left
+ * @param scratch : `zncc_row_scratch_size` doubles, or NULL to allocate
+ * internally
+ * @param[out] out : best disparity for each pixel on the row, W values
+ */
+void calculate_zncc_row(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const int32_t       direction,
+    double             *scratch,
+    int32_t            *out
+);
+
+#endif  // _ZNCC_STREAMING_H_
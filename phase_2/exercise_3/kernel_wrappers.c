@@ -199,5 +199,144 @@ void enqueue_filtering_work(
         return;
     }
 
+    *err = CL_SUCCESS;
+}
+
+void enqueue_box_filtering_work(
+    cl_command_queue queue,
+    cl_kernel        columns_kernel,
+    cl_kernel        rows_kernel,
+    const uint32_t   group_size,
+    const uint32_t   Wi,
+    const uint32_t   Hi,
+    const int32_t    R,
+    cl_mem           img_in,
+    cl_mem           col_sums,
+    cl_mem           img_out,
+    cl_event        *columns_prof_evt,
+    cl_event        *rows_prof_evt,
+    cl_int          *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    // columns: W, H, R, in, out
+    internal_err = clSetKernelArg(columns_kernel, 0, sizeof(uint32_t), &Wi);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(columns_kernel, 1, sizeof(uint32_t), &Hi);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(columns_kernel, 2, sizeof(int32_t), &R);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(columns_kernel, 3, sizeof(cl_mem), &img_in);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(columns_kernel, 4, sizeof(cl_mem), &col_sums);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    const size_t columns_global_ids[1] = {Wi};
+
+    internal_err = clEnqueueNDRangeKernel(
+        queue,
+        columns_kernel,
+        1,
+        NULL,
+        columns_global_ids,
+        NULL,
+        0,
+        NULL,
+        columns_prof_evt
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    // rows: W, H, R, in, out, prefix, totals
+    internal_err = clSetKernelArg(rows_kernel, 0, sizeof(uint32_t), &Wi);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(rows_kernel, 1, sizeof(uint32_t), &Hi);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(rows_kernel, 2, sizeof(int32_t), &R);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(rows_kernel, 3, sizeof(cl_mem), &col_sums);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err = clSetKernelArg(rows_kernel, 4, sizeof(cl_mem), &img_out);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    // local memory, prefix sums of the row and its apron
+    internal_err = clSetKernelArg(
+        rows_kernel, 5, sizeof(cl_uint) * (Wi + (2 * R) + 1), NULL
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    internal_err =
+        clSetKernelArg(rows_kernel, 6, sizeof(cl_uint) * group_size, NULL);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    const size_t rows_global_ids[2] = {group_size, Hi};
+    const size_t rows_local_ids[2]  = {group_size, 1};
+
+    // in-order queue, so this waits for the column sums
+    internal_err = clEnqueueNDRangeKernel(
+        queue,
+        rows_kernel,
+        2,
+        NULL,
+        rows_global_ids,
+        rows_local_ids,
+        0,
+        NULL,
+        rows_prof_evt
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
     *err = CL_SUCCESS;
 }
\ No newline at end of file
@@ -44,4 +44,22 @@ void enqueue_filtering_work(
     cl_int          *err
 );
 
+// runs box_filter_columns_kernel into col_sums (W * H uints) and then
+// box_filter_rows_kernel with one work group of group_size work items per row
+void enqueue_box_filtering_work(
+    cl_command_queue queue,
+    cl_kernel        columns_kernel,
+    cl_kernel        rows_kernel,
+    const uint32_t   group_size,
+    const uint32_t   Wi,
+    const uint32_t   Hi,
+    const int32_t    R,
+    cl_mem           img_in,
+    cl_mem           col_sums,
+    cl_mem           img_out,
+    cl_event        *columns_prof_evt,
+    cl_event        *rows_prof_evt,
+    cl_int          *err
+);
+
 #endif  // _KERNEL_WRAPPERS_H_
\ No newline at end of file
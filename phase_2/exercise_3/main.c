@@ -23,6 +23,15 @@
 #define DOWNSCALING_KERNEL_NAME "downscale_kernel"
 #define GRAYSCALING_KERNEL_NAME "grayscale_kernel"
 #define FILTERING_KERNEL_NAME "smoothing_kernel"
+#define BOX_FILTER_COLUMNS_KERNEL_NAME "box_filter_columns_kernel"
+#define BOX_FILTER_ROWS_KERNEL_NAME "box_filter_rows_kernel"
+
+// 1 for the separable running-sum filter, 0 for smoothing_kernel which sums
+// every pixel of the window
+#define SEPARABLE_FILTERING 1
+#define FILTERING_RADIUS SMOOTHING_KERNEL_RADIUS
+// work items per row of box_filter_rows_kernel, if the device allows
+#define BOX_FILTER_GROUP_SIZE 64
 
 int main() {
     puts("hello world");
@@ -65,6 +74,8 @@ int main() {
     cl_kernel        downscaling_kernel;
     cl_kernel        grayscaling_kernel;
     cl_kernel        filtering_kernel;
+    cl_kernel        box_filter_columns_kernel;
+    cl_kernel        box_filter_rows_kernel;
     cl_context       ctx;
     cl_device_id     device;
     cl_command_queue queue;
@@ -102,6 +113,28 @@ int main() {
     filtering_kernel =
         build_kernel(FILTERING_KERNEL_NAME, filtering_program, &err);
     check_cl_error(err);
+    box_filter_columns_kernel =
+        build_kernel(BOX_FILTER_COLUMNS_KERNEL_NAME, filtering_program, &err);
+    check_cl_error(err);
+    box_filter_rows_kernel =
+        build_kernel(BOX_FILTER_ROWS_KERNEL_NAME, filtering_program, &err);
+    check_cl_error(err);
+
+    // work group size of the rows kernel is limited by the device
+    size_t box_filter_group_size = 0;
+
+    err = clGetKernelWorkGroupInfo(
+        box_filter_rows_kernel,
+        device,
+        CL_KERNEL_WORK_GROUP_SIZE,
+        sizeof(box_filter_group_size),
+        &box_filter_group_size,
+        NULL
+    );
+    check_cl_error(err);
+    if (box_filter_group_size > BOX_FILTER_GROUP_SIZE) {
+        box_filter_group_size = BOX_FILTER_GROUP_SIZE;
+    }
 
     // run kernels
     // note about work dimensions:
@@ -136,6 +169,16 @@ int main() {
     );
     check_cl_error(err);
 
+    // column sums of the separable filter
+    cl_mem col_sums = clCreateBuffer(
+        ctx,
+        CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS,
+        sizeof(cl_uint) * Wo * Ho,
+        NULL,
+        &err
+    );
+    check_cl_error(err);
+
     cl_mem filtered_img = clCreateBuffer(
         ctx,
         CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY,
@@ -153,6 +196,7 @@ int main() {
     cl_event downscaling_prof_evt;
     cl_event grayscaling_prof_evt;
     cl_event filtering_prof_evt;
+    cl_event filtering_rows_prof_evt = NULL;
 
     // enqueue downscaling work
     enqueue_downscaling_work(
@@ -192,18 +236,36 @@ int main() {
     check_cl_error(err);
 
     // enqueue filtering work
+#if SEPARABLE_FILTERING
+    enqueue_box_filtering_work(
+        queue,
+        box_filter_columns_kernel,
+        box_filter_rows_kernel,
+        (uint32_t)box_filter_group_size,
+        Wo,
+        Ho,
+        FILTERING_RADIUS,
+        grayscaled_img,
+        col_sums,
+        filtered_img,
+        &filtering_prof_evt,
+        &filtering_rows_prof_evt,
+        &err
+    );
+#else
     enqueue_filtering_work(
         queue,
         filtering_kernel,
         N,
         Wo,
         Ho,
-        2,
+        FILTERING_RADIUS,
         grayscaled_img,
         filtered_img,
         &filtering_prof_evt,
         &err
     );
+#endif
     check_cl_error(err);
 
     err = clFinish(queue);
@@ -229,7 +291,8 @@ int main() {
     // print profiling information
     uint64_t downscaling_ns = get_exec_ns(downscaling_prof_evt);
     uint64_t grayscaling_ns = get_exec_ns(grayscaling_prof_evt);
-    uint64_t filtering_ns   = get_exec_ns(filtering_prof_evt);
+    uint64_t filtering_ns   = get_exec_ns(filtering_prof_evt) +
+        get_exec_ns(filtering_rows_prof_evt);
     PROFILING_RAW_PRINT_US("downscaling", downscaling_ns);
     PROFILING_RAW_PRINT_US("grayscaling", grayscaling_ns);
     PROFILING_RAW_PRINT_US("filtering", filtering_ns);
@@ -241,12 +304,15 @@ int main() {
     free(downscaling_kernel);
     free(grayscaling_kernel);
     free(filtering_kernel);
+    clReleaseKernel(box_filter_columns_kernel);
+    clReleaseKernel(box_filter_rows_kernel);
     free(ctx);
     free(device);
     free(queue);
     free(input_rgba_img);
     free(downscaled_rgba_img);
     free(grayscaled_img);
+    clReleaseMemObject(col_sums);
     free(filtered_img);
     free(output_img_data);
     free(load_res.img_desc.img);
@@ -59,4 +59,102 @@ __kernel void smoothing_kernel(
             out[(y*W) + x] = (unsigned char)(v / (A));
         }
     }
-}
\ No newline at end of file
+}
+
+// Separable box filter with the same result as smoothing_kernel, but O(1)
+// work per pixel for any R:
+// 1. box_filter_columns_kernel slides a window of 2R+1 rows down each column
+//    and stores the column sums
+// 2. box_filter_rows_kernel sums 2R+1 column sums along each row as the
+//    difference of two prefix sums, computed in local memory
+
+__kernel void box_filter_columns_kernel(
+    const unsigned int W,
+    const unsigned int H,
+    const int R,
+    __global const unsigned char *in,
+    __global unsigned int *out
+) {
+    // one work item per column, neighbouring work items read neighbouring
+    // pixels
+    const int x = get_global_id(0);
+    if (x >= W) {
+        return;
+    }
+
+    const int max_y = H - 1;
+
+    unsigned int v = 0;
+    for (int dy = -R; dy <= R; ++dy) {
+        v += (unsigned int)in[(clamp(dy, 0, max_y)*W) + x];
+    }
+    out[x] = v;
+
+    for (int y = 1; y < H; ++y) {
+        v += (unsigned int)in[(min(y + R, max_y)*W) + x];
+        v -= (unsigned int)in[(max(y - R - 1, 0)*W) + x];
+        out[(y*W) + x] = v;
+    }
+}
+
+__kernel void box_filter_rows_kernel(
+    const unsigned int W,
+    const unsigned int H,
+    const int R,
+    __global const unsigned int *in,
+    __global unsigned char *out,
+    __local unsigned int *prefix,   // W + 2R + 1 values
+    __local unsigned int *totals    // local size values
+) {
+    // one work group per row
+    const int y = get_group_id(1);
+    const int l = get_local_id(0);
+    const int L = get_local_size(0);
+
+    const unsigned int A = ((2*R)+1)*((2*R)+1); // A for area, "R*R"
+    const int n = W + (2*R);                    // row with R clamped pixels on both sides
+    const int max_x = W - 1;
+
+    __global const unsigned int *row = &in[y*W];
+
+    // prefix[i + 1] is the row value at i - R, loaded with coalesced reads
+    for (int i = l; i < n; i += L) {
+        prefix[i + 1] = row[clamp(i - R, 0, max_x)];
+    }
+    if (l == 0) {
+        prefix[0] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // each work item scans a chunk of the row
+    const int chunk = (n + L - 1) / L;
+    const int lo = min(l*chunk, n);
+    const int hi = min(lo + chunk, n);
+
+    unsigned int s = 0;
+    for (int i = lo; i < hi; ++i) {
+        s += prefix[i + 1];
+        prefix[i + 1] = s;
+    }
+    totals[l] = s;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // inclusive scan of the chunk totals
+    for (int offset = 1; offset < L; offset *= 2) {
+        const unsigned int t = (l >= offset) ? totals[l - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        totals[l] += t;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const unsigned int base = (l > 0) ? totals[l - 1] : 0;
+    for (int i = lo; i < hi; ++i) {
+        prefix[i + 1] += base;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int x = l; x < W; x += L) {
+        const unsigned int v = prefix[x + (2*R) + 1] - prefix[x];
+        out[(y*W) + x] = (unsigned char)(v / A);
+    }
+}
@@ -5,9 +5,11 @@
 #include <lodepng.h>
 
 #include "image_operations.h"
+#include "padded_image.h"
 #include "panic.h"
 #include "profiling.h"
 #include "types.h"
+#include "visited_set.h"
 #include "zncc_operations.h"
 
 #define IMAGE_PATH_LEFT "./test_images/im0.png"
@@ -22,6 +24,8 @@
 #define WINDOW_WIDTH 9u
 #define WINDOW_HEIGHT 9u
 #define WINDOW_SIZE (WINDOW_WIDTH * WINDOW_HEIGHT)
+// apron of the padded images, enough for the (square) windows of edge pixels
+#define WINDOW_APRON ((WINDOW_WIDTH - 1) / 2)
 #define MAX_DISP (260u / SCALING_FACTOR_WIDTH)
 #define MAX_GS_VALUE 255u
 #define CROSSCHECK_THRESHOLD 8
@@ -67,51 +71,60 @@ int main() {
 
     PROFILING_BLOCK_BEGIN(preprocessing);
 
-    // downscale
-    rgba_img_t img_left_ds = {
+    // downscale, convert to grayscale and widen to double in one pass
+    double_img_t img_left_f = {
         .img    = NULL,
         .width  = img_left.img_desc.width / SCALING_FACTOR_WIDTH,
         .height = img_left.img_desc.height / SCALING_FACTOR_HEIGHT
     };
-    rgba_img_t img_right_ds = {
+    double_img_t img_right_f = {
         .img    = NULL,
         .width  = img_right.img_desc.width / SCALING_FACTOR_WIDTH,
         .height = img_right.img_desc.height / SCALING_FACTOR_HEIGHT
     };
-    scale_down_image(&img_left.img_desc, &img_left_ds);
-    scale_down_image(&img_right.img_desc, &img_right_ds);
+
+    img_left_f.img =
+        malloc(img_left_f.width * img_left_f.height * sizeof(double));
+    img_right_f.img =
+        malloc(img_right_f.width * img_right_f.height * sizeof(double));
+    assert(img_left_f.img != NULL);
+    assert(img_right_f.img != NULL);
+
+    downscale_to_grayscale(
+        &img_left.img_desc,
+        img_left_f.img,
+        GS_DOUBLE,
+        img_left_f.width,
+        img_left_f.height,
+        0,
+        img_left_f.height
+    );
+    downscale_to_grayscale(
+        &img_right.img_desc,
+        img_right_f.img,
+        GS_DOUBLE,
+        img_right_f.width,
+        img_right_f.height,
+        0,
+        img_right_f.height
+    );
 
     // don't need original images anymore
     free(img_left.img_desc.img);
     free(img_right.img_desc.img);
 
-    // convert to grayscale
-    gray_img_t img_left_gs  = {.img = NULL};
-    gray_img_t img_right_gs = {.img = NULL};
-
-    convert_to_grayscale(&img_left_ds, &img_left_gs);
-    convert_to_grayscale(&img_right_ds, &img_right_gs);
-
-    // don't need scaled down RGBA images anymore
-    free(img_left_ds.img);
-    free(img_right_ds.img);
-
-    double_img_t img_left_f  = {.img = NULL};
-    double_img_t img_right_f = {.img = NULL};
-
-    convert_to_double(&img_left_gs, &img_left_f);
-    convert_to_double(&img_right_gs, &img_right_f);
-
-    // don't need GS images anymore
-    free(img_left_gs.img);
-    free(img_right_gs.img);
-
     assert(img_left_f.width == img_right_f.width);
     assert(img_left_f.height == img_right_f.height);
 
     const uint32_t W = img_left_f.width;
     const uint32_t H = img_left_f.height;
 
+    // windows are copied from padded images, so they need no clamping
+    padded_double_img_t padded_left;
+    padded_double_img_t padded_right;
+    padded_double_img_from(&padded_left, &img_left_f, WINDOW_APRON);
+    padded_double_img_from(&padded_right, &img_right_f, WINDOW_APRON);
+
     printf("pre-processing data windows...\n");
 
     const size_t preprocessed_window_size = sizeof(double) * WINDOW_SIZE;
@@ -143,15 +156,8 @@ int main() {
                 double *window =
                     &preprocessed_windows_left[((y * W) + x) * WINDOW_SIZE];
 
-                extract_window(
-                    img_left_f.img,
-                    window,
-                    x,
-                    y,
-                    WINDOW_WIDTH,
-                    WINDOW_HEIGHT,
-                    W,
-                    H
+                extract_window_padded(
+                    &padded_left, window, x, y, WINDOW_WIDTH, WINDOW_HEIGHT
                 );
                 double mean =
                     calculate_window_mean(window, WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -169,15 +175,8 @@ int main() {
             {
                 double *window =
                     &preprocessed_windows_right[((y * W) + x) * WINDOW_SIZE];
-                extract_window(
-                    img_right_f.img,
-                    window,
-                    x,
-                    y,
-                    WINDOW_WIDTH,
-                    WINDOW_HEIGHT,
-                    W,
-                    H
+                extract_window_padded(
+                    &padded_right, window, x, y, WINDOW_WIDTH, WINDOW_HEIGHT
                 );
                 double mean =
                     calculate_window_mean(window, WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -247,6 +246,8 @@ int main() {
     // don't need float input images anymore
     free(img_left_f.img);
     free(img_right_f.img);
+    padded_double_img_free(&padded_left);
+    padded_double_img_free(&padded_right);
 
     // don't need intermediate images either
     free(mean_left);
@@ -404,13 +405,14 @@ int main() {
 #endif
 
     printf("filling empty regions...\n");
-    uint8_t     *visited = malloc(W * H * sizeof(uint8_t));
-    coord_fifo_t fifo    = {
-           .storage  = malloc(W * H * sizeof(coord_t)),
-           .read     = 0,
-           .write    = 0,
-           .capacity = W * H
+    visited_set_t visited;
+    coord_fifo_t  fifo = {
+         .storage  = malloc(W * H * sizeof(coord_t)),
+         .read     = 0,
+         .write    = 0,
+         .capacity = W * H
     };
+    visited_set_init(&visited, W * H);
     for (uint32_t y = 0; y < H; ++y) {
 #if PROGRESS_PRINTS == 1
         printf("\rprogress: %03.2f%%", ((double)y / (double)H) * 100.0);
@@ -420,15 +422,15 @@ int main() {
         for (uint32_t x = 0; x < W; ++x) {
             int32_t curr = combined[(y * W) + x];
             if (curr == 0) {
-                int32_t nnzn = find_nearest_nonzero_neighbour(
-                    combined, W, H, x, y, visited, &fifo
+                int32_t nnzn = find_nearest_nonzero_neighbour_visited_set(
+                    combined, W, H, x, y, &visited, &fifo
                 );
                 combined[(y * W) + x] = nnzn;
             }
         }
     }
     free(fifo.storage);
-    free(visited);
+    visited_set_free(&visited);
 #if PROGRESS_PRINTS == 1
     printf("\rprogress: 100.00%%\n\n");
 #endif
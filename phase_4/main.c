@@ -1,16 +1,22 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <omp.h>
 
 #include <lodepng.h>
 
 #include "image_operations.h"
+#include "integral_image.h"
 #include "panic.h"
 #include "profiling.h"
+#include "task_pool.h"
 #include "types.h"
+#include "zncc_cost_volume.h"
 #include "zncc_operations.h"
+#include "zncc_simd.h"
+#include "zncc_streaming.h"
 
 #define IMAGE_PATH_LEFT "./test_images/im0.png"
 #define IMAGE_PATH_RIGHT "./test_images/im1.png"
@@ -23,7 +29,6 @@
 
 #define WINDOW_WIDTH 9u
 #define WINDOW_HEIGHT 9u
-#define WINDOW_SIZE (WINDOW_WIDTH * WINDOW_HEIGHT)
 #define MAX_DISP (260u / SCALING_FACTOR_WIDTH)
 #define MAX_GS_VALUE 255u
 #define CROSSCHECK_THRESHOLD 8
@@ -31,6 +36,96 @@
 #define PROGRESS_PRINTS 0
 #define OUTPUT_INTERMEDIATE_IMAGES 0
 
+// ZNCC implementation used for the disparity search
+#define ZNCC_ENGINE_STREAMING 0    // window dot products, row at a time
+#define ZNCC_ENGINE_COST_VOLUME 1  // running sums over disparity space
+#define ZNCC_ENGINE_SIMD_FLOAT 2   // float window dot products, AVX2/AVX-512
+#define ZNCC_ENGINE_SIMD_INT 3     // 8-bit window dot products, AVX2/AVX-512
+#define ZNCC_ENGINE ZNCC_ENGINE_COST_VOLUME
+
+// rows processed per call by the cost volume engine
+#define ZNCC_BAND_HEIGHT 16u
+
+#if ZNCC_ENGINE == ZNCC_ENGINE_SIMD_INT
+typedef zncc_gray_input_t zncc_engine_input_t;
+#else
+typedef zncc_input_t zncc_engine_input_t;
+#endif
+
+#if ZNCC_ENGINE != ZNCC_ENGINE_COST_VOLUME
+// one row of disparities with the row at a time engine selected above
+static inline void zncc_engine_row(
+    const zncc_engine_input_t *left,
+    const zncc_engine_input_t *right,
+    const uint32_t             y,
+    const int32_t              direction,
+    void                      *scratch,
+    int32_t                   *out
+) {
+#if ZNCC_ENGINE == ZNCC_ENGINE_SIMD_FLOAT
+    calculate_zncc_row_f32(
+        left,
+        right,
+        y,
+        WINDOW_WIDTH,
+        WINDOW_HEIGHT,
+        MAX_DISP,
+        direction,
+        scratch,
+        out
+    );
+#elif ZNCC_ENGINE == ZNCC_ENGINE_SIMD_INT
+    calculate_zncc_row_u8(
+        left,
+        right,
+        y,
+        WINDOW_WIDTH,
+        WINDOW_HEIGHT,
+        MAX_DISP,
+        direction,
+        scratch,
+        out
+    );
+#else
+    calculate_zncc_row(
+        left,
+        right,
+        y,
+        WINDOW_WIDTH,
+        WINDOW_HEIGHT,
+        MAX_DISP,
+        direction,
+        scratch,
+        out
+    );
+#endif
+}
+#endif
+
+// filling empty regions, see `fill_zero_regions`
+typedef struct {
+    int32_t  *img;
+    uint32_t *dist;
+    uint32_t  W;
+    uint32_t  H;
+} fill_task_arg_t;
+
+static void fill_rows_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+) {
+    fill_task_arg_t *arg = p;
+    (void)worker_id;
+    fill_zero_regions_rows(arg->img, arg->dist, arg->W, arg->H, begin, end);
+}
+
+static void fill_columns_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+) {
+    fill_task_arg_t *arg = p;
+    (void)worker_id;
+    fill_zero_regions_columns(arg->img, arg->dist, arg->W, arg->H, begin, end);
+}
+
 int main() {
     // load images from disk
     img_load_result_t img_left;
@@ -69,136 +164,104 @@ int main() {
 
     PROFILING_BLOCK_BEGIN(preprocessing);
 
-    // downscale
-    rgba_img_t img_left_ds = {
-        .img    = NULL,
-        .width  = img_left.img_desc.width / SCALING_FACTOR_WIDTH,
-        .height = img_left.img_desc.height / SCALING_FACTOR_HEIGHT
-    };
-    rgba_img_t img_right_ds = {
-        .img    = NULL,
-        .width  = img_right.img_desc.width / SCALING_FACTOR_WIDTH,
-        .height = img_right.img_desc.height / SCALING_FACTOR_HEIGHT
-    };
-    scale_down_image(&img_left.img_desc, &img_left_ds);
-    scale_down_image(&img_right.img_desc, &img_right_ds);
-
-    // don't need original images anymore
-    free(img_left.img_desc.img);
-    free(img_right.img_desc.img);
+    assert(img_left.img_desc.width == img_right.img_desc.width);
+    assert(img_left.img_desc.height == img_right.img_desc.height);
 
-    // convert to grayscale
-    gray_img_t img_left_gs  = {.img = NULL};
-    gray_img_t img_right_gs = {.img = NULL};
+    const uint32_t W = img_left.img_desc.width / SCALING_FACTOR_WIDTH;
+    const uint32_t H = img_left.img_desc.height / SCALING_FACTOR_HEIGHT;
 
-    convert_to_grayscale(&img_left_ds, &img_left_gs);
-    convert_to_grayscale(&img_right_ds, &img_right_gs);
+    // downscale and convert to grayscale in one pass, each original image is
+    // read once
+    double_img_t img_left_f  = {.img = NULL, .width = W, .height = H};
+    double_img_t img_right_f = {.img = NULL, .width = W, .height = H};
 
-    // don't need scaled down RGBA images anymore
-    free(img_left_ds.img);
-    free(img_right_ds.img);
+    img_left_f.img  = malloc(W * H * sizeof(double));
+    img_right_f.img = malloc(W * H * sizeof(double));
+    assert(img_left_f.img != NULL);
+    assert(img_right_f.img != NULL);
 
-    double_img_t img_left_f  = {.img = NULL};
-    double_img_t img_right_f = {.img = NULL};
+#if ZNCC_ENGINE == ZNCC_ENGINE_SIMD_INT
+    // the 8 bit images are only used by this engine, the double rows are
+    // widened from the 8 bit rows just written
+    gray_img_t img_left_gs  = {.img = NULL, .width = W, .height = H};
+    gray_img_t img_right_gs = {.img = NULL, .width = W, .height = H};
 
-    convert_to_double(&img_left_gs, &img_left_f);
-    convert_to_double(&img_right_gs, &img_right_f);
+    img_left_gs.img  = malloc(W * H * sizeof(gray_t));
+    img_right_gs.img = malloc(W * H * sizeof(gray_t));
+    assert(img_left_gs.img != NULL);
+    assert(img_right_gs.img != NULL);
 
-    // don't need GS images anymore
-    free(img_left_gs.img);
-    free(img_right_gs.img);
-
-    assert(img_left_f.width == img_right_f.width);
-    assert(img_left_f.height == img_right_f.height);
-
-    const uint32_t W = img_left_f.width;
-    const uint32_t H = img_left_f.height;
-
-    printf("pre-processing data windows...\n");
-
-    const size_t preprocessed_window_size = sizeof(double) * WINDOW_SIZE;
-    const size_t windows_count            = W * H;
-
-    // lots of data, around 8GB in total with full size images
-    // should not be an issue on typical machines
+#pragma omp parallel for schedule(static)
+    for (uint32_t y = 0; y < H; ++y) {
+        downscale_to_grayscale(
+            &img_left.img_desc, img_left_gs.img, GS, W, H, y, y + 1
+        );
+        downscale_to_grayscale(
+            &img_right.img_desc, img_right_gs.img, GS, W, H, y, y + 1
+        );
+        const uint32_t row = y * W;
+        for (uint32_t x = 0; x < W; ++x) {
+            img_left_f.img[row + x]  = (double)img_left_gs.img[row + x];
+            img_right_f.img[row + x] = (double)img_right_gs.img[row + x];
+        }
+    }
+#else
+#pragma omp parallel for schedule(static)
+    for (uint32_t y = 0; y < H; ++y) {
+        downscale_to_grayscale(
+            &img_left.img_desc, img_left_f.img, GS_DOUBLE, W, H, y, y + 1
+        );
+        downscale_to_grayscale(
+            &img_right.img_desc, img_right_f.img, GS_DOUBLE, W, H, y, y + 1
+        );
+    }
+#endif
 
-    double *preprocessed_windows_left =
-        malloc(preprocessed_window_size * windows_count);
-    double *preprocessed_windows_right =
-        malloc(preprocessed_window_size * windows_count);
+    // don't need original images anymore
+    free(img_left.img_desc.img);
+    free(img_right.img_desc.img);
 
-    assert(preprocessed_windows_left != NULL);
-    assert(preprocessed_windows_right != NULL);
+    printf("calculating window statistics...\n");
 
     double *mean_left  = malloc(sizeof(double) * W * H);
     double *mean_right = malloc(sizeof(double) * W * H);
     double *std_left   = malloc(sizeof(double) * W * H);
     double *std_right  = malloc(sizeof(double) * W * H);
 
-#pragma omp parallel for
-    for (uint32_t y = 0; y < H; ++y) {
-#if PROGRESS_PRINTS == 1
-        printf("\rprogress: %03.2f%%", ((double)y / (double)H) * 100.0);
-#endif
-
-        for (uint32_t x = 0; x < W; ++x) {
-            // left
-            {
-                double *window =
-                    &preprocessed_windows_left[((y * W) + x) * WINDOW_SIZE];
-
-                extract_window(
-                    img_left_f.img,
-                    window,
-                    x,
-                    y,
-                    WINDOW_WIDTH,
-                    WINDOW_HEIGHT,
-                    W,
-                    H
-                );
-                double mean =
-                    calculate_window_mean(window, WINDOW_WIDTH, WINDOW_HEIGHT);
-                double stddev = calculate_window_standard_deviation(
-                    window, WINDOW_WIDTH, WINDOW_HEIGHT, mean
-                );
-                zero_mean_window(window, WINDOW_WIDTH, WINDOW_HEIGHT, mean);
-                normalize_window(window, WINDOW_WIDTH, WINDOW_HEIGHT, stddev);
-
-                mean_left[(y * W) + x] = mean;
-                std_left[(y * W) + x]  = stddev;
-            }
-
-            // right
-            {
-                double *window =
-                    &preprocessed_windows_right[((y * W) + x) * WINDOW_SIZE];
-                extract_window(
-                    img_right_f.img,
-                    window,
-                    x,
-                    y,
-                    WINDOW_WIDTH,
-                    WINDOW_HEIGHT,
-                    W,
-                    H
-                );
-                double mean =
-                    calculate_window_mean(window, WINDOW_WIDTH, WINDOW_HEIGHT);
-                double stddev = calculate_window_standard_deviation(
-                    window, WINDOW_WIDTH, WINDOW_HEIGHT, mean
-                );
-                zero_mean_window(window, WINDOW_WIDTH, WINDOW_HEIGHT, mean);
-                normalize_window(window, WINDOW_WIDTH, WINDOW_HEIGHT, stddev);
+    assert(mean_left != NULL);
+    assert(mean_right != NULL);
+    assert(std_left != NULL);
+    assert(std_right != NULL);
+
+    // window means and standard deviations from summed-area tables, so each
+    // window costs O(1) regardless of window size. Building a table is a
+    // prefix sum over the whole image, so the two are built side by side and
+    // the window lookups are split by rows over all threads.
+    integral_image_t sat_left, sat_right;
+#pragma omp parallel sections
+    {
+#pragma omp section
+        build_integral_image(
+            img_left_f.img, W, H, WINDOW_WIDTH, WINDOW_HEIGHT, &sat_left
+        );
+#pragma omp section
+        build_integral_image(
+            img_right_f.img, W, H, WINDOW_WIDTH, WINDOW_HEIGHT, &sat_right
+        );
+    }
 
-                mean_right[(y * W) + x] = mean;
-                std_right[(y * W) + x]  = stddev;
-            }
-        }
+#pragma omp parallel for schedule(static)
+    for (uint32_t y = 0; y < H; ++y) {
+        integral_window_statistics_rows(
+            &sat_left, y, y + 1, mean_left, std_left
+        );
+        integral_window_statistics_rows(
+            &sat_right, y, y + 1, mean_right, std_right
+        );
     }
-#if PROGRESS_PRINTS == 1
-    printf("\rprogress: 100.00%%\n\n");
-#endif
+
+    free_integral_image(&sat_left);
+    free_integral_image(&sat_right);
 
     PROFILING_BLOCK_END(preprocessing);
 
@@ -249,15 +312,68 @@ int main() {
     }
 #endif
 
-    // don't need float input images anymore
-    free(img_left_f.img);
-    free(img_right_f.img);
-
-    // don't need intermediate images either
-    free(mean_left);
-    free(mean_right);
-    free(std_left);
-    free(std_right);
+    // ZNCC only needs 1/std, invert in place
+    invert_standard_deviation(std_left, std_left, W * H);
+    invert_standard_deviation(std_right, std_right, W * H);
+
+    // windows are never stored, they are read straight from the images
+#if ZNCC_ENGINE == ZNCC_ENGINE_SIMD_INT
+    const zncc_engine_input_t zncc_input_left = {
+        .img         = img_left_gs.img,
+        .mean        = mean_left,
+        .inv_std_dev = std_left,
+        .width       = W,
+        .height      = H
+    };
+    const zncc_engine_input_t zncc_input_right = {
+        .img         = img_right_gs.img,
+        .mean        = mean_right,
+        .inv_std_dev = std_right,
+        .width       = W,
+        .height      = H
+    };
+#else
+    const zncc_engine_input_t zncc_input_left = {
+        .img         = img_left_f.img,
+        .mean        = mean_left,
+        .inv_std_dev = std_left,
+        .width       = W,
+        .height      = H
+    };
+    const zncc_engine_input_t zncc_input_right = {
+        .img         = img_right_f.img,
+        .mean        = mean_right,
+        .inv_std_dev = std_right,
+        .width       = W,
+        .height      = H
+    };
+#endif
+#if ZNCC_ENGINE == ZNCC_ENGINE_COST_VOLUME
+    size_t scratch_size = zncc_cost_volume_scratch_size(
+        W, ZNCC_BAND_HEIGHT, WINDOW_WIDTH, WINDOW_HEIGHT
+    );
+    scratch_size *= sizeof(double);
+    const uint32_t num_bands = (H + ZNCC_BAND_HEIGHT - 1) / ZNCC_BAND_HEIGHT;
+    // columns per tile, so that one tile of a band stays in L2 cache
+    const uint32_t tile_width = zncc_cost_volume_tile_width(
+        ZNCC_BAND_HEIGHT, WINDOW_WIDTH, WINDOW_HEIGHT, MAX_DISP
+    );
+#elif ZNCC_ENGINE == ZNCC_ENGINE_SIMD_FLOAT
+    size_t scratch_size =
+        zncc_row_f32_scratch_size(W, WINDOW_WIDTH, WINDOW_HEIGHT);
+    scratch_size *= sizeof(float);
+    printf("ZNCC SIMD level: %d\n", (int)zncc_simd_get_level());
+#elif ZNCC_ENGINE == ZNCC_ENGINE_SIMD_INT
+    size_t scratch_size =
+        zncc_row_u8_scratch_size(W, WINDOW_WIDTH, WINDOW_HEIGHT);
+    printf("ZNCC SIMD level: %d\n", (int)zncc_simd_get_level());
+#else
+    size_t scratch_size = zncc_row_scratch_size(W, WINDOW_WIDTH, WINDOW_HEIGHT);
+    scratch_size *= sizeof(double);
+#endif
+    // aligned_alloc wants a multiple of the alignment
+    scratch_size = (scratch_size + ZNCC_SIMD_ALIGNMENT - 1) &
+                   ~((size_t)ZNCC_SIMD_ALIGNMENT - 1);
 
     // ZNCC
     PROFILING_BLOCK_BEGIN(zncc_calculation);
@@ -270,93 +386,104 @@ int main() {
     assert(disparity_image_right != NULL);
     memset(disparity_image_right, 0, sizeof(int32_t) * W * H);
 
-    printf("computing depthmap left to right:\n");
-    // LEFT to RIGHT
+#if ZNCC_ENGINE == ZNCC_ENGINE_COST_VOLUME
+    printf("computing depthmaps left to right and right to left:\n");
+    // both directions score the same window pairs, compute each score once
 
-#pragma omp parallel for
-    for (uint32_t y = 0; y < H; ++y) {
+#pragma omp parallel
+    {
+        void *scratch = aligned_alloc(ZNCC_SIMD_ALIGNMENT, scratch_size);
+        assert(scratch != NULL);
+
+#pragma omp for schedule(dynamic)
+        for (uint32_t b = 0; b < num_bands; ++b) {
 #if PROGRESS_PRINTS == 1
-        printf("\rprogress: %03.2f%%", ((double)y / (double)H) * 100.0);
-        fflush(stdout);
+            printf(
+                "\rprogress: %03.2f%%", ((double)b / (double)num_bands) * 100.0
+            );
+            fflush(stdout);
 #endif
-
-        for (uint32_t x = 0; x < W; ++x) {
-            double  max_sum        = 0;
-            int32_t best_disparity = 0;
-            double *window_left =
-                &preprocessed_windows_left[((y * W) + x) * WINDOW_SIZE];
-
-            for (int32_t d = 0; d < MAX_DISP; ++d) {
-                if (d > x) {
-                    // would go out of bounds
-                    break;
-                }
-
-                double *window_right = &preprocessed_windows_right
-                                           [((y * W) + (x - d)) * WINDOW_SIZE];
-
-                double zncc = window_dot_product(
-                    window_left, window_right, WINDOW_WIDTH, WINDOW_HEIGHT
-                );
-
-                if (zncc > max_sum) {
-                    max_sum        = zncc;
-                    best_disparity = d;
-                }
-            }
-
-            disparity_image_left[(y * W) + x] = best_disparity;
+            const uint32_t y_begin = b * ZNCC_BAND_HEIGHT;
+            const uint32_t y_end   = (y_begin + ZNCC_BAND_HEIGHT < H)
+                                         ? (y_begin + ZNCC_BAND_HEIGHT)
+                                         : H;
+            calculate_zncc_cost_volume_fused(
+                &zncc_input_left,
+                &zncc_input_right,
+                y_begin,
+                y_end,
+                WINDOW_WIDTH,
+                WINDOW_HEIGHT,
+                MAX_DISP,
+                tile_width,
+                scratch,
+                disparity_image_left,
+                disparity_image_right
+            );
         }
+
+        free(scratch);
     }
 #if PROGRESS_PRINTS == 1
     printf("\rprogress: 100.00%%\n\n");
 #endif
+#else
+    int32_t *const disparity_images[2] = {
+        disparity_image_left, disparity_image_right
+    };
+    const int32_t     directions[2]      = {1, -1};
+    const char *const direction_names[2] = {"left to right", "right to left"};
 
-    printf("computing depthmap right to left:\n");
-    // RIGHT to LEFT
+    for (uint32_t d = 0; d < 2; ++d) {
+        printf("computing depthmap %s:\n", direction_names[d]);
 
-#pragma omp parallel for
-    for (uint32_t y = 0; y < H; ++y) {
+#pragma omp parallel
+        {
+            void *scratch = aligned_alloc(ZNCC_SIMD_ALIGNMENT, scratch_size);
+            assert(scratch != NULL);
+
+#pragma omp for
+            for (uint32_t y = 0; y < H; ++y) {
 #if PROGRESS_PRINTS == 1
-        printf("\rprogress: %03.2f%%", ((double)y / (double)H) * 100.0);
-        fflush(stdout);
+                printf(
+                    "\rprogress: %03.2f%%", ((double)y / (double)H) * 100.0
+                );
+                fflush(stdout);
 #endif
-
-        for (uint32_t x = 0; x < W; ++x) {
-            double  max_sum        = 0;
-            int32_t best_disparity = 0;
-
-            double *window_right =
-                &preprocessed_windows_right[((y * W) + x) * WINDOW_SIZE];
-
-            for (int32_t d = 0; d < MAX_DISP; ++d) {
-                if (d > (W - x - 1)) {
-                    // would go out of bounds
-                    break;
-                }
-
-                double *window_left = &preprocessed_windows_left
-                                          [((y * W) + (x + d)) * WINDOW_SIZE];
-
-                double zncc = window_dot_product(
-                    window_left, window_right, WINDOW_WIDTH, WINDOW_HEIGHT
+                zncc_engine_row(
+                    &zncc_input_left,
+                    &zncc_input_right,
+                    y,
+                    directions[d],
+                    scratch,
+                    &disparity_images[d][y * W]
                 );
-
-                if (zncc > max_sum) {
-                    max_sum        = zncc;
-                    best_disparity = d;
-                }
             }
 
-            disparity_image_right[(y * W) + x] = best_disparity;
+            free(scratch);
         }
-    }
 #if PROGRESS_PRINTS == 1
-    printf("\rprogress: 100.00%%\n\n");
+        printf("\rprogress: 100.00%%\n\n");
+#endif
+    }
 #endif
 
     PROFILING_BLOCK_END(zncc_calculation);
 
+    // don't need input images anymore
+#if ZNCC_ENGINE == ZNCC_ENGINE_SIMD_INT
+    free(img_left_gs.img);
+    free(img_right_gs.img);
+#endif
+    free(img_left_f.img);
+    free(img_right_f.img);
+
+    // don't need window statistics either
+    free(mean_left);
+    free(mean_right);
+    free(std_left);
+    free(std_right);
+
 #if OUTPUT_INTERMEDIATE_IMAGES == 1
     printf("outputting raw depthmaps\n");
     {
@@ -418,41 +545,24 @@ int main() {
 
     printf("filling empty regions...\n");
 
-#pragma omp parallel
-    {
-        int          num_threads = omp_get_num_threads();
-        int          thread_id   = omp_get_thread_num();
-        uint8_t     *visited     = malloc(W * H * sizeof(uint8_t));
-        coord_fifo_t fifo        = {
-                   .storage  = malloc(W * H * sizeof(coord_t)),
-                   .read     = 0,
-                   .write    = 0,
-                   .capacity = W * H
-        };
+    // distance transform, rows and then columns are independent of each other
+    task_pool_t pool;
+    task_pool_init(&pool, (uint32_t)omp_get_max_threads());
 
-        for (uint32_t y = thread_id; y < H; y += num_threads) {
-#if PROGRESS_PRINTS == 1
-            printf("\rprogress: %03.2f%%", ((double)y / (double)H) * 100.0);
-            fflush(stdout);
-#endif
+    fill_task_arg_t fill_arg = {
+        .img  = combined,
+        .dist = malloc(W * H * sizeof(uint32_t)),
+        .W    = W,
+        .H    = H
+    };
+    assert(fill_arg.dist != NULL);
 
-            for (uint32_t x = 0; x < W; ++x) {
-                int32_t curr = combined[(y * W) + x];
-                if (curr == 0) {
-                    int32_t nnzn = find_nearest_nonzero_neighbour(
-                        combined, W, H, x, y, visited, &fifo
-                    );
-                    combined[(y * W) + x] = nnzn;
-                }
-            }
-        }
-        free(fifo.storage);
-        free(visited);
-    }
+    task_pool_parallel_for(&pool, 0, H, 1, fill_rows_task, &fill_arg);
+    // columns are swept row-major, so give each task a cache line or more
+    task_pool_parallel_for(&pool, 0, W, 16, fill_columns_task, &fill_arg);
 
-#if PROGRESS_PRINTS == 1
-    printf("\rprogress: 100.00%%\n\n");
-#endif
+    free(fill_arg.dist);
+    task_pool_destroy(&pool);
 
     PROFILING_BLOCK_END(postprocessing);
 
@@ -463,8 +573,6 @@ int main() {
     };
     output_image(IMAGE_PATH_CROSSCHECKED_OUT, &combined_img, GS_INT32, NULL);
 
-    free(preprocessed_windows_left);
-    free(preprocessed_windows_right);
     free(disparity_image_left);
     free(disparity_image_right);
     free(combined);
@@ -1,9 +1,18 @@
-__kernel void downscale_kernel(
+// downscale_kernel and grayscale_kernel in one pass, the downscaled color
+// image is never stored.
+//
+// Build with -DGRAYSCALE_8BIT for an 8 bit output image (CL_UNORM_INT8), the
+// values are truncated to integers like convert_to_grayscale on the host.
+// Otherwise the output image is CL_FLOAT.
+
+const float4 grayscaling_factors = (float4)(0.2126f, 0.7152f, 0.0722f, 0.0f);
+
+__kernel void downscale_grayscale_kernel(
     const unsigned int N,
     read_only image2d_t in,
     write_only image2d_t out
 ) {
-    // N is number of sections the overall image is divided into.
+    // N is number of sections the output image is divided into.
     // i determines the rows of the section the kernel should operate on
 
     // Wi is width of input image
@@ -28,15 +37,20 @@ __kernel void downscale_kernel(
     const int sx = Wi / Wo;
     const int2 sc = {(int)(sx), (int)(sy)};
 
-    int xo = 0;
-    int yo = 0;
-
-    for (yo = ly; yo < hy; ++yo) {
-        for (xo = 0; xo < Wo; ++xo) {
+    for (int yo = ly; yo < hy; ++yo) {
+        for (int xo = 0; xo < Wo; ++xo) {
             int2 coord_out = {xo, yo};
             int2 coord_in = coord_out * sc;
-            uint4 px = read_imageui(in, coord_in);
-            write_imageui(out, coord_out, px);
+            uint4 px_in = read_imageui(in, coord_in);
+            float4 px = convert_float4(px_in) * grayscaling_factors;
+            float v = px.x + px.y + px.z;
+
+#ifdef GRAYSCALE_8BIT
+            // stored as v / 255 rounded to 8 bits, exact for integer v
+            v = floor(v) / 255.0f;
+#endif
+
+            write_imagef(out, coord_out, v);
         }
     }
-}
\ No newline at end of file
+}
@@ -12,13 +12,41 @@
 
 #define WINDOW_SIZE (WINDOW_HEIGHT * WINDOW_WIDTH)
 
+// signed, so that window loops around pixels near the top or left edge start
+// at negative coordinates
+#define WINDOW_RADIUS_X ((int)(WINDOW_WIDTH - 1) / 2)
+#define WINDOW_RADIUS_Y ((int)(WINDOW_HEIGHT - 1) / 2)
+
+// The kernels can be specialised with build options, e.g.
+// "-DDIRECTION=1 -DMAX_DISPARITY=65 -DIMAGE_WIDTH=735". Kernel arguments and
+// image widths replaced by a defined constant are ignored, so the compiler can
+// drop the direction branches and unroll loops with fixed trip counts.
+#ifdef DIRECTION
+#define DIRECTION_OR(arg) (DIRECTION)
+#else
+#define DIRECTION_OR(arg) (arg)
+#endif
+
+#ifdef MAX_DISPARITY
+#define MAX_DISPARITY_OR(arg) (MAX_DISPARITY)
+#else
+#define MAX_DISPARITY_OR(arg) (arg)
+#endif
+
+#ifdef IMAGE_WIDTH
+#define IMAGE_WIDTH_OR(arg) (IMAGE_WIDTH)
+#else
+#define IMAGE_WIDTH_OR(arg) (arg)
+#endif
+
 void extract_window(
     const int2 offset,
-    const int2 input_dimensions,
     read_only image2d_t img,
     __private float* window
 ) {
     // assumes that out has capacity for (window_dimensions.x * window_dimensions.y) floats
+    // coordinates outside the image are clamped to the edges by the sampler,
+    // so the loops have no bounds checks
 
     int2 coord = (int2)(0, 0);
     unsigned int out_idx = 0;
@@ -26,20 +54,20 @@ void extract_window(
     int x = 0;
     int y = 0;
 
-    const sampler_t s = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
+    const sampler_t s = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 
     for (
-        y = offset.y - ((WINDOW_HEIGHT - 1) / 2);
-        y <= offset.y + ((WINDOW_HEIGHT -1) / 2);
+        y = offset.y - WINDOW_RADIUS_Y;
+        y <= offset.y + WINDOW_RADIUS_Y;
         ++y
     ) {
-        coord.y = clamp(y, 0, input_dimensions.y);
+        coord.y = y;
         for (
-            x = offset.x - ((WINDOW_WIDTH - 1) / 2);
-            x <= offset.x + ((WINDOW_WIDTH - 1) / 2);
+            x = offset.x - WINDOW_RADIUS_X;
+            x <= offset.x + WINDOW_RADIUS_X;
             ++x
         ) {
-            coord.x = clamp(x, 0, input_dimensions.x);
+            coord.x = x;
 
             float4 px = read_imagef(img, s, coord);
             window[out_idx] = px.x;
@@ -105,6 +133,7 @@ float window_dot_product(
 ) {
     float sum = 0.0f;
 
+    #pragma unroll
     for (unsigned int i = 0; i < WINDOW_SIZE; ++i) {
         sum += a[i] * b[i];
     }
@@ -114,11 +143,10 @@ float window_dot_product(
 
 void extract_normalized_window(
     const int2 offset,
-    const int2 input_dimensions,
     read_only image2d_t img,
     __private float* window
 ) {
-    extract_window(offset, input_dimensions, img, window);
+    extract_window(offset, img, window);
     float mu = calculate_window_mean(window);
     float sigma = calculate_window_standard_deviation(window, mu);
     zero_mean_window(window, mu);
@@ -133,7 +161,10 @@ __kernel void calculate_zncc(
     read_only image2d_t img_right,
     __global int *out
 ) {
-    if (direction == 0) {
+    const int search_direction = DIRECTION_OR(direction);
+    const int D = MAX_DISPARITY_OR(max_disparity);
+
+    if (search_direction == 0) {
         printf("ERROR: direction set to 0. It should be negative for right to left processing, or positive for left to right processing.");
         return;
     }
@@ -142,7 +173,7 @@ __kernel void calculate_zncc(
     // i determines the rows of the section the kernel should operate on
 
     // both have same dimensions
-    const int W = get_image_width(img_left);
+    const int W = IMAGE_WIDTH_OR(get_image_width(img_left));
     const int H = get_image_height(img_left);
 
     const int i = get_global_id(0);
@@ -152,12 +183,10 @@ __kernel void calculate_zncc(
     const int ly = sh * i;       // low y
     const int hy = sh * (i + 1) + ((i == (N-1)) ? mh : 0); // high y
 
-    const int2 image_dimensions = (int2)(W, H);
-
     __private float window_left[WINDOW_SIZE];
     __private float window_right[WINDOW_SIZE];
 
-    if (direction < 0) {
+    if (search_direction < 0) {
         // right to left
         for (int y = ly; y < hy; ++y) {
             for (int x = 0; x < W; ++x) {
@@ -165,12 +194,12 @@ __kernel void calculate_zncc(
                 int best_disparity = 0;
 
                 int2 coord_r = (int2)(x, y);
-                extract_normalized_window(coord_r, image_dimensions, img_right, window_right);
+                extract_normalized_window(coord_r, img_right, window_right);
 
-                for (int d = 0; d < min(W - x, (int)max_disparity); ++d) {
+                for (int d = 0; d < min(W - x, D); ++d) {
                     int2 coord_l = (int2)(x + d, y);
 
-                    extract_normalized_window(coord_l, image_dimensions, img_left, window_left);
+                    extract_normalized_window(coord_l, img_left, window_left);
 
                     float zncc = window_dot_product(window_left, window_right);
 
@@ -192,11 +221,11 @@ __kernel void calculate_zncc(
 
                 int2 coord_l = (int2)(x, y);
 
-                extract_normalized_window(coord_l, image_dimensions, img_left, window_left);
+                extract_normalized_window(coord_l, img_left, window_left);
 
-                for (int d = 0; d < min(x, (int)max_disparity); ++d) {
+                for (int d = 0; d < min(x, D); ++d) {
                     int2 coord_r = (int2)(x - d, y);
-                    extract_normalized_window(coord_r, image_dimensions, img_right, window_right);
+                    extract_normalized_window(coord_r, img_right, window_right);
 
                     float zncc = window_dot_product(window_left, window_right);
 
@@ -213,6 +242,276 @@ __kernel void calculate_zncc(
 }
 
 
+__kernel void calculate_zncc_fused(
+    const unsigned int N,
+    const unsigned int max_disparity,
+    read_only image2d_t img_left,
+    read_only image2d_t img_right,
+    __global float *best_right, // best score so far for each right image pixel
+    __global int *out_left,
+    __global int *out_right
+) {
+    // Left to right and right to left searches score the same window pairs,
+    // so each pair (xl, xr = xl - d) is scored once and used for both.
+    // Pairs are visited with xl increasing, so for each right image pixel
+    // disparities are still tried in increasing order like in calculate_zncc.
+
+    // N is number of sections the image height is divided into.
+    // i determines the rows of the section the kernel should operate on
+
+    // both have same dimensions
+    const int W = IMAGE_WIDTH_OR(get_image_width(img_left));
+    const int H = get_image_height(img_left);
+
+    const int i = get_global_id(0);
+
+    const int mh = H % N;        // modulo height
+    const int sh = (H - mh) / N; // segment height
+    const int ly = sh * i;       // low y
+    const int hy = sh * (i + 1) + ((i == (N-1)) ? mh : 0); // high y
+
+    __private float window_left[WINDOW_SIZE];
+    __private float window_right[WINDOW_SIZE];
+
+    for (int y = ly; y < hy; ++y) {
+        for (int x = 0; x < W; ++x) {
+            best_right[(y * W) + x] = 0.0f;
+            out_right[(y * W) + x] = 0;
+        }
+
+        for (int xl = 0; xl < W; ++xl) {
+            float max_sum = 0.0f;
+            int best_disparity = 0;
+
+            int2 coord_l = (int2)(xl, y);
+            extract_normalized_window(coord_l, img_left, window_left);
+
+            for (int d = 0; d < min(xl + 1, (int)MAX_DISPARITY_OR(max_disparity)); ++d) {
+                const int xr = xl - d;
+                int2 coord_r = (int2)(xr, y);
+                extract_normalized_window(coord_r, img_right, window_right);
+
+                float zncc = window_dot_product(window_left, window_right);
+
+                // left to right search doesn't go all the way to the edge
+                if (d < xl && zncc > max_sum) {
+                    max_sum = zncc;
+                    best_disparity = d;
+                }
+
+                if (zncc > best_right[(y * W) + xr]) {
+                    best_right[(y * W) + xr] = zncc;
+                    out_right[(y * W) + xr] = d;
+                }
+            }
+
+            out_left[(y * W) + xl] = best_disparity;
+        }
+    }
+}
+
+__kernel void extract_data_windows(
+    read_only image2d_t img,
+    __global float *mean,     // window mean of each pixel
+    __global float *inv_sigma // 1 / window standard deviation of each pixel
+) {
+    // One work item per pixel. Computes the statistics needed to normalize
+    // the window of each pixel, so that ZNCC kernels only need to take dot
+    // products: normalized window = (window - mean) * inv_sigma.
+    // Windows are clamped to the image edges.
+
+    const int W = IMAGE_WIDTH_OR(get_image_width(img));
+    const int H = get_image_height(img);
+
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+
+    if (x >= W || y >= H) {
+        return;
+    }
+
+    const sampler_t s = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+    __private float window[WINDOW_SIZE];
+
+    for (int wy = 0; wy < (int)WINDOW_HEIGHT; ++wy) {
+        for (int wx = 0; wx < (int)WINDOW_WIDTH; ++wx) {
+            // clamped to the edges by the sampler
+            const int2 coord = (int2)(x + wx - WINDOW_RADIUS_X, y + wy - WINDOW_RADIUS_Y);
+            window[(wy * (int)WINDOW_WIDTH) + wx] = read_imagef(img, s, coord).x;
+        }
+    }
+
+    const float mu = calculate_window_mean(window);
+    const float sigma = calculate_window_standard_deviation(window, mu);
+
+    mean[(y * W) + x] = mu;
+    // like normalize_window, windows with ~zero deviation are not scaled
+    inv_sigma[(y * W) + x] = (fabs(sigma) <= 1e-4f) ? 1.0f : (1.0f / sigma);
+}
+
+// Tiled variant, one work item per pixel. The work group size must be
+// TILE_WIDTH x TILE_HEIGHT.
+#ifndef TILE_WIDTH
+#define TILE_WIDTH 16
+#endif
+
+#ifndef TILE_HEIGHT
+#define TILE_HEIGHT 8
+#endif
+
+// upper limit for max_disparity, sizes the disparity apron in local memory
+#ifndef MAX_DISPARITY
+#define MAX_DISPARITY 65
+#endif
+
+#define TILE_SIZE (TILE_WIDTH * TILE_HEIGHT)
+// rows of pixels needed for the windows of one tile
+#define TILE_ROWS (TILE_HEIGHT + (int)WINDOW_HEIGHT - 1)
+// columns of pixels needed for the windows of one tile
+#define TILE_COLS (TILE_WIDTH + (int)WINDOW_WIDTH - 1)
+// window centres in the searched image, tile plus disparity apron
+#define APRON_CENTRES (TILE_WIDTH + MAX_DISPARITY - 1)
+// columns of pixels needed for the windows of the tile and apron
+#define APRON_COLS (APRON_CENTRES + (int)WINDOW_WIDTH - 1)
+
+void load_tile(
+    read_only image2d_t img,
+    const int2 origin,
+    const int cols,
+    __local float *tile
+) {
+    // copies TILE_ROWS x cols pixels starting from origin, clamped to the
+    // image edges by the sampler, each work item of the group copies some of
+    // them
+
+    const sampler_t s = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+    const int lid = (get_local_id(1) * TILE_WIDTH) + get_local_id(0);
+
+    for (int i = lid; i < TILE_ROWS * cols; i += TILE_SIZE) {
+        const int r = i / cols;
+        const int c = i % cols;
+        const int2 coord = (int2)(origin.x + c, origin.y + r);
+        tile[i] = read_imagef(img, s, coord).x;
+    }
+}
+
+__kernel void calculate_zncc_tiled(
+    const int direction, // negative for right to left, positive for left to right
+    const unsigned int max_disparity,
+    read_only image2d_t img_left,
+    read_only image2d_t img_right,
+    __global const float *mean_left,      // from extract_data_windows
+    __global const float *inv_sigma_left,
+    __global const float *mean_right,
+    __global const float *inv_sigma_right,
+    __global int *out
+) {
+    // Same search as calculate_zncc, but each work group handles a
+    // TILE_WIDTH x TILE_HEIGHT tile of pixels of the reference image (left
+    // image for left to right, right image for right to left).
+    //
+    // The pixels needed by the windows of the tile and of every candidate
+    // window in the other image (the tile plus a MAX_DISPARITY - 1 wide apron
+    // on the searched side) are loaded into local memory once per group.
+    // Window means and deviations come from extract_data_windows, and each
+    // work item normalizes its own reference window once into private memory,
+    // so the disparity loop only takes dot products.
+
+    __local float ref_tile[TILE_ROWS * TILE_COLS];
+    __local float apron_tile[TILE_ROWS * APRON_COLS];
+
+    __private float window_ref[WINDOW_SIZE];
+
+    const int search_direction = DIRECTION_OR(direction);
+
+    // both have same dimensions
+    const int W = IMAGE_WIDTH_OR(get_image_width(img_left));
+    const int H = get_image_height(img_left);
+
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    // a global offset selects a strip of the image, e.g. rows for one device
+    const int x0 = get_global_offset(0) + (get_group_id(0) * TILE_WIDTH);
+    const int y0 = get_global_offset(1) + (get_group_id(1) * TILE_HEIGHT);
+    const int x = x0 + lx;
+    const int y = y0 + ly;
+
+    const int D = min((int)MAX_DISPARITY_OR(max_disparity), MAX_DISPARITY);
+
+    // x coordinate of the first candidate window centre: for left to right
+    // the candidates of pixel x are x - d, for right to left x + d
+    const int apron_x0 = (search_direction < 0) ? x0 : (x0 - (MAX_DISPARITY - 1));
+
+    const int2 ref_origin = (int2)(x0 - WINDOW_RADIUS_X, y0 - WINDOW_RADIUS_Y);
+    const int2 apron_origin = (int2)(apron_x0 - WINDOW_RADIUS_X, y0 - WINDOW_RADIUS_Y);
+
+    // images can't be assigned to variables, so branch on the loads only
+    if (search_direction < 0) {
+        load_tile(img_right, ref_origin, TILE_COLS, ref_tile);
+        load_tile(img_left, apron_origin, APRON_COLS, apron_tile);
+    } else {
+        load_tile(img_left, ref_origin, TILE_COLS, ref_tile);
+        load_tile(img_right, apron_origin, APRON_COLS, apron_tile);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // the group is padded to whole tiles, no barriers below this
+    if (x >= W || y >= H) {
+        return;
+    }
+
+    __global const float *mean_ref = (search_direction < 0) ? mean_right : mean_left;
+    __global const float *inv_sigma_ref = (search_direction < 0) ? inv_sigma_right : inv_sigma_left;
+    __global const float *mean_apron = (search_direction < 0) ? mean_left : mean_right;
+    __global const float *inv_sigma_apron = (search_direction < 0) ? inv_sigma_left : inv_sigma_right;
+
+    const float mu_ref = mean_ref[(y * W) + x];
+    const float is_ref = inv_sigma_ref[(y * W) + x];
+
+    for (int wy = 0; wy < (int)WINDOW_HEIGHT; ++wy) {
+        for (int wx = 0; wx < (int)WINDOW_WIDTH; ++wx) {
+            window_ref[(wy * (int)WINDOW_WIDTH) + wx] =
+                (ref_tile[((ly + wy) * TILE_COLS) + lx + wx] - mu_ref) * is_ref;
+        }
+    }
+
+    // same disparity ranges as calculate_zncc
+    const int num_disparities = (search_direction < 0) ? min(W - x, D) : min(x, D);
+
+    float max_sum = 0.0f;
+    int best_disparity = 0;
+
+    for (int d = 0; d < num_disparities; ++d) {
+        // candidate window centre relative to apron_x0, always inside the
+        // image for the disparity range above
+        const int c = (search_direction < 0) ? (lx + d) : (lx + (MAX_DISPARITY - 1) - d);
+        const int centre = (y * W) + apron_x0 + c;
+        const float mu = mean_apron[centre];
+
+        float sum = 0.0f;
+        #pragma unroll
+        for (int wy = 0; wy < (int)WINDOW_HEIGHT; ++wy) {
+            #pragma unroll
+            for (int wx = 0; wx < (int)WINDOW_WIDTH; ++wx) {
+                sum += window_ref[(wy * (int)WINDOW_WIDTH) + wx] *
+                    (apron_tile[((ly + wy) * APRON_COLS) + c + wx] - mu);
+            }
+        }
+
+        const float zncc = sum * inv_sigma_apron[centre];
+
+        if (zncc > max_sum) {
+            max_sum = zncc;
+            best_disparity = d;
+        }
+    }
+
+    out[(y * W) + x] = best_disparity;
+}
+
 __kernel void cross_check(
     const unsigned int N,
     const unsigned int W,
@@ -248,3 +547,92 @@ __kernel void cross_check(
         }
     }
 }
+
+// Filling zero regions with the nearest nonzero value, a two pass Manhattan
+// distance transform like fill_zero_regions in src/zncc_operations.c, and with
+// the same results. fill_zero_regions_rows must be complete before
+// fill_zero_regions_columns runs. dist is scratch memory, W * H values.
+
+__kernel void fill_zero_regions_rows(
+    const unsigned int W,
+    const unsigned int H,
+    __global int *img,
+    __global unsigned int *dist
+) {
+    // one work item per row, nearest nonzero pixel on the same row
+
+    const unsigned int y = get_global_id(0);
+
+    if (y >= H) {
+        return;
+    }
+
+    // larger than any real distance
+    const unsigned int none = W + H;
+
+    __global int *row_img = img + (y * W);
+    __global unsigned int *row_dist = dist + (y * W);
+
+    // nearest nonzero pixel on the left
+    unsigned int d = none;
+    int label = 0;
+    for (unsigned int x = 0; x < W; ++x) {
+        if (row_img[x] != 0) {
+            d = 0;
+            label = row_img[x];
+        } else if (d != none) {
+            d += 1;
+            row_img[x] = label;
+        }
+        row_dist[x] = d;
+    }
+
+    // nearest nonzero pixel on the right, if strictly closer
+    d = none;
+    for (unsigned int x = W; x-- > 0;) {
+        if (row_dist[x] == 0) {
+            d = 0;
+            label = row_img[x];
+        } else if (d != none) {
+            d += 1;
+            if (d < row_dist[x]) {
+                row_dist[x] = d;
+                row_img[x] = label;
+            }
+        }
+    }
+}
+
+__kernel void fill_zero_regions_columns(
+    const unsigned int W,
+    const unsigned int H,
+    __global int *img,
+    __global unsigned int *dist
+) {
+    // one work item per column, neighbouring work items access neighbouring
+    // pixels of the same row
+
+    const unsigned int x = get_global_id(0);
+
+    if (x >= W || H == 0) {
+        return;
+    }
+
+    // nearest source above
+    for (unsigned int y = 1; y < H; ++y) {
+        const unsigned int d = dist[((y - 1) * W) + x] + 1;
+        if (d < dist[(y * W) + x]) {
+            dist[(y * W) + x] = d;
+            img[(y * W) + x] = img[((y - 1) * W) + x];
+        }
+    }
+
+    // nearest source below, if strictly closer
+    for (unsigned int y = H - 1; y-- > 0;) {
+        const unsigned int d = dist[((y + 1) * W) + x] + 1;
+        if (d < dist[(y * W) + x]) {
+            dist[(y * W) + x] = d;
+            img[(y * W) + x] = img[((y + 1) * W) + x];
+        }
+    }
+}
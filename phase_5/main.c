@@ -9,66 +9,221 @@
 #include "device_support.h"
 #include "image_operations.h"
 #include "profiling.h"
+#include "task_pool.h"
 #include "types.h"
+#include "work_size_tuning.h"
 #include "zncc_operations.h"
 
 #define IMAGE_PATH_LEFT "./test_images/im0.png"
 #define IMAGE_PATH_RIGHT "./test_images/im1.png"
 #define IMAGE_PATH_OUT "./output_images/depthmap_cc.png"
 
-#define DOWNSCALING_KERNEL_FILE "./kernels/resize.cl"
-#define DOWNSCALING_KERNEL_NAME "downscale_kernel"
-
-#define GRAYSCALING_KERNEL_FILE "./kernels/grayscale.cl"
-#define GRAYSCALING_KERNEL_NAME "grayscale_kernel"
+#define PREPROCESSING_KERNEL_FILE "./kernels/downscale_grayscale.cl"
+#define PREPROCESSING_KERNEL_NAME "downscale_grayscale_kernel"
 
 #define ZNCC_KERNEL_FILE "./kernels/zncc.cl"
 #define ZNCC_EXTRACT_DATA_WINDOWS_NAME "extract_data_windows"
 #define ZNCC_CALCULATE_NAME "calculate_zncc"
+#define ZNCC_CALCULATE_FUSED_NAME "calculate_zncc_fused"
+#define ZNCC_CALCULATE_TILED_NAME "calculate_zncc_tiled"
 #define ZNCC_CROSS_CHECK_NAME "cross_check"
+#define ZNCC_FILL_ROWS_NAME "fill_zero_regions_rows"
+#define ZNCC_FILL_COLUMNS_NAME "fill_zero_regions_columns"
+
+#define PROGRAM_BUILD_OPTIONS "-Werror"
+// compiled kernels are cached here, NULL to always compile from source
+#define PROGRAM_CACHE_DIR "./kernel_cache"
 
 #define DOWNSCALING_FACTOR_W 4
 #define DOWNSCALING_FACTOR_H 4
 
-#define NUM_ROWS 504  // probably should be calculated
+// work sizes are tuned on first use and kept here, delete it to tune again
+#define WORK_SIZE_TUNING_FILE "./work_sizes.txt"
+// largest work group size tried when tuning
+#define MAX_TUNED_LOCAL_SIZE 256u
 
+// calculate_zncc_tiled supports up to MAX_DISPARITY in zncc.cl
 #define MAX_DISP (260u / DOWNSCALING_FACTOR_W)
 #define MAX_GS_VALUE 255u
 #define CROSSCHECK_THRESHOLD 8
+#define WINDOW_WIDTH 9u
+#define WINDOW_HEIGHT 9u
 
 #define err_check(e) check_cl_error_with_file_line(__FILE__, __LINE__, e)
 
 #define OUTPUT_INTERMEDIATE_IMAGES 0
 
-void enqueue_downscaling_work(
+// 1: grayscale images are 8 bit (CL_UNORM_INT8), read as value / 255 by the
+// ZNCC kernels, which doesn't change the ZNCC scores
+// 0: grayscale images are 32 bit floats
+#define GRAYSCALE_8BIT 1
+
+#if GRAYSCALE_8BIT == 1
+#define PREPROCESSING_BUILD_OPTIONS PROGRAM_BUILD_OPTIONS " -DGRAYSCALE_8BIT"
+#define GRAYSCALE_CHANNEL_TYPE CL_UNORM_INT8
+typedef gray_t gs_pixel_t;
+#else
+#define PREPROCESSING_BUILD_OPTIONS PROGRAM_BUILD_OPTIONS
+#define GRAYSCALE_CHANNEL_TYPE CL_FLOAT
+typedef float gs_pixel_t;
+#endif
+
+#define ZNCC_KERNEL_ROWS 0   // calculate_zncc, work item per row section
+#define ZNCC_KERNEL_FUSED 1  // calculate_zncc_fused, both directions at once
+#define ZNCC_KERNEL_TILED 2  // calculate_zncc_tiled, work item per pixel
+#define ZNCC_KERNEL ZNCC_KERNEL_TILED
+
+// 1: fill zero regions on the device, the host only reads the final depthmap
+// 0: read back the cross checked depthmap and fill it on the host
+#define ZERO_FILL_ON_DEVICE 1
+
+// 1: out-of-order queue, launches are ordered only by their wait events so
+// independent ones (left/right images, both ZNCC directions) may overlap
+// 0: in-order queue, launches run one at a time
+#define OUT_OF_ORDER_QUEUE 1
+
+// number of ZNCC kernel launches, the cross check waits for all of them
+#if ZNCC_KERNEL == ZNCC_KERNEL_FUSED
+#define ZNCC_NUM_EVENTS 1u
+#else
+#define ZNCC_NUM_EVENTS 2u
+#endif
+
+// work group size of calculate_zncc_tiled, TILE_WIDTH x TILE_HEIGHT in zncc.cl
+#define ZNCC_TILE_WIDTH 16u
+#define ZNCC_TILE_HEIGHT 8u
+
+// zncc.cl is specialised with the constants above
+static const zncc_program_constants_t zncc_constants = {
+    .base_options         = PROGRAM_BUILD_OPTIONS,
+    .window_width         = WINDOW_WIDTH,
+    .window_height        = WINDOW_HEIGHT,
+    .max_disparity        = MAX_DISP,
+    .crosscheck_threshold = CROSSCHECK_THRESHOLD
+};
+
+// work sizes of the device, see get_work_size
+typedef struct {
+    work_size_table_t table;
+    char              device[WORK_SIZE_KEY_LEN];
+    uint32_t          num_tuned;  // entries added during this run
+} tuning_t;
+
+/*!
+ * @brief Looks up work size of a kernel launch, or tunes it by timing the
+ * candidates of `work_size_candidates` if this is its first use. Kernel
+ * arguments must be set.
+ * @param tuning : tuned work sizes, new ones are added
+ * @param queue : work queue
+ * @param kernel : kernel to launch
+ * @param name : kernel name, including any variant
+ * @param kind : how the kernel maps work items to the problem
+ * @param work_dim : 1 or 2
+ * @param n0 : number of rows for WORK_SIZE_ROW_SECTIONS, items in the first
+ * dimension otherwise
+ * @param n1 : items in the second dimension, or width of the rows. Part of
+ * the key even for 1D kernels.
+ * @param n_arg : see `tune_work_size`
+ * @param num_wait_events : number of events in wait_events
+ * @param wait_events : events the kernel launch must wait for
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ * @return work size
+ */
+work_size_t get_work_size(
+    tuning_t              *tuning,
+    cl_command_queue       queue,
+    cl_kernel              kernel,
+    const char            *name,
+    const work_size_kind_t kind,
+    const uint32_t         work_dim,
+    const uint32_t         n0,
+    const uint32_t         n1,
+    const int32_t          n_arg,
+    const cl_uint          num_wait_events,
+    const cl_event        *wait_events,
+    cl_int                *err
+);
+
+void enqueue_preprocessing_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
     cl_mem           img_in,
     cl_mem           img_out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 );
 
-void enqueue_grayscaling_work(
+void enqueue_zncc_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
-    cl_mem           img_in,
-    cl_mem           img_out,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
+    const int32_t    direction,
+    const uint32_t   max_disparity,
+    cl_mem           img_left,
+    cl_mem           img_right,
+    cl_mem           disp_img_out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 );
 
-void enqueue_zncc_work(
+void enqueue_zncc_fused_work(
+    cl_command_queue queue,
+    cl_kernel        kernel,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
+    const uint32_t   max_disparity,
+    cl_mem           img_left,
+    cl_mem           img_right,
+    cl_mem           best_right,
+    cl_mem           disp_img_left,
+    cl_mem           disp_img_right,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
+    cl_event        *profiling_evt,
+    cl_int          *err
+);
+
+void enqueue_extract_data_windows_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
+    cl_mem           img,
+    cl_mem           mean,
+    cl_mem           inv_sigma,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
+    cl_event        *profiling_evt,
+    cl_int          *err
+);
+
+void enqueue_zncc_tiled_work(
+    cl_command_queue queue,
+    cl_kernel        kernel,
+    const uint32_t   W,
+    const uint32_t   H,
     const int32_t    direction,
     const uint32_t   max_disparity,
     cl_mem           img_left,
     cl_mem           img_right,
+    cl_mem           mean_left,
+    cl_mem           inv_sigma_left,
+    cl_mem           mean_right,
+    cl_mem           inv_sigma_right,
     cl_mem           disp_img_out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 );
@@ -76,49 +231,82 @@ void enqueue_zncc_work(
 void enqueue_cross_check_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
+    tuning_t        *tuning,
     const uint32_t   W,
     const uint32_t   H,
     cl_mem           disp_img_left,
     cl_mem           disp_img_right,
     cl_mem           out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 );
 
 void enqueue_zero_fill_work(
     cl_command_queue queue,
-    cl_kernel        kernel,
-    const uint32_t   N,
+    cl_kernel        rows_kernel,
+    cl_kernel        columns_kernel,
+    tuning_t        *tuning,
     const uint32_t   W,
     const uint32_t   H,
     cl_mem           img,
-    cl_event        *profiling_evt,
+    cl_mem           dist,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
+    cl_event        *profiling_evts,
     cl_int          *err
 );
 
+#if ZERO_FILL_ON_DEVICE == 0
+// filling empty regions on host, see `fill_zero_regions`
+typedef struct {
+    int32_t  *img;
+    uint32_t *dist;
+    uint32_t  W;
+    uint32_t  H;
+} fill_task_arg_t;
+
+static void fill_rows_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+);
+static void fill_columns_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+);
+#endif
+
 int main() {
     PROFILING_BLOCK_DECLARE(total_runtime);
     PROFILING_BLOCK_DECLARE(opencl_runtime_setup);
     PROFILING_BLOCK_DECLARE(preprocessing);
-    PROFILING_BLOCK_DECLARE(zncc_calculation);
+    PROFILING_BLOCK_DECLARE(device_pipeline);
     PROFILING_BLOCK_DECLARE(postprocessing);
 
     PROFILING_BLOCK_BEGIN(total_runtime);
     PROFILING_BLOCK_BEGIN(opencl_runtime_setup);
 
     // setup OpenCL environment
-    cl_int           err           = CL_SUCCESS;
-    cl_device_id     dev           = NULL;
-    cl_context       ctx           = NULL;
-    cl_command_queue queue         = NULL;
-    cl_program       downscaling_p = NULL;
-    cl_program       grayscaling_p = NULL;
-    cl_kernel        downscaling_k = NULL;
-    cl_kernel        grayscaling_k = NULL;
-    cl_program       zncc_p        = NULL;
-    cl_kernel        zncc_k        = NULL;
-    cl_kernel        cross_check_k = NULL;
+    cl_int           err             = CL_SUCCESS;
+    cl_device_id     dev             = NULL;
+    cl_context       ctx             = NULL;
+    cl_command_queue queue           = NULL;
+    cl_program       preprocessing_p = NULL;
+    cl_kernel        preprocessing_k = NULL;
+    cl_kernel        cross_check_k   = NULL;
+#if ZNCC_KERNEL == ZNCC_KERNEL_FUSED
+    cl_kernel zncc_k = NULL;
+#else
+    // specialised for left to right and right to left search
+    cl_kernel zncc_lr_k = NULL;
+    cl_kernel zncc_rl_k = NULL;
+#endif
+#if ZNCC_KERNEL == ZNCC_KERNEL_TILED
+    cl_kernel data_windows_k = NULL;
+#endif
+#if ZERO_FILL_ON_DEVICE == 1
+    cl_kernel fill_rows_k    = NULL;
+    cl_kernel fill_columns_k = NULL;
+#endif
 
     printf("set up OpenCL runtime...\n");
 
@@ -128,33 +316,60 @@ int main() {
     ctx = create_context(dev, &err);
     check_cl_error(err);
 
+#if OUT_OF_ORDER_QUEUE == 1
+    queue = create_out_of_order_queue(ctx, dev, &err);
+#else
     queue = create_queue(ctx, dev, &err);
+#endif
     check_cl_error(err);
 
-    printf("build OpenCL kernels...\n");
+    // work sizes tuned on earlier runs, missing ones are tuned on first use
+    tuning_t tuning = {.num_tuned = 0};
+    work_size_table_init(&tuning.table);
+    get_device_identity(dev, tuning.device, sizeof(tuning.device));
+    if (work_size_table_load(&tuning.table, WORK_SIZE_TUNING_FILE) != 0) {
+        printf("no tuned work sizes, tuning kernels on first use...\n");
+    }
 
-    downscaling_p =
-        compile_program_from_file(DOWNSCALING_KERNEL_FILE, ctx, dev, &err);
-    err_check(err);
+    printf("build OpenCL kernels...\n");
 
-    downscaling_k = build_kernel(DOWNSCALING_KERNEL_NAME, downscaling_p, &err);
+    preprocessing_p = compile_program_from_file_cached(
+        PREPROCESSING_KERNEL_FILE,
+        PREPROCESSING_BUILD_OPTIONS,
+        PROGRAM_CACHE_DIR,
+        ctx,
+        dev,
+        &err
+    );
     err_check(err);
 
-    grayscaling_p =
-        compile_program_from_file(GRAYSCALING_KERNEL_FILE, ctx, dev, &err);
+    preprocessing_k =
+        build_kernel(PREPROCESSING_KERNEL_NAME, preprocessing_p, &err);
     err_check(err);
 
-    grayscaling_k = build_kernel(GRAYSCALING_KERNEL_NAME, grayscaling_p, &err);
-    err_check(err);
+    // zncc.cl is built in variants with different compile time constants,
+    // the ZNCC kernels themselves once the image size is known
+    program_variants_t zncc_variants;
+    program_variants_init(
+        &zncc_variants, ZNCC_KERNEL_FILE, PROGRAM_CACHE_DIR, ctx, dev
+    );
 
-    zncc_p = compile_program_from_file(ZNCC_KERNEL_FILE, ctx, dev, &err);
+    cross_check_k = build_zncc_kernel(
+        &zncc_variants, ZNCC_CROSS_CHECK_NAME, &zncc_constants, 0, 0, &err
+    );
     err_check(err);
 
-    zncc_k = build_kernel(ZNCC_CALCULATE_NAME, zncc_p, &err);
+#if ZERO_FILL_ON_DEVICE == 1
+    fill_rows_k = build_zncc_kernel(
+        &zncc_variants, ZNCC_FILL_ROWS_NAME, &zncc_constants, 0, 0, &err
+    );
     err_check(err);
 
-    cross_check_k = build_kernel(ZNCC_CROSS_CHECK_NAME, zncc_p, &err);
+    fill_columns_k = build_zncc_kernel(
+        &zncc_variants, ZNCC_FILL_COLUMNS_NAME, &zncc_constants, 0, 0, &err
+    );
     err_check(err);
+#endif
 
     print_device_info(dev);
 
@@ -175,191 +390,190 @@ int main() {
 
     const uint32_t W_orig = load_left.img_desc.width;
     const uint32_t H_orig = load_left.img_desc.height;
+
+    // lodepng's buffers aren't aligned for zero-copy images, move the pixels
+    // to host memory the devices can use in place
+    const size_t rgba_sz    = (size_t)W_orig * H_orig * sizeof(rgba_t);
+    rgba_t      *rgba_left  = allocate_host_memory(rgba_sz);
+    rgba_t      *rgba_right = allocate_host_memory(rgba_sz);
+    memcpy(rgba_left, load_left.img_desc.img, rgba_sz);
+    memcpy(rgba_right, load_right.img_desc.img, rgba_sz);
+    free(load_left.img_desc.img);
+    free(load_right.img_desc.img);
     const uint32_t W_ds   = W_orig / DOWNSCALING_FACTOR_W;
     const uint32_t H_ds   = H_orig / DOWNSCALING_FACTOR_H;
 
-    // create buffers for images and load original images into device memory
-    // originals
-    cl_mem dev_image_left  = NULL;
-    cl_mem dev_image_right = NULL;
-    // downscaled
-    cl_mem dev_image_ds_left  = NULL;
-    cl_mem dev_image_ds_right = NULL;
-    // grayscale
-    cl_mem dev_image_gs_left  = NULL;
-    cl_mem dev_image_gs_right = NULL;
-
-    const cl_image_format image_format_rgba = {CL_RGBA, CL_UNSIGNED_INT8};
-    const cl_image_format image_format_gs   = {CL_R, CL_FLOAT};
+    printf("build ZNCC kernels for %u pixel wide images...\n", W_ds);
 
-    dev_image_left = allocate_2D_image(
-        ctx,
-        queue,
-        &image_format_rgba,
-        W_orig,
-        H_orig,
-        sizeof(rgba_t),
-        load_left.img_desc.img,
+#if ZNCC_KERNEL == ZNCC_KERNEL_TILED
+    data_windows_k = build_zncc_kernel(
+        &zncc_variants,
+        ZNCC_EXTRACT_DATA_WINDOWS_NAME,
+        &zncc_constants,
+        W_ds,
+        0,
         &err
     );
     err_check(err);
 
-    dev_image_right = allocate_2D_image(
-        ctx,
-        queue,
-        &image_format_rgba,
-        W_orig,
-        H_orig,
-        sizeof(rgba_t),
-        load_right.img_desc.img,
+    zncc_lr_k = build_zncc_kernel(
+        &zncc_variants,
+        ZNCC_CALCULATE_TILED_NAME,
+        &zncc_constants,
+        W_ds,
+        1,
         &err
     );
     err_check(err);
 
-    dev_image_ds_left = allocate_2D_image(
-        ctx, NULL, &image_format_rgba, W_ds, H_ds, sizeof(rgba_t), NULL, &err
+    zncc_rl_k = build_zncc_kernel(
+        &zncc_variants,
+        ZNCC_CALCULATE_TILED_NAME,
+        &zncc_constants,
+        W_ds,
+        -1,
+        &err
     );
     err_check(err);
-
-    dev_image_ds_right = allocate_2D_image(
-        ctx, NULL, &image_format_rgba, W_ds, H_ds, sizeof(rgba_t), NULL, &err
+#elif ZNCC_KERNEL == ZNCC_KERNEL_FUSED
+    zncc_k = build_zncc_kernel(
+        &zncc_variants,
+        ZNCC_CALCULATE_FUSED_NAME,
+        &zncc_constants,
+        W_ds,
+        0,
+        &err
     );
     err_check(err);
-
-    dev_image_gs_left = allocate_2D_image(
-        ctx, NULL, &image_format_gs, W_ds, H_ds, sizeof(float), NULL, &err
+#else
+    zncc_lr_k = build_zncc_kernel(
+        &zncc_variants, ZNCC_CALCULATE_NAME, &zncc_constants, W_ds, 1, &err
     );
     err_check(err);
 
-    dev_image_gs_right = allocate_2D_image(
-        ctx, NULL, &image_format_gs, W_ds, H_ds, sizeof(float), NULL, &err
+    zncc_rl_k = build_zncc_kernel(
+        &zncc_variants, ZNCC_CALCULATE_NAME, &zncc_constants, W_ds, -1, &err
     );
     err_check(err);
+#endif
 
-    // execute downscaling for left and right images
-    printf("downscaling input images...\n");
-    cl_event prof_evt_ds_left  = NULL;
-    cl_event prof_evt_ds_right = NULL;
+    // create buffers for images and load original images into device memory
+    // originals
+    cl_mem dev_image_left  = NULL;
+    cl_mem dev_image_right = NULL;
+    // downscaled grayscale
+    cl_mem dev_image_gs_left  = NULL;
+    cl_mem dev_image_gs_right = NULL;
 
-    enqueue_downscaling_work(
-        queue,
-        downscaling_k,
-        NUM_ROWS,
-        dev_image_left,
-        dev_image_ds_left,
-        &prof_evt_ds_left,
-        &err
-    );
-    err_check(err);
+    const cl_image_format image_format_rgba = {CL_RGBA, CL_UNSIGNED_INT8};
+    const cl_image_format image_format_gs   = {CL_R, GRAYSCALE_CHANNEL_TYPE};
 
-    enqueue_downscaling_work(
-        queue,
-        downscaling_k,
-        NUM_ROWS,
-        dev_image_right,
-        dev_image_ds_right,
-        &prof_evt_ds_right,
-        &err
+    dev_image_left = allocate_2D_image(
+        ctx, &image_format_rgba, W_orig, H_orig, rgba_left, &err
     );
     err_check(err);
 
-    err = clFinish(queue);
+    dev_image_right = allocate_2D_image(
+        ctx, &image_format_rgba, W_orig, H_orig, rgba_right, &err
+    );
     err_check(err);
 
-#if OUTPUT_INTERMEDIATE_IMAGES == 1
-    // output intermediate images
-    rgba_img_t ds_l = {.img = NULL, .width = W_ds, .height = H_ds};
-    rgba_img_t ds_r = {.img = NULL, .width = W_ds, .height = H_ds};
-
-    ds_l.img = read_device_image(
-        queue, dev_image_ds_left, W_ds, H_ds, sizeof(rgba_t), &err
-    );
+    dev_image_gs_left =
+        allocate_2D_image(ctx, &image_format_gs, W_ds, H_ds, NULL, &err);
     err_check(err);
 
-    ds_r.img = read_device_image(
-        queue, dev_image_ds_right, W_ds, H_ds, sizeof(rgba_t), &err
-    );
+    dev_image_gs_right =
+        allocate_2D_image(ctx, &image_format_gs, W_ds, H_ds, NULL, &err);
     err_check(err);
 
-    output_image("./output_images/tmp_ds_l.png", &ds_l, RGBA, NULL);
-    output_image("./output_images/tmp_ds_r.png", &ds_r, RGBA, NULL);
+    PROFILING_BLOCK_END(preprocessing);
 
-    free(ds_l.img);
-    free(ds_r.img);
-#endif
+    // All device stages are chained with events and intermediate results stay
+    // in device memory, the host only waits for the final depthmap.
+    PROFILING_BLOCK_BEGIN(device_pipeline);
 
-    // execute grayscaling work for left and right images
-    printf("grayscaling input images...\n");
+    // downscale and grayscale left and right images in one pass
+    printf("downscaling and grayscaling input images...\n");
     cl_event prof_evt_gs_left  = NULL;
     cl_event prof_evt_gs_right = NULL;
 
-    enqueue_grayscaling_work(
+    enqueue_preprocessing_work(
         queue,
-        grayscaling_k,
-        NUM_ROWS,
-        dev_image_ds_left,
+        preprocessing_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        dev_image_left,
         dev_image_gs_left,
+        0,
+        NULL,
         &prof_evt_gs_left,
         &err
     );
     err_check(err);
 
-    enqueue_grayscaling_work(
+    enqueue_preprocessing_work(
         queue,
-        grayscaling_k,
-        NUM_ROWS,
-        dev_image_ds_right,
+        preprocessing_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        dev_image_right,
         dev_image_gs_right,
+        0,
+        NULL,
         &prof_evt_gs_right,
         &err
     );
     err_check(err);
 
-    err = clFinish(queue);
-    err_check(err);
-
-    // free original and downscaled color images
+    // free original images, OpenCL keeps them alive until the kernels using
+    // them have finished
     clReleaseMemObject(dev_image_left);
     clReleaseMemObject(dev_image_right);
-    clReleaseMemObject(dev_image_ds_left);
-    clReleaseMemObject(dev_image_ds_right);
-
-    PROFILING_BLOCK_END(preprocessing);
 
 #if OUTPUT_INTERMEDIATE_IMAGES == 1
     // output intermediate images to check them
+    err = clFinish(queue);
+    err_check(err);
+
+#if GRAYSCALE_8BIT == 1
+    gray_img_t gs_l = {.img = NULL, .width = W_ds, .height = H_ds};
+    gray_img_t gs_r = {.img = NULL, .width = W_ds, .height = H_ds};
+    const palette_e gs_palette = GS;
+#else
     float_img_t gs_l = {
         .img = NULL, .max = 255.0f, .width = W_ds, .height = H_ds
     };
     float_img_t gs_r = {
         .img = NULL, .max = 255.0f, .width = W_ds, .height = H_ds
     };
+    const palette_e gs_palette = GS_FLOAT;
+#endif
 
     gs_l.img = read_device_image(
-        queue, dev_image_gs_left, W_ds, H_ds, sizeof(float), &err
+        queue, dev_image_gs_left, W_ds, H_ds, sizeof(gs_pixel_t), &err
     );
     err_check(err);
 
     gs_r.img = read_device_image(
-        queue, dev_image_gs_right, W_ds, H_ds, sizeof(float), &err
+        queue, dev_image_gs_right, W_ds, H_ds, sizeof(gs_pixel_t), &err
     );
     err_check(err);
 
-    output_image("./output_images/tmp_gs_l.png", &gs_l, GS_FLOAT, NULL);
-    output_image("./output_images/tmp_gs_r.png", &gs_r, GS_FLOAT, NULL);
+    output_image("./output_images/tmp_gs_l.png", &gs_l, gs_palette, NULL);
+    output_image("./output_images/tmp_gs_r.png", &gs_r, gs_palette, NULL);
 
     free(gs_l.img);
     free(gs_r.img);
 #endif
 
     // do ZNCC calculations
-    PROFILING_BLOCK_BEGIN(zncc_calculation);
-
     printf("calculate zncc...\n");
-    cl_event prof_evt_zncc_l = NULL;
-    cl_event prof_evt_zncc_r = NULL;
-    cl_mem   dev_disp_left   = NULL;
-    cl_mem   dev_disp_right  = NULL;
+    // left to right and right to left, or both at once for fused
+    cl_event prof_evt_zncc[ZNCC_NUM_EVENTS] = {NULL};
+    cl_mem dev_disp_left  = NULL;
+    cl_mem dev_disp_right = NULL;
 
     dev_disp_left = clCreateBuffer(
         ctx,
@@ -379,55 +593,201 @@ int main() {
     );
     err_check(err);
 
-    enqueue_zncc_work(
+#if ZNCC_KERNEL == ZNCC_KERNEL_FUSED
+    cl_mem dev_best_right = clCreateBuffer(
+        ctx,
+        CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS,
+        W_ds * H_ds * sizeof(float),
+        NULL,
+        &err
+    );
+    err_check(err);
+
+    const cl_event gs_events[] = {prof_evt_gs_left, prof_evt_gs_right};
+
+    enqueue_zncc_fused_work(
         queue,
         zncc_k,
-        NUM_ROWS,
+        &tuning,
+        W_ds,
+        H_ds,
+        MAX_DISP,
+        dev_image_gs_left,
+        dev_image_gs_right,
+        dev_best_right,
+        dev_disp_left,
+        dev_disp_right,
+        2,
+        gs_events,
+        &prof_evt_zncc[0],
+        &err
+    );
+    err_check(err);
+#elif ZNCC_KERNEL == ZNCC_KERNEL_TILED
+    // window mean and 1/sigma of each pixel, computed once for all
+    // disparities and both directions
+    cl_event prof_evt_dw_left  = NULL;
+    cl_event prof_evt_dw_right = NULL;
+    cl_mem   dev_mean_left     = NULL;
+    cl_mem   dev_mean_right    = NULL;
+    cl_mem   dev_inv_sd_left   = NULL;
+    cl_mem   dev_inv_sd_right  = NULL;
+
+    cl_mem *const window_data_buffers[] = {
+        &dev_mean_left, &dev_mean_right, &dev_inv_sd_left, &dev_inv_sd_right
+    };
+    for (uint32_t i = 0; i < 4; ++i) {
+        *window_data_buffers[i] = clCreateBuffer(
+            ctx,
+            CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS,
+            W_ds * H_ds * sizeof(float),
+            NULL,
+            &err
+        );
+        err_check(err);
+    }
+
+    enqueue_extract_data_windows_work(
+        queue,
+        data_windows_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        dev_image_gs_left,
+        dev_mean_left,
+        dev_inv_sd_left,
+        1,
+        &prof_evt_gs_left,
+        &prof_evt_dw_left,
+        &err
+    );
+    err_check(err);
+
+    enqueue_extract_data_windows_work(
+        queue,
+        data_windows_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        dev_image_gs_right,
+        dev_mean_right,
+        dev_inv_sd_right,
+        1,
+        &prof_evt_gs_right,
+        &prof_evt_dw_right,
+        &err
+    );
+    err_check(err);
+
+    const cl_event dw_events[] = {prof_evt_dw_left, prof_evt_dw_right};
+
+    enqueue_zncc_tiled_work(
+        queue,
+        zncc_lr_k,
+        W_ds,
+        H_ds,
         1,
         MAX_DISP,
         dev_image_gs_left,
         dev_image_gs_right,
+        dev_mean_left,
+        dev_inv_sd_left,
+        dev_mean_right,
+        dev_inv_sd_right,
         dev_disp_left,
-        &prof_evt_zncc_l,
+        2,
+        dw_events,
+        &prof_evt_zncc[0],
         &err
     );
     err_check(err);
 
-    enqueue_zncc_work(
+    enqueue_zncc_tiled_work(
         queue,
-        zncc_k,
-        NUM_ROWS,
+        zncc_rl_k,
+        W_ds,
+        H_ds,
         -1,
         MAX_DISP,
         dev_image_gs_left,
         dev_image_gs_right,
+        dev_mean_left,
+        dev_inv_sd_left,
+        dev_mean_right,
+        dev_inv_sd_right,
         dev_disp_right,
-        &prof_evt_zncc_r,
+        2,
+        dw_events,
+        &prof_evt_zncc[1],
         &err
     );
     err_check(err);
+#else
+    const cl_event gs_events[] = {prof_evt_gs_left, prof_evt_gs_right};
 
-    err = clFinish(queue);
+    enqueue_zncc_work(
+        queue,
+        zncc_lr_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        1,
+        MAX_DISP,
+        dev_image_gs_left,
+        dev_image_gs_right,
+        dev_disp_left,
+        2,
+        gs_events,
+        &prof_evt_zncc[0],
+        &err
+    );
     err_check(err);
 
-    PROFILING_BLOCK_END(zncc_calculation);
+    enqueue_zncc_work(
+        queue,
+        zncc_rl_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        -1,
+        MAX_DISP,
+        dev_image_gs_left,
+        dev_image_gs_right,
+        dev_disp_right,
+        2,
+        gs_events,
+        &prof_evt_zncc[1],
+        &err
+    );
+    err_check(err);
+#endif
 
-    // free images which are no longer needed
+    // free images which are no longer needed once the kernels are done
     clReleaseMemObject(dev_image_gs_left);
     clReleaseMemObject(dev_image_gs_right);
+#if ZNCC_KERNEL == ZNCC_KERNEL_FUSED
+    clReleaseMemObject(dev_best_right);
+#elif ZNCC_KERNEL == ZNCC_KERNEL_TILED
+    for (uint32_t i = 0; i < 4; ++i) {
+        clReleaseMemObject(*window_data_buffers[i]);
+    }
+#endif
 
-    // postprocessing
-    PROFILING_BLOCK_BEGIN(postprocessing);
     printf("postprocessing disparity data...\n");
 
     cl_event prof_evt_cross_check = NULL;
     cl_mem   dev_combined_image   = NULL;
 
+    // the depthmap is written straight into page aligned host memory, which
+    // is not copied at all if the device shares memory with the host
+    int32_t *depthmap_host =
+        allocate_host_memory(W_ds * H_ds * sizeof(int32_t));
+
     dev_combined_image = clCreateBuffer(
         ctx,
-        CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY,
+        CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
         W_ds * H_ds * sizeof(int32_t),
-        NULL,
+        depthmap_host,
         &err
     );
     err_check(err);
@@ -435,72 +795,115 @@ int main() {
     enqueue_cross_check_work(
         queue,
         cross_check_k,
-        NUM_ROWS,
+        &tuning,
         W_ds,
         H_ds,
         dev_disp_left,
         dev_disp_right,
         dev_combined_image,
+        ZNCC_NUM_EVENTS,
+        prof_evt_zncc,
         &prof_evt_cross_check,
         &err
     );
     err_check(err);
 
-    err = clFinish(queue);
+    clReleaseMemObject(dev_disp_left);
+    clReleaseMemObject(dev_disp_right);
+
+#if ZERO_FILL_ON_DEVICE == 1
+    printf("filling empty regions (on device)...\n");
+
+    // distance to the nearest non-zero pixel, only used between the passes
+    cl_event prof_evt_zero_fill[2] = {NULL, NULL};
+    cl_mem   dev_fill_dist         = NULL;
+
+    dev_fill_dist = clCreateBuffer(
+        ctx,
+        CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS,
+        W_ds * H_ds * sizeof(uint32_t),
+        NULL,
+        &err
+    );
     err_check(err);
 
-    // enqueue_zero_fill_work(
-    //     queue,
-    //     zero_fill_k,
-    //     1,
-    //     W_ds,
-    //     H_ds,
-    //     dev_combined_image,
-    //     &prof_evt_zero_fill,
-    //     &err
-    // );
-    // err_check(err);
+    enqueue_zero_fill_work(
+        queue,
+        fill_rows_k,
+        fill_columns_k,
+        &tuning,
+        W_ds,
+        H_ds,
+        dev_combined_image,
+        dev_fill_dist,
+        1,
+        &prof_evt_cross_check,
+        prof_evt_zero_fill,
+        &err
+    );
+    err_check(err);
+
+    clReleaseMemObject(dev_fill_dist);
 
-    // err = clFinish(queue);
-    // err_check(err);
+    cl_event *const final_evt = &prof_evt_zero_fill[1];
+#else
+    cl_event *const final_evt = &prof_evt_cross_check;
+#endif
 
+    // the only point where the host waits for the device
     int32_img_t depthmap = {
         .img = NULL, .max = MAX_DISP, .width = W_ds, .height = H_ds
     };
-    depthmap.img = read_device_memory(
-        queue, dev_combined_image, W_ds * H_ds * sizeof(int32_t), &err
+#if ZERO_FILL_ON_DEVICE == 1
+    const cl_map_flags depthmap_map_flags = CL_MAP_READ;
+#else
+    // zero regions are filled in place
+    const cl_map_flags depthmap_map_flags = CL_MAP_READ | CL_MAP_WRITE;
+#endif
+    depthmap.img = map_device_memory(
+        queue,
+        dev_combined_image,
+        depthmap_map_flags,
+        W_ds * H_ds * sizeof(int32_t),
+        1,
+        final_evt,
+        &err
     );
     err_check(err);
 
-    printf("filling empty regions (on host)...\n");
+    PROFILING_BLOCK_END(device_pipeline);
 
-#pragma omp parallel
-    {
-        int          num_threads = omp_get_num_threads();
-        int          thread_id   = omp_get_thread_num();
-        uint8_t     *visited     = malloc(W_ds * H_ds * sizeof(uint8_t));
-        coord_fifo_t fifo        = {
-                   .storage  = malloc(W_ds * H_ds * sizeof(coord_t)),
-                   .read     = 0,
-                   .write    = 0,
-                   .capacity = W_ds * H_ds
-        };
-
-        for (uint32_t y = thread_id; y < H_ds; y += num_threads) {
-            for (uint32_t x = 0; x < W_ds; ++x) {
-                int32_t curr = depthmap.img[(y * W_ds) + x];
-                if (curr == 0) {
-                    int32_t nnzn = find_nearest_nonzero_neighbour(
-                        depthmap.img, W_ds, H_ds, x, y, visited, &fifo
-                    );
-                    depthmap.img[(y * W_ds) + x] = nnzn;
-                }
-            }
-        }
-        free(fifo.storage);
-        free(visited);
+    if (tuning.num_tuned > 0 &&
+        work_size_table_save(&tuning.table, WORK_SIZE_TUNING_FILE) != 0) {
+        printf("error saving tuned work sizes\n");
     }
 
+    // postprocessing
+    PROFILING_BLOCK_BEGIN(postprocessing);
+
+#if ZERO_FILL_ON_DEVICE == 0
+    printf("filling empty regions (on host)...\n");
+
+    // distance transform, rows and then columns are independent of each other
+    task_pool_t pool;
+    task_pool_init(&pool, (uint32_t)omp_get_max_threads());
+
+    fill_task_arg_t fill_arg = {
+        .img  = depthmap.img,
+        .dist = malloc(W_ds * H_ds * sizeof(uint32_t)),
+        .W    = W_ds,
+        .H    = H_ds
+    };
+    assert(fill_arg.dist != NULL);
+
+    task_pool_parallel_for(&pool, 0, H_ds, 1, fill_rows_task, &fill_arg);
+    // columns are swept row-major, so give each task a cache line or more
+    task_pool_parallel_for(&pool, 0, W_ds, 16, fill_columns_task, &fill_arg);
+
+    free(fill_arg.dist);
+    task_pool_destroy(&pool);
+#endif
+
     PROFILING_BLOCK_END(postprocessing);
 
     img_write_result_t r = {.err = 0};
@@ -510,53 +913,66 @@ int main() {
     }
 
     // free remaining resources
-    clReleaseMemObject(dev_disp_left);
-    clReleaseMemObject(dev_disp_right);
+    unmap_device_memory(queue, dev_combined_image, depthmap.img, &err);
+    err_check(err);
     clReleaseMemObject(dev_combined_image);
-    free(depthmap.img);
+    err = clFinish(queue);
+    err_check(err);
+    free(rgba_left);
+    free(rgba_right);
+    free(depthmap_host);
+    program_variants_release(&zncc_variants);
 
     PROFILING_BLOCK_END(total_runtime);
 
     // print profiling information
 
-    uint64_t ds_ns =
-        get_exec_ns(prof_evt_ds_left) + get_exec_ns(prof_evt_ds_right);
-    uint64_t gs_ns =
-        get_exec_ns(prof_evt_gs_left) + get_exec_ns(prof_evt_gs_right);
-    uint64_t zncc_ns =
-        get_exec_ns(prof_evt_zncc_l) + get_exec_ns(prof_evt_zncc_r);
-    uint64_t postprocess_ns = get_exec_ns(prof_evt_cross_check);
+    // all stages are enqueued up front and left and right may overlap, so
+    // each stage is timed from its first start to its last end
+    const cl_event preprocess_evts[] = {prof_evt_gs_left, prof_evt_gs_right};
+    uint64_t       preprocess_ns     = get_span_ns(preprocess_evts, 2);
+#if ZNCC_KERNEL == ZNCC_KERNEL_TILED
+    const cl_event zncc_evts[] = {
+        prof_evt_dw_left, prof_evt_dw_right, prof_evt_zncc[0], prof_evt_zncc[1]
+    };
+    uint64_t zncc_ns = get_span_ns(zncc_evts, 4);
+#else
+    uint64_t zncc_ns = get_span_ns(prof_evt_zncc, ZNCC_NUM_EVENTS);
+#endif
+#if ZERO_FILL_ON_DEVICE == 1
+    const cl_event postprocess_evts[] = {
+        prof_evt_cross_check, prof_evt_zero_fill[0], prof_evt_zero_fill[1]
+    };
+    uint64_t postprocess_ns = get_span_ns(postprocess_evts, 3);
+#else
+    uint64_t postprocess_ns = get_span_ns(&prof_evt_cross_check, 1);
+#endif
 
     printf("\nOpenCL profiling blocks:\n");
-    PROFILING_RAW_PRINT_US("downscaling", ds_ns);
-    PROFILING_RAW_PRINT_US("grayscaling", gs_ns);
+    PROFILING_RAW_PRINT_US("downscaling_grayscaling", preprocess_ns);
     PROFILING_RAW_PRINT_MS("zncc_calculation", zncc_ns);
     PROFILING_RAW_PRINT_US("postprocessing", postprocess_ns);
 
     printf("\nhost program profiling blocks:\n");
     PROFILING_BLOCK_PRINT_MS(opencl_runtime_setup);
     PROFILING_BLOCK_PRINT_MS(preprocessing);
-    PROFILING_BLOCK_PRINT_S(zncc_calculation);
+    PROFILING_BLOCK_PRINT_S(device_pipeline);
     PROFILING_BLOCK_PRINT_MS(postprocessing);
     PROFILING_BLOCK_PRINT_S(total_runtime);
 
     return 0;
 }
 
-#define SET_KERNEL_ARG(idx, t, v)                                 \
-    internal_err = clSetKernelArg(kernel, (idx), sizeof(t), (v)); \
-    if (internal_err != CL_SUCCESS) {                             \
-        printf("error setting argument %d\n", (idx));             \
-        *err = internal_err;                                      \
-        return;                                                   \
-    }
-
-void enqueue_grayscaling_work(
+void enqueue_preprocessing_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
     cl_mem           img_in,
     cl_mem           img_out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 ) {
@@ -565,14 +981,42 @@ void enqueue_grayscaling_work(
         err = &internal_err;
     }
 
-    SET_KERNEL_ARG(0, uint32_t, &N)
     SET_KERNEL_ARG(1, cl_mem, &img_in)
     SET_KERNEL_ARG(2, cl_mem, &img_out)
 
-    const size_t global_id = N;
+    // the number of row sections N is tuned
+    const work_size_t ws = get_work_size(
+        tuning,
+        queue,
+        kernel,
+        PREPROCESSING_KERNEL_NAME,
+        WORK_SIZE_ROW_SECTIONS,
+        1,
+        H,
+        W,
+        0,
+        num_wait_events,
+        wait_events,
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    const uint32_t N = (uint32_t)ws.global[0];
+    SET_KERNEL_ARG(0, uint32_t, &N);
 
     internal_err = clEnqueueNDRangeKernel(
-        queue, kernel, 1, NULL, &global_id, NULL, 0, NULL, profiling_evt
+        queue,
+        kernel,
+        ws.work_dim,
+        NULL,
+        ws.global,
+        (ws.local[0] == 0) ? NULL : ws.local,
+        num_wait_events,
+        wait_events,
+        profiling_evt
     );
     if (internal_err != CL_SUCCESS) {
         *err = internal_err;
@@ -582,12 +1026,19 @@ void enqueue_grayscaling_work(
     *err = CL_SUCCESS;
 }
 
-void enqueue_downscaling_work(
+void enqueue_zncc_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
-    cl_mem           img_in,
-    cl_mem           img_out,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
+    const int32_t    direction,
+    const uint32_t   max_disparity,
+    cl_mem           img_left,
+    cl_mem           img_right,
+    cl_mem           disp_img_out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 ) {
@@ -596,14 +1047,45 @@ void enqueue_downscaling_work(
         err = &internal_err;
     }
 
-    SET_KERNEL_ARG(0, uint32_t, &N)
-    SET_KERNEL_ARG(1, cl_mem, &img_in)
-    SET_KERNEL_ARG(2, cl_mem, &img_out)
+    SET_KERNEL_ARG(1, int32_t, &direction);
+    SET_KERNEL_ARG(2, uint32_t, &max_disparity);
+    SET_KERNEL_ARG(3, cl_mem, &img_left);
+    SET_KERNEL_ARG(4, cl_mem, &img_right);
+    SET_KERNEL_ARG(5, cl_mem, &disp_img_out);
 
-    const size_t global_id = N;
+    // the number of row sections N is tuned
+    const work_size_t ws = get_work_size(
+        tuning,
+        queue,
+        kernel,
+        (direction > 0) ? ZNCC_CALCULATE_NAME "_lr" : ZNCC_CALCULATE_NAME "_rl",
+        WORK_SIZE_ROW_SECTIONS,
+        1,
+        H,
+        W,
+        0,
+        num_wait_events,
+        wait_events,
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    const uint32_t N = (uint32_t)ws.global[0];
+    SET_KERNEL_ARG(0, uint32_t, &N);
 
     internal_err = clEnqueueNDRangeKernel(
-        queue, kernel, 1, NULL, &global_id, NULL, 0, NULL, profiling_evt
+        queue,
+        kernel,
+        ws.work_dim,
+        NULL,
+        ws.global,
+        (ws.local[0] == 0) ? NULL : ws.local,
+        num_wait_events,
+        wait_events,
+        profiling_evt
     );
     if (internal_err != CL_SUCCESS) {
         *err = internal_err;
@@ -613,15 +1095,20 @@ void enqueue_downscaling_work(
     *err = CL_SUCCESS;
 }
 
-void enqueue_zncc_work(
+void enqueue_zncc_fused_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
-    const int32_t    direction,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
     const uint32_t   max_disparity,
     cl_mem           img_left,
     cl_mem           img_right,
-    cl_mem           disp_img_out,
+    cl_mem           best_right,
+    cl_mem           disp_img_left,
+    cl_mem           disp_img_right,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 ) {
@@ -630,17 +1117,168 @@ void enqueue_zncc_work(
         err = &internal_err;
     }
 
+    SET_KERNEL_ARG(1, uint32_t, &max_disparity);
+    SET_KERNEL_ARG(2, cl_mem, &img_left);
+    SET_KERNEL_ARG(3, cl_mem, &img_right);
+    SET_KERNEL_ARG(4, cl_mem, &best_right);
+    SET_KERNEL_ARG(5, cl_mem, &disp_img_left);
+    SET_KERNEL_ARG(6, cl_mem, &disp_img_right);
+
+    // the number of row sections N is tuned
+    const work_size_t ws = get_work_size(
+        tuning,
+        queue,
+        kernel,
+        ZNCC_CALCULATE_FUSED_NAME,
+        WORK_SIZE_ROW_SECTIONS,
+        1,
+        H,
+        W,
+        0,
+        num_wait_events,
+        wait_events,
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    const uint32_t N = (uint32_t)ws.global[0];
     SET_KERNEL_ARG(0, uint32_t, &N);
-    SET_KERNEL_ARG(1, int32_t, &direction);
-    SET_KERNEL_ARG(2, uint32_t, &max_disparity);
-    SET_KERNEL_ARG(3, cl_mem, &img_left);
-    SET_KERNEL_ARG(4, cl_mem, &img_right);
-    SET_KERNEL_ARG(5, cl_mem, &disp_img_out);
 
-    const size_t global_id = N;
+    internal_err = clEnqueueNDRangeKernel(
+        queue,
+        kernel,
+        ws.work_dim,
+        NULL,
+        ws.global,
+        (ws.local[0] == 0) ? NULL : ws.local,
+        num_wait_events,
+        wait_events,
+        profiling_evt
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    *err = CL_SUCCESS;
+}
+
+void enqueue_extract_data_windows_work(
+    cl_command_queue queue,
+    cl_kernel        kernel,
+    tuning_t        *tuning,
+    const uint32_t   W,
+    const uint32_t   H,
+    cl_mem           img,
+    cl_mem           mean,
+    cl_mem           inv_sigma,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
+    cl_event        *profiling_evt,
+    cl_int          *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    SET_KERNEL_ARG(0, cl_mem, &img);
+    SET_KERNEL_ARG(1, cl_mem, &mean);
+    SET_KERNEL_ARG(2, cl_mem, &inv_sigma);
+
+    // one work item per pixel, the work group size is tuned
+    const work_size_t ws = get_work_size(
+        tuning,
+        queue,
+        kernel,
+        ZNCC_EXTRACT_DATA_WINDOWS_NAME,
+        WORK_SIZE_PER_ITEM,
+        2,
+        W,
+        H,
+        -1,
+        num_wait_events,
+        wait_events,
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
 
     internal_err = clEnqueueNDRangeKernel(
-        queue, kernel, 1, NULL, &global_id, NULL, 0, NULL, profiling_evt
+        queue,
+        kernel,
+        ws.work_dim,
+        NULL,
+        ws.global,
+        (ws.local[0] == 0) ? NULL : ws.local,
+        num_wait_events,
+        wait_events,
+        profiling_evt
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    *err = CL_SUCCESS;
+}
+
+void enqueue_zncc_tiled_work(
+    cl_command_queue queue,
+    cl_kernel        kernel,
+    const uint32_t   W,
+    const uint32_t   H,
+    const int32_t    direction,
+    const uint32_t   max_disparity,
+    cl_mem           img_left,
+    cl_mem           img_right,
+    cl_mem           mean_left,
+    cl_mem           inv_sigma_left,
+    cl_mem           mean_right,
+    cl_mem           inv_sigma_right,
+    cl_mem           disp_img_out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
+    cl_event        *profiling_evt,
+    cl_int          *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    SET_KERNEL_ARG(0, int32_t, &direction);
+    SET_KERNEL_ARG(1, uint32_t, &max_disparity);
+    SET_KERNEL_ARG(2, cl_mem, &img_left);
+    SET_KERNEL_ARG(3, cl_mem, &img_right);
+    SET_KERNEL_ARG(4, cl_mem, &mean_left);
+    SET_KERNEL_ARG(5, cl_mem, &inv_sigma_left);
+    SET_KERNEL_ARG(6, cl_mem, &mean_right);
+    SET_KERNEL_ARG(7, cl_mem, &inv_sigma_right);
+    SET_KERNEL_ARG(8, cl_mem, &disp_img_out);
+
+    // one work item per pixel, padded to whole tiles
+    const size_t local_size[2]  = {ZNCC_TILE_WIDTH, ZNCC_TILE_HEIGHT};
+    const size_t global_size[2] = {
+        ((W + ZNCC_TILE_WIDTH - 1) / ZNCC_TILE_WIDTH) * ZNCC_TILE_WIDTH,
+        ((H + ZNCC_TILE_HEIGHT - 1) / ZNCC_TILE_HEIGHT) * ZNCC_TILE_HEIGHT
+    };
+
+    internal_err = clEnqueueNDRangeKernel(
+        queue,
+        kernel,
+        2,
+        NULL,
+        global_size,
+        local_size,
+        num_wait_events,
+        wait_events,
+        profiling_evt
     );
     if (internal_err != CL_SUCCESS) {
         *err = internal_err;
@@ -653,12 +1291,14 @@ void enqueue_zncc_work(
 void enqueue_cross_check_work(
     cl_command_queue queue,
     cl_kernel        kernel,
-    const uint32_t   N,
+    tuning_t        *tuning,
     const uint32_t   W,
     const uint32_t   H,
     cl_mem           disp_img_left,
     cl_mem           disp_img_right,
     cl_mem           out,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
     cl_event        *profiling_evt,
     cl_int          *err
 ) {
@@ -667,17 +1307,45 @@ void enqueue_cross_check_work(
         err = &internal_err;
     }
 
-    SET_KERNEL_ARG(0, uint32_t, &N);
     SET_KERNEL_ARG(1, uint32_t, &W);
     SET_KERNEL_ARG(2, uint32_t, &H);
     SET_KERNEL_ARG(3, cl_mem, &disp_img_left);
     SET_KERNEL_ARG(4, cl_mem, &disp_img_right);
     SET_KERNEL_ARG(5, cl_mem, &out);
 
-    const size_t global_id = N;
+    // the number of row sections N is tuned
+    const work_size_t ws = get_work_size(
+        tuning,
+        queue,
+        kernel,
+        ZNCC_CROSS_CHECK_NAME,
+        WORK_SIZE_ROW_SECTIONS,
+        1,
+        H,
+        W,
+        0,
+        num_wait_events,
+        wait_events,
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    const uint32_t N = (uint32_t)ws.global[0];
+    SET_KERNEL_ARG(0, uint32_t, &N);
 
     internal_err = clEnqueueNDRangeKernel(
-        queue, kernel, 1, NULL, &global_id, NULL, 0, NULL, profiling_evt
+        queue,
+        kernel,
+        ws.work_dim,
+        NULL,
+        ws.global,
+        (ws.local[0] == 0) ? NULL : ws.local,
+        num_wait_events,
+        wait_events,
+        profiling_evt
     );
     if (internal_err != CL_SUCCESS) {
         *err = internal_err;
@@ -689,12 +1357,16 @@ void enqueue_cross_check_work(
 
 void enqueue_zero_fill_work(
     cl_command_queue queue,
-    cl_kernel        kernel,
-    const uint32_t   N,
+    cl_kernel        rows_kernel,
+    cl_kernel        columns_kernel,
+    tuning_t        *tuning,
     const uint32_t   W,
     const uint32_t   H,
     cl_mem           img,
-    cl_event        *profiling_evt,
+    cl_mem           dist,
+    const cl_uint    num_wait_events,
+    const cl_event  *wait_events,
+    cl_event        *profiling_evts,
     cl_int          *err
 ) {
     cl_int internal_err;
@@ -702,15 +1374,72 @@ void enqueue_zero_fill_work(
         err = &internal_err;
     }
 
-    SET_KERNEL_ARG(0, uint32_t, &N);
-    SET_KERNEL_ARG(1, uint32_t, &W);
-    SET_KERNEL_ARG(2, uint32_t, &H);
-    SET_KERNEL_ARG(3, cl_mem, &img);
+    // pass 1: work item per row, pass 2: work item per column
+    cl_kernel kernel = rows_kernel;
 
-    const size_t global_id = N;
+    SET_KERNEL_ARG(0, uint32_t, &W);
+    SET_KERNEL_ARG(1, uint32_t, &H);
+    SET_KERNEL_ARG(2, cl_mem, &img);
+    SET_KERNEL_ARG(3, cl_mem, &dist);
+
+    // the rows pass reads pixels it has filled, so it can't be timed by
+    // running it again and the runtime picks its work group size
+    const size_t global_id = H;
+
+    internal_err = clEnqueueNDRangeKernel(
+        queue,
+        kernel,
+        1,
+        NULL,
+        &global_id,
+        NULL,
+        num_wait_events,
+        wait_events,
+        &profiling_evts[0]
+    );
+
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    kernel = columns_kernel;
+
+    SET_KERNEL_ARG(0, uint32_t, &W);
+    SET_KERNEL_ARG(1, uint32_t, &H);
+    SET_KERNEL_ARG(2, cl_mem, &img);
+    SET_KERNEL_ARG(3, cl_mem, &dist);
+
+    // the columns pass doesn't change an already filled image
+    const work_size_t ws = get_work_size(
+        tuning,
+        queue,
+        kernel,
+        ZNCC_FILL_COLUMNS_NAME,
+        WORK_SIZE_PER_ITEM,
+        1,
+        W,
+        H,
+        -1,
+        1,
+        &profiling_evts[0],
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
 
     internal_err = clEnqueueNDRangeKernel(
-        queue, kernel, 1, NULL, &global_id, NULL, 0, NULL, profiling_evt
+        queue,
+        kernel,
+        ws.work_dim,
+        NULL,
+        ws.global,
+        (ws.local[0] == 0) ? NULL : ws.local,
+        1,
+        &profiling_evts[0],
+        &profiling_evts[1]
     );
 
     if (internal_err != CL_SUCCESS) {
@@ -719,4 +1448,85 @@ void enqueue_zero_fill_work(
     }
 
     *err = CL_SUCCESS;
-}
\ No newline at end of file
+}
+
+#if ZERO_FILL_ON_DEVICE == 0
+static void fill_rows_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+) {
+    fill_task_arg_t *arg = p;
+    (void)worker_id;
+    fill_zero_regions_rows(arg->img, arg->dist, arg->W, arg->H, begin, end);
+}
+
+static void fill_columns_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *p
+) {
+    fill_task_arg_t *arg = p;
+    (void)worker_id;
+    fill_zero_regions_columns(arg->img, arg->dist, arg->W, arg->H, begin, end);
+}
+#endif
+
+work_size_t get_work_size(
+    tuning_t              *tuning,
+    cl_command_queue       queue,
+    cl_kernel              kernel,
+    const char            *name,
+    const work_size_kind_t kind,
+    const uint32_t         work_dim,
+    const uint32_t         n0,
+    const uint32_t         n1,
+    const int32_t          n_arg,
+    const cl_uint          num_wait_events,
+    const cl_event        *wait_events,
+    cl_int                *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    cl_device_id dev = NULL;
+    (void)clGetCommandQueueInfo(
+        queue, CL_QUEUE_DEVICE, sizeof(dev), &dev, NULL
+    );
+    char options[MAX_PROGRAM_OPTIONS_LEN];
+    get_kernel_build_options(kernel, dev, options, sizeof(options));
+
+    char key[WORK_SIZE_KEY_LEN];
+    work_size_key(key, name, options, tuning->device, n0, n1);
+
+    const work_size_t *tuned = work_size_table_find(&tuning->table, key);
+    if (tuned != NULL) {
+        *err = CL_SUCCESS;
+        return *tuned;
+    }
+
+    work_size_t    candidates[WORK_SIZE_MAX_CANDIDATES];
+    const uint32_t num_candidates = work_size_candidates(
+        kind, work_dim, n0, n1, MAX_TUNED_LOCAL_SIZE, candidates
+    );
+
+    printf("tuning work size of %s...\n", name);
+    const uint32_t best = tune_work_size(
+        queue,
+        kernel,
+        n_arg,
+        candidates,
+        num_candidates,
+        num_wait_events,
+        wait_events,
+        &internal_err
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return candidates[0];
+    }
+
+    work_size_table_set(&tuning->table, key, &candidates[best]);
+    tuning->num_tuned += 1;
+
+    *err = CL_SUCCESS;
+    return candidates[best];
+}
@@ -0,0 +1,574 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CL/cl.h>
+
+#include "device_support.h"
+#include "image_operations.h"
+#include "profiling.h"
+#include "row_scheduler.h"
+#include "types.h"
+#include "zncc_operations.h"
+
+/*
+ * ZNCC on every OpenCL device of the machine at once, e.g. a CPU and an
+ * integrated GPU, or several CPU sub-devices.
+ *
+ * Each device has its own context and queue, and gets the grayscale images and
+ * a strip of rows to compute the disparities of with calculate_zncc_tiled. A
+ * first strip of CALIBRATION_TILE_ROWS tile rows per device measures the
+ * throughput of each device, the rest of the image is split in proportion to
+ * it. Disparity strips are merged on the host, which also does the cheap
+ * pre- and postprocessing.
+ */
+
+#define IMAGE_PATH_LEFT "./test_images/im0.png"
+#define IMAGE_PATH_RIGHT "./test_images/im1.png"
+#define IMAGE_PATH_OUT "./output_images/depthmap_multi_device.png"
+
+#define ZNCC_KERNEL_FILE "./kernels/zncc.cl"
+#define ZNCC_EXTRACT_DATA_WINDOWS_NAME "extract_data_windows"
+#define ZNCC_CALCULATE_TILED_NAME "calculate_zncc_tiled"
+
+#define PROGRAM_BUILD_OPTIONS "-Werror"
+#define PROGRAM_CACHE_DIR "./kernel_cache"
+
+#define DOWNSCALING_FACTOR_W 4
+#define DOWNSCALING_FACTOR_H 4
+
+#define MAX_DISP (260u / DOWNSCALING_FACTOR_W)
+#define CROSSCHECK_THRESHOLD 8
+#define WINDOW_WIDTH 9u
+#define WINDOW_HEIGHT 9u
+
+// work group size of calculate_zncc_tiled, TILE_WIDTH x TILE_HEIGHT in zncc.cl
+#define ZNCC_TILE_WIDTH 16u
+#define ZNCC_TILE_HEIGHT 8u
+
+#define MAX_NUM_DEVICES 8u
+
+// rows each device computes first to measure its throughput, in tile rows
+#define CALIBRATION_TILE_ROWS 2u
+
+#define err_check(e) check_cl_error_with_file_line(__FILE__, __LINE__, e)
+
+static const zncc_program_constants_t zncc_constants = {
+    .base_options         = PROGRAM_BUILD_OPTIONS,
+    .window_width         = WINDOW_WIDTH,
+    .window_height        = WINDOW_HEIGHT,
+    .max_disparity        = MAX_DISP,
+    .crosscheck_threshold = CROSSCHECK_THRESHOLD
+};
+
+// everything one device needs
+typedef struct {
+    cl_device_id       dev;
+    cl_context         ctx;
+    cl_command_queue   queue;
+    program_variants_t variants;
+    cl_kernel          zncc_lr_k;  // left to right
+    cl_kernel          zncc_rl_k;  // right to left
+    float             *gs_host[2]; // host memory of gs, one copy per device
+    cl_mem             gs[2];      // grayscale left and right image
+    cl_mem             mean[2];    // window means of gs
+    cl_mem             inv_sd[2];  // inverse window std devs of gs
+    cl_mem             disp[2];    // disparities left to right, right to left
+} device_slot_t;
+
+/*!
+ * @brief Creates context, queue, kernels and buffers of one device and
+ * computes the window statistics of both images, waits for the device
+ * @param[out] slot : device state
+ * @param dev : OpenCL device
+ * @param W : image width
+ * @param H : image height
+ * @param gs_left : left grayscale image, W * H values, copied
+ * @param gs_right : right grayscale image, W * H values, copied
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ */
+void setup_device(
+    device_slot_t *slot,
+    cl_device_id   dev,
+    const uint32_t W,
+    const uint32_t H,
+    const float   *gs_left,
+    const float   *gs_right,
+    cl_int        *err
+);
+
+/*!
+ * @brief Enqueues both ZNCC directions for rows row_begin..row_end-1
+ * @param slot : device state
+ * @param W : image width
+ * @param row_begin : first row, multiple of ZNCC_TILE_HEIGHT
+ * @param row_end : one past last row
+ * @param[out] profiling_evts : 2 events, left to right and right to left
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ */
+void enqueue_strip(
+    device_slot_t *slot,
+    const uint32_t W,
+    const uint32_t row_begin,
+    const uint32_t row_end,
+    cl_event      *profiling_evts,
+    cl_int        *err
+);
+
+/*!
+ * @brief Reads disparities of rows row_begin..row_end-1 into the full size
+ * host images, waits for the device
+ * @param slot : device state
+ * @param W : image width
+ * @param row_begin : first row
+ * @param row_end : one past last row
+ * @param[out] disp_left : left to right disparities, W * H values
+ * @param[out] disp_right : right to left disparities, W * H values
+ * @param[out] err : CL_SUCCESS for success, error code otherwise
+ */
+void read_strip(
+    device_slot_t *slot,
+    const uint32_t W,
+    const uint32_t row_begin,
+    const uint32_t row_end,
+    int32_t       *disp_left,
+    int32_t       *disp_right,
+    cl_int        *err
+);
+
+void release_device(device_slot_t *slot);
+
+int main() {
+    PROFILING_BLOCK_DECLARE(total_runtime);
+    PROFILING_BLOCK_DECLARE(opencl_runtime_setup);
+    PROFILING_BLOCK_DECLARE(preprocessing);
+    PROFILING_BLOCK_DECLARE(zncc_calculation);
+    PROFILING_BLOCK_DECLARE(postprocessing);
+
+    PROFILING_BLOCK_BEGIN(total_runtime);
+    PROFILING_BLOCK_BEGIN(preprocessing);
+
+    cl_int err = CL_SUCCESS;
+
+    printf("loading input images into memory...\n");
+    img_load_result_t load_left;
+    img_load_result_t load_right;
+    load_image(IMAGE_PATH_LEFT, &load_left);
+    load_image(IMAGE_PATH_RIGHT, &load_right);
+
+    assert(load_left.img_desc.img != NULL);
+    assert(load_right.img_desc.img != NULL);
+    assert(load_left.img_desc.width == load_right.img_desc.width);
+    assert(load_left.img_desc.height == load_right.img_desc.height);
+
+    const uint32_t W = load_left.img_desc.width / DOWNSCALING_FACTOR_W;
+    const uint32_t H = load_left.img_desc.height / DOWNSCALING_FACTOR_H;
+
+    // cheap compared to ZNCC, so done once on the host
+    printf("downscaling and grayscaling input images...\n");
+    float *gs_left_f  = malloc(W * H * sizeof(float));
+    float *gs_right_f = malloc(W * H * sizeof(float));
+    assert(gs_left_f != NULL && gs_right_f != NULL);
+    downscale_to_grayscale(
+        &load_left.img_desc, gs_left_f, GS_FLOAT, W, H, 0, H
+    );
+    downscale_to_grayscale(
+        &load_right.img_desc, gs_right_f, GS_FLOAT, W, H, 0, H
+    );
+    free(load_left.img_desc.img);
+    free(load_right.img_desc.img);
+
+    PROFILING_BLOCK_END(preprocessing);
+    PROFILING_BLOCK_BEGIN(opencl_runtime_setup);
+
+    printf("set up OpenCL devices...\n");
+
+    cl_device_id  devices[MAX_NUM_DEVICES];
+    const cl_uint num_devices = get_all_devices(devices, MAX_NUM_DEVICES, &err);
+    err_check(err);
+    if (num_devices == 0) {
+        printf("no OpenCL devices found\n");
+        return 1;
+    }
+
+    device_slot_t slots[MAX_NUM_DEVICES];
+    for (cl_uint i = 0; i < num_devices; ++i) {
+        setup_device(&slots[i], devices[i], W, H, gs_left_f, gs_right_f, &err);
+        err_check(err);
+    }
+    // every device has its own copy
+    free(gs_left_f);
+    free(gs_right_f);
+
+    PROFILING_BLOCK_END(opencl_runtime_setup);
+    PROFILING_BLOCK_BEGIN(zncc_calculation);
+
+    printf("calculate zncc on %u devices...\n", num_devices);
+
+    int32_t *disp_left  = malloc(W * H * sizeof(int32_t));
+    int32_t *disp_right = malloc(W * H * sizeof(int32_t));
+    assert(disp_left != NULL && disp_right != NULL);
+
+    row_scheduler_t scheduler;
+    row_scheduler_init(&scheduler, num_devices, ZNCC_TILE_HEIGHT);
+
+    uint32_t bounds[MAX_NUM_DEVICES + 1];
+    cl_event evts[MAX_NUM_DEVICES][2];
+
+    // 1st round measures the devices, 2nd round splits the rest accordingly
+    const uint32_t calibration_rows = CALIBRATION_TILE_ROWS * ZNCC_TILE_HEIGHT;
+    for (uint32_t round = 0; round < 2; ++round) {
+        if (round == 0) {
+            for (cl_uint i = 0; i <= num_devices; ++i) {
+                bounds[i] = (i * calibration_rows < H) ? i * calibration_rows
+                                                       : H;
+            }
+        } else {
+            row_scheduler_split(&scheduler, bounds[num_devices], H, bounds);
+        }
+
+        for (cl_uint i = 0; i < num_devices; ++i) {
+            if (bounds[i] < bounds[i + 1]) {
+                enqueue_strip(
+                    &slots[i], W, bounds[i], bounds[i + 1], evts[i], &err
+                );
+                err_check(err);
+            }
+            // start all devices before waiting for any of them
+            clFlush(slots[i].queue);
+        }
+
+        for (cl_uint i = 0; i < num_devices; ++i) {
+            if (bounds[i] == bounds[i + 1]) {
+                continue;
+            }
+            read_strip(
+                &slots[i],
+                W,
+                bounds[i],
+                bounds[i + 1],
+                disp_left,
+                disp_right,
+                &err
+            );
+            err_check(err);
+
+            // both directions run back to back on the in-order queue
+            const uint64_t ns = get_span_ns(evts[i], 2);
+            row_scheduler_record(
+                &scheduler, i, bounds[i + 1] - bounds[i], (ns > 0) ? ns : 1
+            );
+            printf(
+                "device %u: rows %u..%u, %.0f rows/s\n",
+                i,
+                bounds[i],
+                bounds[i + 1] - 1,
+                scheduler.throughput[i]
+            );
+            clReleaseEvent(evts[i][0]);
+            clReleaseEvent(evts[i][1]);
+        }
+    }
+
+    PROFILING_BLOCK_END(zncc_calculation);
+    PROFILING_BLOCK_BEGIN(postprocessing);
+
+    printf("postprocessing disparity data...\n");
+
+    int32_img_t depthmap = {
+        .img = malloc(W * H * sizeof(int32_t)), .max = MAX_DISP, .width = W,
+        .height = H
+    };
+    assert(depthmap.img != NULL);
+
+    // same as the cross_check kernel
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            const uint32_t offset    = (y * W) + x;
+            const int32_t  disparity = disp_left[offset];
+            const int32_t  delta =
+                abs(disparity - disp_right[offset - disparity]);
+
+            depthmap.img[offset] =
+                (delta < CROSSCHECK_THRESHOLD) ? disparity : 0;
+        }
+    }
+
+    fill_zero_regions(depthmap.img, NULL, W, H);
+
+    PROFILING_BLOCK_END(postprocessing);
+
+    img_write_result_t r = {.err = 0};
+    output_image(IMAGE_PATH_OUT, &depthmap, GS_INT32, &r);
+    if (r.err != 0) {
+        printf("error outputting depthmap: %d\n", r.err);
+    }
+
+    // free remaining resources
+    for (cl_uint i = 0; i < num_devices; ++i) {
+        release_device(&slots[i]);
+    }
+    free(disp_left);
+    free(disp_right);
+    free(depthmap.img);
+
+    PROFILING_BLOCK_END(total_runtime);
+
+    printf("\nhost program profiling blocks:\n");
+    PROFILING_BLOCK_PRINT_MS(preprocessing);
+    PROFILING_BLOCK_PRINT_MS(opencl_runtime_setup);
+    PROFILING_BLOCK_PRINT_S(zncc_calculation);
+    PROFILING_BLOCK_PRINT_MS(postprocessing);
+    PROFILING_BLOCK_PRINT_S(total_runtime);
+
+    return 0;
+}
+
+void setup_device(
+    device_slot_t *slot,
+    cl_device_id   dev,
+    const uint32_t W,
+    const uint32_t H,
+    const float   *gs_left,
+    const float   *gs_right,
+    cl_int        *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->dev = dev;
+
+    char name[128] = {0};
+    clGetDeviceInfo(dev, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+    printf("using device: %s\n", name);
+
+    slot->ctx = create_context(dev, err);
+    if (*err != CL_SUCCESS) {
+        return;
+    }
+
+    slot->queue = create_queue(slot->ctx, dev, err);
+    if (*err != CL_SUCCESS) {
+        return;
+    }
+
+    program_variants_init(
+        &slot->variants, ZNCC_KERNEL_FILE, PROGRAM_CACHE_DIR, slot->ctx, dev
+    );
+
+    cl_kernel kernel = build_zncc_kernel(
+        &slot->variants,
+        ZNCC_EXTRACT_DATA_WINDOWS_NAME,
+        &zncc_constants,
+        W,
+        0,
+        err
+    );
+    if (*err != CL_SUCCESS) {
+        return;
+    }
+
+    slot->zncc_lr_k = build_zncc_kernel(
+        &slot->variants, ZNCC_CALCULATE_TILED_NAME, &zncc_constants, W, 1, err
+    );
+    if (*err != CL_SUCCESS) {
+        return;
+    }
+
+    slot->zncc_rl_k = build_zncc_kernel(
+        &slot->variants, ZNCC_CALCULATE_TILED_NAME, &zncc_constants, W, -1, err
+    );
+    if (*err != CL_SUCCESS) {
+        return;
+    }
+
+    const cl_image_format image_format_gs = {CL_R, CL_FLOAT};
+    const float *const    gs_in[2]        = {gs_left, gs_right};
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        // the device reads its copy in place where it shares host memory.
+        // Images of other contexts must not use the same host memory.
+        slot->gs_host[i] = allocate_host_memory(W * H * sizeof(float));
+        memcpy(slot->gs_host[i], gs_in[i], W * H * sizeof(float));
+
+        slot->gs[i] = allocate_2D_image(
+            slot->ctx, &image_format_gs, W, H, slot->gs_host[i], err
+        );
+        if (*err != CL_SUCCESS) {
+            return;
+        }
+
+        cl_mem *const statistics[] = {&slot->mean[i], &slot->inv_sd[i]};
+        for (uint32_t b = 0; b < 2; ++b) {
+            *statistics[b] = clCreateBuffer(
+                slot->ctx,
+                CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS,
+                W * H * sizeof(float),
+                NULL,
+                &internal_err
+            );
+            if (internal_err != CL_SUCCESS) {
+                *err = internal_err;
+                return;
+            }
+        }
+
+        slot->disp[i] = clCreateBuffer(
+            slot->ctx,
+            CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY,
+            W * H * sizeof(int32_t),
+            NULL,
+            &internal_err
+        );
+        if (internal_err != CL_SUCCESS) {
+            *err = internal_err;
+            return;
+        }
+
+        SET_KERNEL_ARG(0, cl_mem, &slot->gs[i]);
+        SET_KERNEL_ARG(1, cl_mem, &slot->mean[i]);
+        SET_KERNEL_ARG(2, cl_mem, &slot->inv_sd[i]);
+
+        // statistics of the whole image, windows of a strip reach outside it
+        const size_t global_size[2] = {W, H};
+
+        internal_err = clEnqueueNDRangeKernel(
+            slot->queue, kernel, 2, NULL, global_size, NULL, 0, NULL, NULL
+        );
+        if (internal_err != CL_SUCCESS) {
+            *err = internal_err;
+            return;
+        }
+    }
+
+    clReleaseKernel(kernel);
+
+    // uploads and statistics must not count towards the first strip's time
+    internal_err = clFinish(slot->queue);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    *err = CL_SUCCESS;
+}
+
+void enqueue_strip(
+    device_slot_t *slot,
+    const uint32_t W,
+    const uint32_t row_begin,
+    const uint32_t row_end,
+    cl_event      *profiling_evts,
+    cl_int        *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    const uint32_t  max_disparity = MAX_DISP;
+    const int32_t   directions[2] = {1, -1};
+    const cl_kernel kernels[2]    = {slot->zncc_lr_k, slot->zncc_rl_k};
+
+    // one work item per pixel of the strip, padded to whole tiles
+    const size_t offset[2]      = {0, row_begin};
+    const size_t local_size[2]  = {ZNCC_TILE_WIDTH, ZNCC_TILE_HEIGHT};
+    const size_t global_size[2] = {
+        ((W + ZNCC_TILE_WIDTH - 1) / ZNCC_TILE_WIDTH) * ZNCC_TILE_WIDTH,
+        ((row_end - row_begin + ZNCC_TILE_HEIGHT - 1) / ZNCC_TILE_HEIGHT) *
+            ZNCC_TILE_HEIGHT
+    };
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        cl_kernel kernel = kernels[i];
+
+        SET_KERNEL_ARG(0, int32_t, &directions[i]);
+        SET_KERNEL_ARG(1, uint32_t, &max_disparity);
+        SET_KERNEL_ARG(2, cl_mem, &slot->gs[0]);
+        SET_KERNEL_ARG(3, cl_mem, &slot->gs[1]);
+        SET_KERNEL_ARG(4, cl_mem, &slot->mean[0]);
+        SET_KERNEL_ARG(5, cl_mem, &slot->inv_sd[0]);
+        SET_KERNEL_ARG(6, cl_mem, &slot->mean[1]);
+        SET_KERNEL_ARG(7, cl_mem, &slot->inv_sd[1]);
+        SET_KERNEL_ARG(8, cl_mem, &slot->disp[i]);
+
+        internal_err = clEnqueueNDRangeKernel(
+            slot->queue,
+            kernel,
+            2,
+            offset,
+            global_size,
+            local_size,
+            0,
+            NULL,
+            &profiling_evts[i]
+        );
+        if (internal_err != CL_SUCCESS) {
+            *err = internal_err;
+            return;
+        }
+    }
+
+    *err = CL_SUCCESS;
+}
+
+void read_strip(
+    device_slot_t *slot,
+    const uint32_t W,
+    const uint32_t row_begin,
+    const uint32_t row_end,
+    int32_t       *disp_left,
+    int32_t       *disp_right,
+    cl_int        *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    int32_t *const out[2] = {disp_left, disp_right};
+    const size_t   offset = row_begin * W * sizeof(int32_t);
+    const size_t   sz     = (row_end - row_begin) * W * sizeof(int32_t);
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        // the queue is in order, so this waits for the strip kernels
+        internal_err = clEnqueueReadBuffer(
+            slot->queue,
+            slot->disp[i],
+            CL_TRUE,
+            offset,
+            sz,
+            (uint8_t *)out[i] + offset,
+            0,
+            NULL,
+            NULL
+        );
+        if (internal_err != CL_SUCCESS) {
+            *err = internal_err;
+            return;
+        }
+    }
+
+    *err = CL_SUCCESS;
+}
+
+void release_device(device_slot_t *slot) {
+    for (uint32_t i = 0; i < 2; ++i) {
+        clReleaseMemObject(slot->gs[i]);
+        clReleaseMemObject(slot->mean[i]);
+        clReleaseMemObject(slot->inv_sd[i]);
+        clReleaseMemObject(slot->disp[i]);
+    }
+    // after the images using them
+    free(slot->gs_host[0]);
+    free(slot->gs_host[1]);
+    clReleaseKernel(slot->zncc_lr_k);
+    clReleaseKernel(slot->zncc_rl_k);
+    program_variants_release(&slot->variants);
+    clReleaseCommandQueue(slot->queue);
+    clReleaseContext(slot->ctx);
+}
@@ -1,11 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "device_support.h"
 #include "panic.h"
 
 #define MAX_PANIC_MSG_LEN 32
 #define MAX_PANIC_MSG_WITH_FILE_LINE_LEN 256
+#define PROGRAM_CACHE_PATH_LEN 512
 
 void check_cl_error(cl_int err) {
     if (err != CL_SUCCESS) {
@@ -23,54 +27,62 @@ void check_cl_error_with_file_line(const char *file, int line, cl_int err) {
     }
 }
 
-cl_program compile_program_from_file(
-    const char *path, cl_context ctx, cl_device_id dev, cl_int *err
-) {
-    cl_program program = NULL;
-    FILE      *f       = NULL;
-    size_t     sz      = 0;
-    char      *str     = NULL;
-    cl_int     internal_err;
-
-    if (err == NULL) {
-        err = &internal_err;
-    }
+/*
+ * Reads whole file into a NUL terminated string, NULL if it can't be opened.
+ */
+static char *read_whole_file(const char *path, size_t *sz) {
+    FILE *f   = NULL;
+    char *str = NULL;
 
     f = fopen(path, "rb");
-
     if (f == NULL) {
-        panic("failed to open src file!");
+        return NULL;
     }
 
-    // get size of program
+    // get size of file
     fseek(f, 0, SEEK_END);
-    sz = ftell(f);
+    *sz = ftell(f);
     rewind(f);
 
-    str = (char *)malloc(sz + 1);
+    str = (char *)malloc(*sz + 1);
     if (str == NULL) {
-        panic("failed to allocate string to hold kernel source");
+        panic("failed to allocate string to hold file contents");
     }
-    str[sz] = 0;
+    str[*sz] = 0;
 
     // read whole file into str
-    fread(str, sizeof(char), sz, f);
+    if (fread(str, sizeof(char), *sz, f) != *sz) {
+        free(str);
+        str = NULL;
+    }
+    fclose(f);
 
-    // create OpenCL program from str
-    program = clCreateProgramWithSource(
-        ctx, 1, (const char **)&str, NULL, &internal_err
-    );
-    free(str);
+    return str;
+}
+
+static cl_program build_program_from_source(
+    const char  *src,
+    const char  *options,
+    cl_context   ctx,
+    cl_device_id dev,
+    cl_int      *err
+) {
+    cl_program program = NULL;
+    cl_int     internal_err;
+
+    // create OpenCL program from src
+    program = clCreateProgramWithSource(ctx, 1, &src, NULL, &internal_err);
     if (internal_err != CL_SUCCESS) {
         *err = internal_err;
         return NULL;
     }
 
-    internal_err = clBuildProgram(program, 1, &dev, "-Werror", NULL, NULL);
+    internal_err = clBuildProgram(program, 1, &dev, options, NULL, NULL);
     if (internal_err != CL_SUCCESS) {
         if (internal_err == CL_BUILD_PROGRAM_FAILURE) {
             print_build_log(program, dev);
         }
+        clReleaseProgram(program);
         *err = internal_err;
         return NULL;
     }
@@ -79,6 +91,334 @@ cl_program compile_program_from_file(
     return program;
 }
 
+cl_program compile_program_from_file(
+    const char *path, cl_context ctx, cl_device_id dev, cl_int *err
+) {
+    return compile_program_from_file_cached(
+        path, "-Werror", NULL, ctx, dev, err
+    );
+}
+
+// FNV-1a, only used to name cache files
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t fnv1a_64(uint64_t h, const void *data, size_t sz) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < sz; ++i) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    // separator, so that ("ab", "c") and ("a", "bc") hash differently
+    h ^= 0xff;
+    h *= FNV_PRIME;
+    return h;
+}
+
+#define DEVICE_INFO_STR_LEN 256
+
+static uint64_t hash_device_info(
+    uint64_t h, cl_device_id dev, cl_device_info param
+) {
+    char   info[DEVICE_INFO_STR_LEN] = {0};
+    size_t len                       = 0;
+    (void)clGetDeviceInfo(dev, param, sizeof(info) - 1, info, &len);
+    return fnv1a_64(h, info, strnlen(info, sizeof(info)));
+}
+
+/*
+ * Creates and builds program from a cached binary, NULL if there is no usable
+ * binary for the device.
+ */
+static cl_program load_program_binary(
+    const char  *cache_path,
+    const char  *options,
+    cl_context   ctx,
+    cl_device_id dev
+) {
+    cl_program program = NULL;
+    size_t     sz      = 0;
+    char      *bin     = NULL;
+    cl_int     binary_status;
+    cl_int     internal_err;
+
+    bin = read_whole_file(cache_path, &sz);
+    if (bin == NULL) {
+        return NULL;
+    }
+
+    program = clCreateProgramWithBinary(
+        ctx,
+        1,
+        &dev,
+        &sz,
+        (const unsigned char **)&bin,
+        &binary_status,
+        &internal_err
+    );
+    free(bin);
+    if (internal_err != CL_SUCCESS || binary_status != CL_SUCCESS) {
+        if (program != NULL) {
+            clReleaseProgram(program);
+        }
+        return NULL;
+    }
+
+    // still required for binaries, but only links the device code
+    internal_err = clBuildProgram(program, 1, &dev, options, NULL, NULL);
+    if (internal_err != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+/*
+ * Writes the device binary of program into cache_path. Failing to do so only
+ * means the next run compiles from source again, so errors are ignored.
+ */
+static void store_program_binary(cl_program program, const char *cache_path) {
+    size_t         sz = 0;
+    unsigned char *bin;
+    cl_int         internal_err;
+
+    // program is built for a single device
+    internal_err = clGetProgramInfo(
+        program, CL_PROGRAM_BINARY_SIZES, sizeof(sz), &sz, NULL
+    );
+    if (internal_err != CL_SUCCESS || sz == 0) {
+        return;
+    }
+
+    bin = (unsigned char *)malloc(sz);
+    if (bin == NULL) {
+        panic("failed to allocate buffer to hold program binary");
+    }
+
+    internal_err =
+        clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(bin), &bin, NULL);
+    if (internal_err != CL_SUCCESS) {
+        free(bin);
+        return;
+    }
+
+    // write to a temporary file and rename it, so that concurrently started
+    // processes never load a partially written binary
+    char tmp_path[PROGRAM_CACHE_PATH_LEN + 32];
+    snprintf(
+        tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_path, (long)getpid()
+    );
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        free(bin);
+        return;
+    }
+    const size_t written = fwrite(bin, 1, sz, f);
+    free(bin);
+
+    if (fclose(f) != 0 || written != sz || rename(tmp_path, cache_path) != 0) {
+        printf("WARNING: failed to write program binary %s\n", cache_path);
+        remove(tmp_path);
+    }
+}
+
+cl_program compile_program_from_file_cached(
+    const char  *path,
+    const char  *options,
+    const char  *cache_dir,
+    cl_context   ctx,
+    cl_device_id dev,
+    cl_int      *err
+) {
+    cl_program program = NULL;
+    size_t     sz      = 0;
+    char      *src     = NULL;
+    cl_int     internal_err;
+
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    src = read_whole_file(path, &sz);
+    if (src == NULL) {
+        panic("failed to open src file!");
+    }
+
+    if (cache_dir == NULL) {
+        program = build_program_from_source(src, options, ctx, dev, err);
+        free(src);
+        return program;
+    }
+
+    // anything that changes the resulting binary is part of the key
+    uint64_t key = FNV_OFFSET_BASIS;
+    key          = fnv1a_64(key, src, sz);
+    key          = fnv1a_64(key, options, options ? strlen(options) : 0);
+    key          = hash_device_info(key, dev, CL_DEVICE_NAME);
+    key          = hash_device_info(key, dev, CL_DEVICE_VERSION);
+    key          = hash_device_info(key, dev, CL_DRIVER_VERSION);
+
+    char cache_path[PROGRAM_CACHE_PATH_LEN];
+    snprintf(
+        cache_path,
+        sizeof(cache_path),
+        "%s/%016llx.bin",
+        cache_dir,
+        (unsigned long long)key
+    );
+
+    program = load_program_binary(cache_path, options, ctx, dev);
+    if (program != NULL) {
+        free(src);
+        *err = CL_SUCCESS;
+        return program;
+    }
+
+    program = build_program_from_source(src, options, ctx, dev, err);
+    free(src);
+    if (program == NULL) {
+        return NULL;
+    }
+
+    // fails harmlessly if the directory exists already
+    (void)mkdir(cache_dir, 0755);
+    store_program_binary(program, cache_path);
+
+    return program;
+}
+
+void program_variants_init(
+    program_variants_t *variants,
+    const char         *path,
+    const char         *cache_dir,
+    cl_context          ctx,
+    cl_device_id        dev
+) {
+    if (variants == NULL || path == NULL) {
+        panic("bad arguments to \"program_variants_init\"");
+    }
+
+    variants->path         = path;
+    variants->cache_dir    = cache_dir;
+    variants->ctx          = ctx;
+    variants->dev          = dev;
+    variants->num_variants = 0;
+}
+
+void format_zncc_program_options(
+    char                           *options,
+    const zncc_program_constants_t *constants,
+    const uint32_t                  W,
+    const int32_t                   direction
+) {
+    if (options == NULL || constants == NULL ||
+        constants->base_options == NULL) {
+        panic("bad arguments to \"format_zncc_program_options\"");
+    }
+
+    const size_t len = MAX_PROGRAM_OPTIONS_LEN;
+    int          n   = snprintf(
+        options,
+        len,
+        "%s -DWINDOW_WIDTH=%uu -DWINDOW_HEIGHT=%uu -DMAX_DISPARITY=%u"
+        " -DCROSSCHECK_THRESHOLD=%d",
+        constants->base_options,
+        constants->window_width,
+        constants->window_height,
+        constants->max_disparity,
+        constants->crosscheck_threshold
+    );
+    if (n >= 0 && (size_t)n < len && W != 0) {
+        n += snprintf(options + n, len - n, " -DIMAGE_WIDTH=%u", W);
+    }
+    if (n >= 0 && (size_t)n < len && direction != 0) {
+        n += snprintf(options + n, len - n, " -DDIRECTION=%d", direction);
+    }
+    if (n < 0 || (size_t)n >= len) {
+        panic("zncc program options too long");
+    }
+}
+
+cl_kernel build_zncc_kernel(
+    program_variants_t             *variants,
+    const char                     *name,
+    const zncc_program_constants_t *constants,
+    const uint32_t                  W,
+    const int32_t                   direction,
+    cl_int                         *err
+) {
+    char options[MAX_PROGRAM_OPTIONS_LEN];
+    format_zncc_program_options(options, constants, W, direction);
+
+    cl_program program = get_program_variant(variants, options, err);
+    if (program == NULL) {
+        return NULL;
+    }
+
+    return build_kernel(name, program, err);
+}
+
+cl_program get_program_variant(
+    program_variants_t *variants, const char *options, cl_int *err
+) {
+    cl_program program = NULL;
+    cl_int     internal_err;
+
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    if (variants == NULL || options == NULL) {
+        panic("bad arguments to \"get_program_variant\"");
+    }
+
+    for (cl_uint i = 0; i < variants->num_variants; ++i) {
+        if (strcmp(variants->variants[i].options, options) == 0) {
+            *err = CL_SUCCESS;
+            return variants->variants[i].program;
+        }
+    }
+
+    if (variants->num_variants >= MAX_PROGRAM_VARIANTS) {
+        panic("too many program variants");
+    }
+    if (strlen(options) >= MAX_PROGRAM_OPTIONS_LEN) {
+        panic("program build options too long");
+    }
+
+    program = compile_program_from_file_cached(
+        variants->path,
+        options,
+        variants->cache_dir,
+        variants->ctx,
+        variants->dev,
+        err
+    );
+    if (program == NULL) {
+        return NULL;
+    }
+
+    program_variant_t *v = &variants->variants[variants->num_variants];
+    strcpy(v->options, options);
+    v->program = program;
+    variants->num_variants += 1;
+
+    return program;
+}
+
+void program_variants_release(program_variants_t *variants) {
+    if (variants == NULL) {
+        return;
+    }
+
+    for (cl_uint i = 0; i < variants->num_variants; ++i) {
+        clReleaseProgram(variants->variants[i].program);
+    }
+    variants->num_variants = 0;
+}
+
 // 64 kB buffer should be plenty, right?
 #define BUILD_LOG_SIZE (64 * 1024)
 
@@ -159,6 +499,59 @@ cl_device_id get_device(cl_int *err) {
     return device;
 }
 
+cl_uint get_all_devices(
+    cl_device_id *devices, const cl_uint max_devices, cl_int *err
+) {
+    cl_uint        num_platforms = 0;
+    cl_uint        num_devices   = 0;
+    cl_int         internal_err;
+    cl_platform_id platforms[MAX_NUM_CL_PLATFORMS];
+
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    if (devices == NULL) {
+        panic("bad arguments to \"get_all_devices\"");
+    }
+
+    internal_err =
+        clGetPlatformIDs(MAX_NUM_CL_PLATFORMS, platforms, &num_platforms);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return 0;
+    }
+    if (num_platforms > MAX_NUM_CL_PLATFORMS) {
+        num_platforms = MAX_NUM_CL_PLATFORMS;
+    }
+
+    for (cl_uint p = 0; p < num_platforms && num_devices < max_devices; ++p) {
+        cl_uint n = 0;
+
+        internal_err = clGetDeviceIDs(
+            platforms[p],
+            CL_DEVICE_TYPE_ALL,
+            max_devices - num_devices,
+            &devices[num_devices],
+            &n
+        );
+        if (internal_err == CL_DEVICE_NOT_FOUND) {
+            continue;
+        }
+        if (internal_err != CL_SUCCESS) {
+            *err = internal_err;
+            return 0;
+        }
+        // n is the number of devices available, not the number returned
+        num_devices += (n < max_devices - num_devices)
+                           ? n
+                           : (max_devices - num_devices);
+    }
+
+    *err = CL_SUCCESS;
+    return num_devices;
+}
+
 cl_context create_context(cl_device_id device, cl_int *err) {
     cl_int     internal_err;
     cl_context ctx = NULL;
@@ -199,6 +592,47 @@ cl_command_queue create_queue(
     return queue;
 }
 
+cl_command_queue create_out_of_order_queue(
+    cl_context ctx, cl_device_id device, cl_int *err
+) {
+    cl_int                      internal_err;
+    cl_command_queue            queue     = NULL;
+    cl_command_queue_properties supported = 0;
+    cl_command_queue_properties props     = CL_QUEUE_PROFILING_ENABLE;
+
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    internal_err = clGetDeviceInfo(
+        device,
+        CL_DEVICE_QUEUE_PROPERTIES,
+        sizeof(supported),
+        &supported,
+        NULL
+    );
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return NULL;
+    }
+
+    // without support the queue is in-order, which is correct but slower
+    if ((supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0) {
+        props |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    } else {
+        printf("device doesn't support out-of-order queues, using in-order\n");
+    }
+
+    queue = clCreateCommandQueue(ctx, device, props, &internal_err);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return NULL;
+    }
+
+    *err = CL_SUCCESS;
+    return queue;
+}
+
 uint64_t get_exec_ns(cl_event evt) {
     if (evt == NULL) {
         return 0;
@@ -218,13 +652,170 @@ uint64_t get_exec_ns(cl_event evt) {
     return (uint64_t)(evt_end - evt_start);
 }
 
+uint64_t get_span_ns(const cl_event *evts, cl_uint num_evts) {
+    if (evts == NULL) {
+        return 0;
+    }
+
+    cl_ulong start = ~(cl_ulong)0;
+    cl_ulong end   = 0;
+
+    for (cl_uint i = 0; i < num_evts; ++i) {
+        if (evts[i] == NULL) {
+            continue;
+        }
+
+        cl_ulong evt_start = 0;
+        cl_ulong evt_end   = 0;
+
+        (void)clGetEventProfilingInfo(
+            evts[i],
+            CL_PROFILING_COMMAND_START,
+            sizeof(evt_start),
+            &evt_start,
+            NULL
+        );
+        (void)clGetEventProfilingInfo(
+            evts[i], CL_PROFILING_COMMAND_END, sizeof(evt_end), &evt_end, NULL
+        );
+
+        start = (evt_start < start) ? evt_start : start;
+        end   = (evt_end > end) ? evt_end : end;
+    }
+
+    return (end > start) ? (uint64_t)(end - start) : 0;
+}
+
+void get_device_identity(cl_device_id dev, char *buf, size_t len) {
+    if (buf == NULL || len == 0) {
+        panic("bad arguments to \"get_device_identity\"");
+    }
+
+    char    name[DEVICE_INFO_STR_LEN]   = {0};
+    char    driver[DEVICE_INFO_STR_LEN] = {0};
+    cl_uint compute_units               = 0;
+
+    (void)clGetDeviceInfo(dev, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+    (void)clGetDeviceInfo(
+        dev, CL_DRIVER_VERSION, sizeof(driver) - 1, driver, NULL
+    );
+    (void)clGetDeviceInfo(
+        dev,
+        CL_DEVICE_MAX_COMPUTE_UNITS,
+        sizeof(compute_units),
+        &compute_units,
+        NULL
+    );
+
+    snprintf(buf, len, "%s/%s/%ucu", name, driver, compute_units);
+}
+
+void get_kernel_build_options(
+    cl_kernel kernel, cl_device_id dev, char *buf, size_t len
+) {
+    if (buf == NULL || len == 0) {
+        panic("bad arguments to \"get_kernel_build_options\"");
+    }
+
+    memset(buf, 0, len);
+
+    cl_program program = NULL;
+    if (clGetKernelInfo(
+            kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, NULL
+        ) != CL_SUCCESS) {
+        return;
+    }
+    (void)clGetProgramBuildInfo(
+        program, dev, CL_PROGRAM_BUILD_OPTIONS, len - 1, buf, NULL
+    );
+}
+
+uint32_t tune_work_size(
+    cl_command_queue   queue,
+    cl_kernel          kernel,
+    const int32_t      n_arg,
+    const work_size_t *candidates,
+    const uint32_t     num_candidates,
+    const cl_uint      num_wait_events,
+    const cl_event    *wait_events,
+    cl_int            *err
+) {
+    cl_int internal_err;
+
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    if (candidates == NULL || num_candidates == 0) {
+        panic("bad arguments to \"tune_work_size\"");
+    }
+
+    uint32_t best    = 0;
+    uint64_t best_ns = UINT64_MAX;
+
+    for (uint32_t i = 0; i < num_candidates; ++i) {
+        const work_size_t *ws = &candidates[i];
+        cl_event           evt = NULL;
+
+        if (n_arg >= 0) {
+            const cl_uint n = (cl_uint)ws->global[0];
+            internal_err    = clSetKernelArg(kernel, n_arg, sizeof(n), &n);
+            if (internal_err != CL_SUCCESS) {
+                *err = internal_err;
+                return 0;
+            }
+        }
+
+        // e.g. a work group larger than the kernel allows, try the next one
+        internal_err = clEnqueueNDRangeKernel(
+            queue,
+            kernel,
+            ws->work_dim,
+            NULL,
+            ws->global,
+            (ws->local[0] == 0) ? NULL : ws->local,
+            num_wait_events,
+            wait_events,
+            &evt
+        );
+        if (internal_err != CL_SUCCESS) {
+            continue;
+        }
+
+        internal_err = clWaitForEvents(1, &evt);
+        if (internal_err == CL_SUCCESS) {
+            // execution only, the first launch also waits for wait_events
+            cl_ulong start = 0;
+            cl_ulong end   = 0;
+            (void)clGetEventProfilingInfo(
+                evt, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL
+            );
+            (void)clGetEventProfilingInfo(
+                evt, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL
+            );
+
+            if ((uint64_t)(end - start) < best_ns) {
+                best_ns = (uint64_t)(end - start);
+                best    = i;
+            }
+        }
+        clReleaseEvent(evt);
+    }
+
+    if (best_ns == UINT64_MAX) {
+        *err = CL_INVALID_WORK_GROUP_SIZE;
+        return 0;
+    }
+
+    *err = CL_SUCCESS;
+    return best;
+}
+
 cl_mem allocate_2D_image(
     cl_context             ctx,
-    cl_command_queue       queue,
     const cl_image_format *format,
     size_t                 W,
     size_t                 H,
-    size_t                 elem_sz,
     void                  *data,
     cl_int                *err
 ) {
@@ -262,28 +853,94 @@ cl_mem allocate_2D_image(
         return NULL;
     }
 
-    if (data) {
-        // copy data to device side
-        size_t origin[3] = {0, 0, 0};
-        size_t region[3] = {W, H, 1};
-        internal_err     = clEnqueueWriteImage(
-            queue, img, CL_TRUE, origin, region, 0, 0, data, 0, NULL, NULL
-        );
+    // no write needed, with CL_MEM_USE_HOST_PTR the runtime reads the pixels
+    // from data itself, or uses it in place if the device shares host memory
 
-        if (internal_err != CL_SUCCESS) {
-            *err = internal_err;
-            clReleaseMemObject(img);
-            return NULL;
-        }
+    *err = CL_SUCCESS;
+
+    return img;
+}
+
+void *allocate_host_memory(size_t sz) {
+    // aligned_alloc wants a multiple of the alignment
+    const size_t padded_sz =
+        ((sz + HOST_MEMORY_ALIGNMENT - 1) / HOST_MEMORY_ALIGNMENT) *
+        HOST_MEMORY_ALIGNMENT;
+
+    void *buf = aligned_alloc(HOST_MEMORY_ALIGNMENT, padded_sz);
+    if (buf == NULL) {
+        panic("failed to allocate host memory");
+    }
+
+    return buf;
+}
+
+void *map_device_memory(
+    cl_command_queue queue,
+    cl_mem           mem,
+    cl_map_flags     flags,
+    size_t           sz,
+    cl_uint          num_wait_events,
+    const cl_event  *wait_events,
+    cl_int          *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    void *ptr = clEnqueueMapBuffer(
+        queue,
+        mem,
+        CL_TRUE,
+        flags,
+        0,
+        sz,
+        num_wait_events,
+        wait_events,
+        NULL,
+        &internal_err
+    );
+
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return NULL;
     }
 
     *err = CL_SUCCESS;
+    return ptr;
+}
 
-    return img;
+void unmap_device_memory(
+    cl_command_queue queue, cl_mem mem, void *ptr, cl_int *err
+) {
+    cl_int internal_err;
+    if (err == NULL) {
+        err = &internal_err;
+    }
+
+    internal_err = clEnqueueUnmapMemObject(queue, mem, ptr, 0, NULL, NULL);
+    if (internal_err != CL_SUCCESS) {
+        *err = internal_err;
+        return;
+    }
+
+    *err = CL_SUCCESS;
 }
 
 void *read_device_memory(
     cl_command_queue queue, cl_mem mem, size_t sz, cl_int *err
+) {
+    return read_device_memory_after(queue, mem, sz, 0, NULL, err);
+}
+
+void *read_device_memory_after(
+    cl_command_queue queue,
+    cl_mem           mem,
+    size_t           sz,
+    cl_uint          num_wait_events,
+    const cl_event  *wait_events,
+    cl_int          *err
 ) {
     uint8_t *buf = malloc(sz);
     if (buf == NULL) {
@@ -295,8 +952,9 @@ void *read_device_memory(
         err = &internal_err;
     }
 
-    internal_err =
-        clEnqueueReadBuffer(queue, mem, CL_TRUE, 0, sz, buf, 0, NULL, NULL);
+    internal_err = clEnqueueReadBuffer(
+        queue, mem, CL_TRUE, 0, sz, buf, num_wait_events, wait_events, NULL
+    );
 
     if (internal_err != CL_SUCCESS) {
         *err = internal_err;
@@ -505,5 +1163,20 @@ void print_device_info(cl_device_id dev) {
             printf("Device does not support images\n");
         }
     }
+    {
+        cl_bool unified_memory = CL_FALSE;
+        clGetDeviceInfo(
+            dev,
+            CL_DEVICE_HOST_UNIFIED_MEMORY,
+            sizeof(cl_bool),
+            &unified_memory,
+            NULL
+        );
+        if (unified_memory) {
+            printf("Device shares memory with the host\n");
+        } else {
+            printf("Device has its own memory\n");
+        }
+    }
     printf("\nend of device info dump\n\n");
 }
@@ -151,17 +151,16 @@ void scale_down_image(rgba_img_t* in, rgba_img_t* out) {
     const uint32_t scale_w = in->width / out->width;
     const uint32_t scale_h = in->height / out->height;
     const uint32_t wi      = in->width;
-    const uint32_t hi      = in->height;
     const uint32_t wo      = out->width;
     const uint32_t ho      = out->height;
 
     // tmp variables
     uint32_t xo = 0, xi = 0, yo = 0, yi = 0;
 
-    for (yo = 0; (yo * scale_h) < hi; ++yo) {
+    for (yo = 0; yo < ho; ++yo) {
         yi = yo * scale_h;
 
-        for (xo = 0; (xo * scale_w) < wi; ++xo) {
+        for (xo = 0; xo < wo; ++xo) {
             xi = xo * scale_w;
 
             // cast to uint32_t to copy RGBA in one go
@@ -171,6 +170,26 @@ void scale_down_image(rgba_img_t* in, rgba_img_t* out) {
     }
 }
 
+static gray_t rgba_to_gray_double(rgba_t rgba) {
+    const double g = (SCALE_R * (double)rgba.R) + (SCALE_G * (double)rgba.G) +
+        (SCALE_B * (double)rgba.B);
+    return (gray_t)(g);
+}
+
+gray_t rgba_to_gray(rgba_t rgba) {
+    const uint32_t s = (GRAY_FX_R * (uint32_t)rgba.R) +
+        (GRAY_FX_G * (uint32_t)rgba.G) + (GRAY_FX_B * (uint32_t)rgba.B);
+    const uint32_t q = s / GRAY_FX_ONE;
+
+    // the double sum of an exact multiple can round to just below it, which
+    // truncates to one less, so those few colors use the double formula
+    if (q * GRAY_FX_ONE == s) {
+        return rgba_to_gray_double(rgba);
+    }
+
+    return (gray_t)q;
+}
+
 void convert_to_grayscale(rgba_img_t* in, gray_img_t* out) {
     if (in == NULL || out == NULL || in->height == 0 || in->width == 0) {
         panic("bad arguments to \"convert_to_grayscale\"");
@@ -186,17 +205,60 @@ void convert_to_grayscale(rgba_img_t* in, gray_img_t* out) {
         panic("failed to malloc");
     }
 
-    // tmp
-    rgba_t rgba;
-    double g;
-
     for (uint32_t y = 0; y < h; ++y) {
         for (uint32_t x = 0; x < w; ++x) {
-            rgba = ((rgba_t*)(in->img))[(y * w) + x];
-            g    = (SCALE_R * (double)rgba.R) + (SCALE_G * (double)rgba.G) +
-                (SCALE_B * (double)rgba.B);
+            out->img[(y * w) + x] = rgba_to_gray(in->img[(y * w) + x]);
+        }
+    }
+}
+
+void downscale_to_grayscale(
+    const rgba_img_t* in,
+    void*             out,
+    palette_e         palette,
+    uint32_t          W,
+    uint32_t          H,
+    uint32_t          begin,
+    uint32_t          end
+) {
+    if (in == NULL || out == NULL || W == 0 || H == 0 || in->width < W ||
+        in->height < H || begin > end || end > H) {
+        panic("bad arguments to \"downscale_to_grayscale\"");
+    }
+    if (palette != GS && palette != GS_FLOAT && palette != GS_DOUBLE) {
+        panic("unsupported palette for \"downscale_to_grayscale\"");
+    }
 
-            out->img[(y * w) + x] = (gray_t)(g);
+    // sampling every nth pixel like scale_down_image
+    const uint32_t scale_w = in->width / W;
+    const uint32_t scale_h = in->height / H;
+    const uint32_t wi      = in->width;
+
+    for (uint32_t y = begin; y < end; ++y) {
+        const rgba_t* row_in = &in->img[(y * scale_h) * wi];
+
+        switch (palette) {
+            case GS: {
+                gray_t* row_out = &((gray_t*)out)[y * W];
+                for (uint32_t x = 0; x < W; ++x) {
+                    row_out[x] = rgba_to_gray(row_in[x * scale_w]);
+                }
+                break;
+            }
+            case GS_FLOAT: {
+                float* row_out = &((float*)out)[y * W];
+                for (uint32_t x = 0; x < W; ++x) {
+                    row_out[x] = (float)rgba_to_gray(row_in[x * scale_w]);
+                }
+                break;
+            }
+            default: {
+                double* row_out = &((double*)out)[y * W];
+                for (uint32_t x = 0; x < W; ++x) {
+                    row_out[x] = (double)rgba_to_gray(row_in[x * scale_w]);
+                }
+                break;
+            }
         }
     }
 }
@@ -206,8 +268,29 @@ void apply_filter(gray_img_t* in, gray_img_t* out) {
         panic("bad arguments to \"apply_filter\"");
     }
 
-    const uint32_t h = in->height;
-    const uint32_t w = in->width;
+    apply_box_filter(in, out, SMOOTHING_KERNEL_RADIUS);
+}
+
+static inline uint32_t clamp_coord(const int32_t i, const uint32_t n) {
+    if (i < 0) {
+        return 0;
+    }
+    if ((uint32_t)i >= n) {
+        return n - 1;
+    }
+    return (uint32_t)i;
+}
+
+void apply_box_filter(gray_img_t* in, gray_img_t* out, uint32_t radius) {
+    if (in == NULL || out == NULL || in->img == NULL || in->height == 0 ||
+        in->width == 0 || radius > BOX_FILTER_MAX_RADIUS) {
+        panic("bad arguments to \"apply_box_filter\"");
+    }
+
+    const uint32_t h    = in->height;
+    const uint32_t w    = in->width;
+    const int32_t  r    = (int32_t)radius;
+    const uint32_t area = ((2 * radius) + 1) * ((2 * radius) + 1);
 
     out->height = h;
     out->width  = w;
@@ -216,45 +299,116 @@ void apply_filter(gray_img_t* in, gray_img_t* out) {
         panic("failed to malloc");
     }
 
-    // variables
-    uint32_t y, x;
-    int32_t  dy, dx;
-    uint32_t py, px;
-    // use larger intermediate value to prevent clipping
-    uint32_t v;
+    // sum of the 2 * radius + 1 rows around the current row, per column
+    uint32_t* col_sums = calloc(w, sizeof(uint32_t));
+    if (col_sums == NULL) {
+        panic("failed to malloc");
+    }
+
+    for (int32_t dy = -r; dy <= r; ++dy) {
+        const gray_t* row = &in->img[clamp_coord(dy, h) * w];
+        for (uint32_t x = 0; x < w; ++x) {
+            col_sums[x] += row[x];
+        }
+    }
+
+    for (uint32_t y = 0; y < h; ++y) {
+        if (y > 0) {
+            // slide the column window down by one row
+            const gray_t* enter = &in->img[clamp_coord((int32_t)y + r, h) * w];
+            const gray_t* leave =
+                &in->img[clamp_coord((int32_t)y - r - 1, h) * w];
+            for (uint32_t x = 0; x < w; ++x) {
+                col_sums[x] = col_sums[x] + enter[x] - leave[x];
+            }
+        }
 
-    // clang-format off
-    for (y = 0; y < h; ++y) {
-        for (x = 0; x < w; ++x) {
-            v = 0;
+        // window sum of pixel 0, then slide it right along the row
+        uint32_t v = 0;
+        for (int32_t dx = -r; dx <= r; ++dx) {
+            v += col_sums[clamp_coord(dx, w)];
+        }
 
-            for (dy = -SMOOTHING_KERNEL_RADIUS; dy <= SMOOTHING_KERNEL_RADIUS; ++dy) {
-                py = y + dy;
+        gray_t* row_out = &out->img[y * w];
+        for (uint32_t x = 0; x < w; ++x) {
+            row_out[x] = (gray_t)(v / area);
+            v += col_sums[clamp_coord((int32_t)x + r + 1, w)];
+            v -= col_sums[clamp_coord((int32_t)x - r, w)];
+        }
+    }
 
-                if (py < 0) {
-                    py = 0;
-                } else if (py >= h) {
-                    py = h - 1;
-                };
+    free(col_sums);
+}
 
-                for (dx = -SMOOTHING_KERNEL_RADIUS; dx <= SMOOTHING_KERNEL_RADIUS; ++dx) {
-                    px = x + dx;
+void apply_filter_padded(const padded_gray_img_t* in, gray_img_t* out) {
+    if (in == NULL || out == NULL) {
+        panic("bad arguments to \"apply_filter_padded\"");
+    }
 
-                    if (px < 0) {
-                        px = 0;
-                    } else if (px >= w) {
-                        px = w - 1;
-                    }
+    apply_box_filter_padded(in, out, SMOOTHING_KERNEL_RADIUS);
+}
 
-                    v += in->img[(py * w) + px];
-                }
+void apply_box_filter_padded(
+    const padded_gray_img_t* in, gray_img_t* out, uint32_t radius
+) {
+    if (in == NULL || out == NULL || in->img == NULL ||
+        radius > BOX_FILTER_MAX_RADIUS || in->apron <= radius) {
+        panic("bad arguments to \"apply_box_filter_padded\"");
+    }
+
+    const uint32_t h      = in->height;
+    const uint32_t w      = in->width;
+    const int32_t  r      = (int32_t)radius;
+    const int32_t  stride = (int32_t)in->stride;
+    const uint32_t area   = ((2 * radius) + 1) * ((2 * radius) + 1);
+    // columns -r..w+r, everything the sliding windows touch
+    const uint32_t n = w + (2 * radius) + 1;
+
+    out->height = h;
+    out->width  = w;
+    out->img    = malloc(h * w * sizeof(gray_t));
+    if (out->img == NULL) {
+        panic("failed to malloc");
+    }
+
+    // col_sums[i] is the sum of the rows around the current row in column
+    // i - r, like in apply_box_filter
+    uint32_t* col_sums = calloc(n, sizeof(uint32_t));
+    if (col_sums == NULL) {
+        panic("failed to malloc");
+    }
+
+    for (int32_t dy = -r; dy <= r; ++dy) {
+        const gray_t* row = &in->img[(dy * stride) - r];
+        for (uint32_t i = 0; i < n; ++i) {
+            col_sums[i] += row[i];
+        }
+    }
+
+    for (uint32_t y = 0; y < h; ++y) {
+        if (y > 0) {
+            const gray_t* enter = &in->img[(((int32_t)y + r) * stride) - r];
+            const gray_t* leave =
+                &in->img[(((int32_t)y - r - 1) * stride) - r];
+            for (uint32_t i = 0; i < n; ++i) {
+                col_sums[i] = col_sums[i] + enter[i] - leave[i];
             }
+        }
 
-            out->img[(y * w) + x] =
-                (gray_t)(v / (SMOOTHING_KERNEL_ORDER * SMOOTHING_KERNEL_ORDER));
+        uint32_t v = 0;
+        for (uint32_t i = 0; i <= 2 * radius; ++i) {
+            v += col_sums[i];
+        }
+
+        gray_t* row_out = &out->img[y * w];
+        for (uint32_t x = 0; x < w; ++x) {
+            row_out[x] = (gray_t)(v / area);
+            v += col_sums[x + (2 * radius) + 1];
+            v -= col_sums[x];
         }
     }
-    // clang-format on
+
+    free(col_sums);
 }
 
 void convert_to_double(gray_img_t* in, double_img_t* out) {
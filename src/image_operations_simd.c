@@ -0,0 +1,467 @@
+#include "image_operations_simd.h"
+#include "image_operations.h"
+#include "panic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// v / 25 as (v * FILTER_DIV_MUL) >> (16 + FILTER_DIV_SHIFT), exact up to the
+// largest sum 25 * 255
+#if SMOOTHING_KERNEL_ORDER != 5
+#error "FILTER_DIV_MUL and FILTER_DIV_SHIFT are for a 5x5 kernel"
+#endif
+#define FILTER_DIV_MUL 5243
+#define FILTER_DIV_SHIFT 1
+
+// -1 until first use, atomic as the `_parallel` functions read it on workers
+static int simd_level = -1;
+
+image_simd_level_e image_simd_detect(void) {
+#ifdef IMAGE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return IMAGE_SIMD_AVX2;
+    }
+#endif
+    return IMAGE_SIMD_SCALAR;
+}
+
+image_simd_level_e image_simd_get_level(void) {
+    int level = __atomic_load_n(&simd_level, __ATOMIC_RELAXED);
+    if (level < 0) {
+        // like zncc_simd_get_level, a concurrent set wins over detection
+        int unset = -1;
+        level     = (int)image_simd_detect();
+        if (!__atomic_compare_exchange_n(
+                &simd_level,
+                &unset,
+                level,
+                false,
+                __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED
+            )) {
+            level = unset;
+        }
+    }
+    return (image_simd_level_e)level;
+}
+
+void image_simd_set_level(image_simd_level_e level) {
+    const image_simd_level_e supported = image_simd_detect();
+    __atomic_store_n(
+        &simd_level,
+        (int)((level > supported) ? supported : level),
+        __ATOMIC_RELAXED
+    );
+}
+
+/* Downscaling */
+
+static void scale_down_row_scalar(
+    const rgba_t *in, rgba_t *out, const uint32_t W, const uint32_t scale_w
+) {
+    for (uint32_t x = 0; x < W; ++x) {
+        out[x] = in[x * scale_w];
+    }
+}
+
+#ifdef IMAGE_SIMD_X86
+__attribute__((target("avx2"))) static void scale_down_row_avx2(
+    const rgba_t *in, rgba_t *out, const uint32_t W, const uint32_t scale_w
+) {
+    // pixels are 32 bits, so every nth one can be gathered as an int
+    const __m256i idx = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+        _mm256_set1_epi32((int)scale_w)
+    );
+
+    uint32_t x = 0;
+    for (; x + 8 <= W; x += 8) {
+        const __m256i px =
+            _mm256_i32gather_epi32((const int *)&in[x * scale_w], idx, 4);
+        _mm256_storeu_si256((__m256i *)&out[x], px);
+    }
+    scale_down_row_scalar(&in[x * scale_w], &out[x], W - x, scale_w);
+}
+#endif
+
+void scale_down_image_rows(
+    const rgba_img_t *in, rgba_img_t *out, uint32_t begin, uint32_t end
+) {
+    if (in == NULL || out == NULL || out->img == NULL || out->width == 0 ||
+        out->height == 0 || out->width > in->width ||
+        out->height > in->height || begin > end || end > out->height) {
+        panic("bad arguments to \"scale_down_image_rows\"");
+    }
+
+    const uint32_t scale_w = in->width / out->width;
+    const uint32_t scale_h = in->height / out->height;
+    const uint32_t wi      = in->width;
+    const uint32_t wo      = out->width;
+
+    const image_simd_level_e level = image_simd_get_level();
+
+    for (uint32_t y = begin; y < end; ++y) {
+        const rgba_t *row_in  = &in->img[(y * scale_h) * wi];
+        rgba_t       *row_out = &out->img[y * wo];
+
+        if (scale_w == 1) {
+            memcpy(row_out, row_in, wo * sizeof(rgba_t));
+            continue;
+        }
+
+        switch (level) {
+#ifdef IMAGE_SIMD_X86
+            case IMAGE_SIMD_AVX2:
+                scale_down_row_avx2(row_in, row_out, wo, scale_w);
+                break;
+#endif
+            default:
+                scale_down_row_scalar(row_in, row_out, wo, scale_w);
+                break;
+        }
+    }
+}
+
+/* Grayscaling */
+
+static void grayscale_scalar(const rgba_t *in, gray_t *out, const uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        out[i] = rgba_to_gray(in[i]);
+    }
+}
+
+#ifdef IMAGE_SIMD_X86
+__attribute__((target("avx2"))) static void grayscale_avx2(
+    const rgba_t *in, gray_t *out, const uint32_t n
+) {
+    // pixels are R | G << 8 | B << 16 | A << 24, masking every other byte
+    // gives 16-bit (R, B) and (G, A) pairs for pmaddwd
+    const __m256i mask_16 = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i w_rb    = _mm256_set1_epi32((GRAY_FX_B << 16) | GRAY_FX_R);
+    const __m256i w_ga    = _mm256_set1_epi32(GRAY_FX_G);
+    const __m256i one     = _mm256_set1_epi32(GRAY_FX_ONE);
+    const __m256i one_m1  = _mm256_set1_epi32(GRAY_FX_ONE - 1);
+    const __m256  inv_one = _mm256_set1_ps(1.0f / (float)GRAY_FX_ONE);
+    const __m256i zero    = _mm256_setzero_si256();
+    // first 32 bits of each 128-bit lane after packing to bytes
+    const __m256i gather_lo = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i px = _mm256_loadu_si256((const __m256i *)&in[i]);
+        const __m256i rb = _mm256_and_si256(px, mask_16);
+        const __m256i ga = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask_16);
+        const __m256i s  = _mm256_add_epi32(
+            _mm256_madd_epi16(rb, w_rb), _mm256_madd_epi16(ga, w_ga)
+        );
+
+        // s / GRAY_FX_ONE, s < 2^22 is exact in float and the estimate is off
+        // by at most one, which the remainder corrects
+        __m256i q = _mm256_cvttps_epi32(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(s), inv_one)
+        );
+        __m256i r = _mm256_sub_epi32(s, _mm256_mullo_epi32(q, one));
+
+        const __m256i below = _mm256_cmpgt_epi32(zero, r);
+        q = _mm256_add_epi32(q, below);
+        r = _mm256_add_epi32(r, _mm256_and_si256(below, one));
+
+        const __m256i above = _mm256_cmpgt_epi32(r, one_m1);
+        q = _mm256_sub_epi32(q, above);
+        r = _mm256_sub_epi32(r, _mm256_and_si256(above, one));
+
+        __m256i g = _mm256_packus_epi32(q, q);
+        g         = _mm256_packus_epi16(g, g);
+        g         = _mm256_permutevar8x32_epi32(g, gather_lo);
+        _mm_storel_epi64((__m128i *)&out[i], _mm256_castsi256_si128(g));
+
+        // exact multiples are rare, redo them like `rgba_to_gray`
+        uint32_t ties = (uint32_t)_mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(r, zero))
+        );
+        while (ties != 0) {
+            const uint32_t k = (uint32_t)__builtin_ctz(ties);
+            out[i + k]       = rgba_to_gray(in[i + k]);
+            ties &= ties - 1;
+        }
+    }
+    grayscale_scalar(&in[i], &out[i], n - i);
+}
+#endif
+
+void convert_to_grayscale_rows(
+    const rgba_img_t *in, gray_img_t *out, uint32_t begin, uint32_t end
+) {
+    if (in == NULL || out == NULL || out->img == NULL || begin > end ||
+        end > in->height) {
+        panic("bad arguments to \"convert_to_grayscale_rows\"");
+    }
+
+    // rows are contiguous in both images
+    const rgba_t  *px_in  = &in->img[begin * in->width];
+    gray_t        *px_out = &out->img[begin * in->width];
+    const uint32_t n      = (end - begin) * in->width;
+
+    switch (image_simd_get_level()) {
+#ifdef IMAGE_SIMD_X86
+        case IMAGE_SIMD_AVX2:
+            grayscale_avx2(px_in, px_out, n);
+            break;
+#endif
+        default:
+            grayscale_scalar(px_in, px_out, n);
+            break;
+    }
+}
+
+/* Filtering */
+
+// clamps to the first or last row or column like apply_filter
+static inline uint32_t filter_clamp(const int32_t i, const uint32_t n) {
+    if (i < 0) {
+        return 0;
+    }
+    return ((uint32_t)i >= n) ? (n - 1) : (uint32_t)i;
+}
+
+static inline gray_t filter_divide(const uint32_t v) {
+    return (gray_t)(v / (SMOOTHING_KERNEL_ORDER * SMOOTHING_KERNEL_ORDER));
+}
+
+// pixel x of the row whose neighbourhood rows are in `rows`, clamped
+static gray_t filter_border_pixel(
+    const gray_t *const *rows, const uint32_t x, const uint32_t W
+) {
+    uint32_t v = 0;
+    for (uint32_t k = 0; k < SMOOTHING_KERNEL_ORDER; ++k) {
+        for (int32_t dx = -SMOOTHING_KERNEL_RADIUS;
+             dx <= SMOOTHING_KERNEL_RADIUS;
+             ++dx) {
+            v += rows[k][filter_clamp((int32_t)x + dx, W)];
+        }
+    }
+    return filter_divide(v);
+}
+
+// pixels begin..end-1 of a row, all at least the radius away from the
+// left and right edges
+static void filter_interior_scalar(
+    const gray_t *const *rows,
+    gray_t              *out,
+    const uint32_t       begin,
+    const uint32_t       end
+) {
+    for (uint32_t x = begin; x < end; ++x) {
+        uint32_t v = 0;
+        for (uint32_t k = 0; k < SMOOTHING_KERNEL_ORDER; ++k) {
+            const gray_t *src = &rows[k][x - SMOOTHING_KERNEL_RADIUS];
+            for (uint32_t d = 0; d < SMOOTHING_KERNEL_ORDER; ++d) {
+                v += src[d];
+            }
+        }
+        out[x] = filter_divide(v);
+    }
+}
+
+#ifdef IMAGE_SIMD_X86
+// like filter_interior_scalar, 16 pixels at a time, returns first pixel not
+// processed
+__attribute__((target("avx2"))) static uint32_t filter_interior_avx2(
+    const gray_t *const *rows,
+    gray_t              *out,
+    const uint32_t       begin,
+    const uint32_t       end
+) {
+    const __m256i div_mul = _mm256_set1_epi16(FILTER_DIV_MUL);
+
+    uint32_t x = begin;
+    for (; x + 16 <= end; x += 16) {
+        // at most 25 * 255, fits in 16 bits
+        __m256i v = _mm256_setzero_si256();
+        for (uint32_t k = 0; k < SMOOTHING_KERNEL_ORDER; ++k) {
+            const gray_t *src = &rows[k][x - SMOOTHING_KERNEL_RADIUS];
+            for (uint32_t d = 0; d < SMOOTHING_KERNEL_ORDER; ++d) {
+                v = _mm256_add_epi16(
+                    v,
+                    _mm256_cvtepu8_epi16(
+                        _mm_loadu_si128((const __m128i *)&src[d])
+                    )
+                );
+            }
+        }
+
+        v = _mm256_srli_epi16(_mm256_mulhi_epu16(v, div_mul), FILTER_DIV_SHIFT);
+        v = _mm256_packus_epi16(v, v);
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)&out[x], _mm256_castsi256_si128(v));
+    }
+
+    return x;
+}
+#endif
+
+void apply_filter_rows(
+    const gray_img_t *in, gray_img_t *out, uint32_t begin, uint32_t end
+) {
+    if (in == NULL || out == NULL || out->img == NULL || in->img == out->img ||
+        begin > end || end > in->height) {
+        panic("bad arguments to \"apply_filter_rows\"");
+    }
+
+    const uint32_t W = in->width;
+    const uint32_t H = in->height;
+    const uint32_t R = SMOOTHING_KERNEL_RADIUS;
+
+    // columns x_lo..x_hi-1 need no clamping
+    const uint32_t x_lo = (W < R) ? W : R;
+    const uint32_t x_hi = (W > 2 * R) ? (W - R) : x_lo;
+
+    const image_simd_level_e level = image_simd_get_level();
+
+    const gray_t *rows[SMOOTHING_KERNEL_ORDER];
+
+    for (uint32_t y = begin; y < end; ++y) {
+        for (uint32_t k = 0; k < SMOOTHING_KERNEL_ORDER; ++k) {
+            rows[k] = &in->img[filter_clamp((int32_t)(y + k - R), H) * W];
+        }
+        gray_t *row_out = &out->img[y * W];
+
+        uint32_t x = x_lo;
+        switch (level) {
+#ifdef IMAGE_SIMD_X86
+            case IMAGE_SIMD_AVX2:
+                x = filter_interior_avx2(rows, row_out, x_lo, x_hi);
+                break;
+#endif
+            default:
+                break;
+        }
+        filter_interior_scalar(rows, row_out, x, x_hi);
+
+        for (x = 0; x < x_lo; ++x) {
+            row_out[x] = filter_border_pixel(rows, x, W);
+        }
+        for (x = x_hi; x < W; ++x) {
+            row_out[x] = filter_border_pixel(rows, x, W);
+        }
+    }
+}
+
+/* Threading */
+
+typedef enum {
+    OP_SCALE_DOWN,
+    OP_GRAYSCALE,
+    OP_FILTER,
+} image_op_e;
+
+typedef struct {
+    image_op_e  op;
+    const void *in;
+    void       *out;
+} image_op_arg_t;
+
+static void image_op_task(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void *arg
+) {
+    (void)worker_id;
+    const image_op_arg_t *a = (const image_op_arg_t *)arg;
+
+    switch (a->op) {
+        case OP_SCALE_DOWN:
+            scale_down_image_rows(a->in, a->out, begin, end);
+            break;
+        case OP_GRAYSCALE:
+            convert_to_grayscale_rows(a->in, a->out, begin, end);
+            break;
+        case OP_FILTER:
+            apply_filter_rows(a->in, a->out, begin, end);
+            break;
+    }
+}
+
+static void run_rows(
+    task_pool_t   *pool,
+    image_op_arg_t arg,
+    const uint32_t num_rows
+) {
+    if (pool == NULL) {
+        image_op_task(0, num_rows, 0, &arg);
+        return;
+    }
+
+    task_pool_parallel_for(
+        pool, 0, num_rows, IMAGE_SIMD_ROWS_PER_TASK, image_op_task, &arg
+    );
+}
+
+void scale_down_image_parallel(
+    rgba_img_t *in, rgba_img_t *out, task_pool_t *pool
+) {
+    if (in == NULL || out == NULL || out->width == 0 || out->height == 0 ||
+        in->height == 0 || in->width == 0) {
+        panic("bad arguments to \"scale_down_image_parallel\"");
+    }
+    if (out->width > in->width || out->height > in->height) {
+        panic("output dimensions not smaller than input dimensions");
+    }
+
+    out->img = malloc(out->width * out->height * sizeof(rgba_t));
+    if (out->img == NULL) {
+        panic("failed to malloc");
+    }
+
+    run_rows(
+        pool,
+        (image_op_arg_t){.op = OP_SCALE_DOWN, .in = in, .out = out},
+        out->height
+    );
+}
+
+void convert_to_grayscale_parallel(
+    rgba_img_t *in, gray_img_t *out, task_pool_t *pool
+) {
+    if (in == NULL || out == NULL || in->height == 0 || in->width == 0) {
+        panic("bad arguments to \"convert_to_grayscale_parallel\"");
+    }
+
+    out->height = in->height;
+    out->width  = in->width;
+    out->img    = malloc(in->height * in->width * sizeof(gray_t));
+    if (out->img == NULL) {
+        panic("failed to malloc");
+    }
+
+    run_rows(
+        pool,
+        (image_op_arg_t){.op = OP_GRAYSCALE, .in = in, .out = out},
+        in->height
+    );
+}
+
+void apply_filter_parallel(gray_img_t *in, gray_img_t *out, task_pool_t *pool) {
+    if (in == NULL || out == NULL) {
+        panic("bad arguments to \"apply_filter_parallel\"");
+    }
+
+    out->height = in->height;
+    out->width  = in->width;
+    out->img    = malloc(in->height * in->width * sizeof(gray_t));
+    if (out->img == NULL) {
+        panic("failed to malloc");
+    }
+
+    run_rows(
+        pool,
+        (image_op_arg_t){.op = OP_FILTER, .in = in, .out = out},
+        in->height
+    );
+}
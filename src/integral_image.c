@@ -0,0 +1,169 @@
+#include "integral_image.h"
+#include "panic.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+void build_integral_image(
+    double           *img,
+    const uint32_t    W,
+    const uint32_t    H,
+    const uint32_t    win_width,
+    const uint32_t    win_height,
+    integral_image_t *out
+) {
+    if (img == NULL || out == NULL || W == 0 || H == 0 || win_width == 0 ||
+        win_height == 0) {
+        panic("bad arguments to \"build_integral_image\"");
+    }
+
+    const uint32_t ax = (win_width - 1) / 2;
+    const uint32_t ay = (win_height - 1) / 2;
+    const uint32_t tw = W + (2 * ax) + 1;
+    const uint32_t th = H + (2 * ay) + 1;
+
+    out->apron_x = ax;
+    out->apron_y = ay;
+    out->width   = tw;
+    out->height  = th;
+    out->sum     = malloc(sizeof(double) * tw * th);
+    out->sum_sq  = malloc(sizeof(double) * tw * th);
+    if (out->sum == NULL || out->sum_sq == NULL) {
+        panic("failed to malloc");
+    }
+
+    // first row and column are zero so that lookups need no special cases
+    for (uint32_t tx = 0; tx < tw; ++tx) {
+        out->sum[tx]    = 0.0;
+        out->sum_sq[tx] = 0.0;
+    }
+
+    // tmp variables
+    int32_t sy, sx;
+    double  v, row_sum, row_sum_sq;
+
+    for (uint32_t ty = 1; ty < th; ++ty) {
+        sy = (int32_t)ty - 1 - (int32_t)ay;
+        if (sy < 0) {
+            sy = 0;
+        } else if (sy > ((int32_t)H - 1)) {
+            sy = (int32_t)H - 1;
+        }
+
+        double *row      = &out->sum[ty * tw];
+        double *row_sq   = &out->sum_sq[ty * tw];
+        double *above    = &out->sum[(ty - 1) * tw];
+        double *above_sq = &out->sum_sq[(ty - 1) * tw];
+
+        row[0]     = 0.0;
+        row_sq[0]  = 0.0;
+        row_sum    = 0.0;
+        row_sum_sq = 0.0;
+
+        for (uint32_t tx = 1; tx < tw; ++tx) {
+            sx = (int32_t)tx - 1 - (int32_t)ax;
+            if (sx < 0) {
+                sx = 0;
+            } else if (sx > ((int32_t)W - 1)) {
+                sx = (int32_t)W - 1;
+            }
+
+            v = img[(sy * W) + sx];
+            row_sum += v;
+            row_sum_sq += v * v;
+
+            row[tx]    = above[tx] + row_sum;
+            row_sq[tx] = above_sq[tx] + row_sum_sq;
+        }
+    }
+}
+
+void free_integral_image(integral_image_t *sat) {
+    if (sat == NULL) {
+        return;
+    }
+    free(sat->sum);
+    free(sat->sum_sq);
+    sat->sum    = NULL;
+    sat->sum_sq = NULL;
+}
+
+void integral_window_statistics(
+    const integral_image_t *sat,
+    const uint32_t          x,
+    const uint32_t          y,
+    double                 *mean,
+    double                 *std_dev
+) {
+    const uint32_t tw = sat->width;
+    const uint32_t ww = (2 * sat->apron_x) + 1;
+    const uint32_t wh = (2 * sat->apron_y) + 1;
+    const double   n  = (double)(ww * wh);
+
+    // window covers table rows y..y+wh and columns x..x+ww (exclusive top/left)
+    const uint32_t tl = (y * tw) + x;
+    const uint32_t tr = tl + ww;
+    const uint32_t bl = ((y + wh) * tw) + x;
+    const uint32_t br = bl + ww;
+
+    const double s1 = sat->sum[br] - sat->sum[tr] - sat->sum[bl] + sat->sum[tl];
+    const double s2 =
+        sat->sum_sq[br] - sat->sum_sq[tr] - sat->sum_sq[bl] + sat->sum_sq[tl];
+
+    // (n * s2 - s1^2) is exact for integer valued images, which avoids the
+    // cancellation of computing E[I^2] - E[I]^2 directly
+    double variance = ((n * s2) - (s1 * s1)) / (n * n);
+    if (variance < 0.0) {
+        variance = 0.0;
+    }
+
+    if (mean != NULL) {
+        *mean = s1 / n;
+    }
+    if (std_dev != NULL) {
+        *std_dev = sqrt(variance);
+    }
+}
+
+void integral_window_statistics_rows(
+    const integral_image_t *sat,
+    const uint32_t          y_begin,
+    const uint32_t          y_end,
+    double                 *mean,
+    double                 *std_dev
+) {
+    const uint32_t W = sat->width - (2 * sat->apron_x) - 1;
+    const uint32_t H = sat->height - (2 * sat->apron_y) - 1;
+    if (y_begin > y_end || y_end > H) {
+        panic("bad arguments to \"integral_window_statistics_rows\"");
+    }
+
+    double m, s;
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            integral_window_statistics(sat, x, y, &m, &s);
+            if (mean != NULL) {
+                mean[(y * W) + x] = m;
+            }
+            if (std_dev != NULL) {
+                std_dev[(y * W) + x] = s;
+            }
+        }
+    }
+}
+
+void calculate_window_statistics(
+    double        *img,
+    const uint32_t W,
+    const uint32_t H,
+    const uint32_t win_width,
+    const uint32_t win_height,
+    double        *mean,
+    double        *std_dev
+) {
+    integral_image_t sat;
+    build_integral_image(img, W, H, win_width, win_height, &sat);
+    integral_window_statistics_rows(&sat, 0, H, mean, std_dev);
+    free_integral_image(&sat);
+}
@@ -0,0 +1,201 @@
+#include "padded_image.h"
+#include "panic.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t round_up(const size_t n, const size_t multiple) {
+    return ((n + multiple - 1) / multiple) * multiple;
+}
+
+/*
+ * Shared by the pixel types, sizes are in bytes. Returns the allocation and
+ * sets the offset of pixel (0, 0) in it and the row pitch.
+ */
+static void *alloc_padded(
+    const size_t   pixel_size,
+    const uint32_t width,
+    const uint32_t height,
+    const uint32_t apron,
+    size_t        *origin,
+    size_t        *pitch
+) {
+    if (width == 0 || height == 0) {
+        panic("bad arguments to \"alloc_padded\"");
+    }
+
+    // the left apron is rounded up so that rows start aligned
+    const size_t left = round_up(apron * pixel_size, PADDED_IMAGE_ALIGNMENT);
+
+    *pitch = round_up(
+        left + ((size_t)(width + apron) * pixel_size), PADDED_IMAGE_ALIGNMENT
+    );
+    *origin = ((size_t)apron * *pitch) + left;
+
+    void *mem = aligned_alloc(
+        PADDED_IMAGE_ALIGNMENT, *pitch * ((size_t)height + (2 * apron))
+    );
+    if (mem == NULL) {
+        panic("failed to malloc");
+    }
+
+    return mem;
+}
+
+static void fill_apron(
+    uint8_t       *img,
+    const size_t   pixel_size,
+    const uint32_t width,
+    const uint32_t height,
+    const size_t   pitch,
+    const uint32_t apron
+) {
+    // left and right of each row
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t       *row   = &img[y * pitch];
+        const uint8_t *first = row;
+        const uint8_t *last  = &row[(width - 1) * pixel_size];
+
+        for (uint32_t a = 1; a <= apron; ++a) {
+            memcpy(row - (a * pixel_size), first, pixel_size);
+            memcpy(&row[(width - 1 + a) * pixel_size], last, pixel_size);
+        }
+    }
+
+    // whole rows above and below, which fills the corners too
+    const size_t span  = (size_t)(width + (2 * apron)) * pixel_size;
+    uint8_t     *first = img - (apron * pixel_size);
+    uint8_t     *last  = first + ((height - 1) * pitch);
+
+    for (uint32_t a = 1; a <= apron; ++a) {
+        memcpy(first - (a * pitch), first, span);
+        memcpy(last + (a * pitch), last, span);
+    }
+}
+
+void padded_gray_img_alloc(
+    padded_gray_img_t *p,
+    const uint32_t     width,
+    const uint32_t     height,
+    const uint32_t     apron
+) {
+    if (p == NULL) {
+        panic("bad arguments to \"padded_gray_img_alloc\"");
+    }
+
+    size_t origin, pitch;
+    p->mem =
+        alloc_padded(sizeof(gray_t), width, height, apron, &origin, &pitch);
+    p->img    = (gray_t *)((uint8_t *)p->mem + origin);
+    p->width  = width;
+    p->height = height;
+    p->stride = (uint32_t)(pitch / sizeof(gray_t));
+    p->apron  = apron;
+}
+
+void padded_gray_img_from(
+    padded_gray_img_t *p, const gray_img_t *in, const uint32_t apron
+) {
+    if (p == NULL || in == NULL || in->img == NULL) {
+        panic("bad arguments to \"padded_gray_img_from\"");
+    }
+
+    padded_gray_img_alloc(p, in->width, in->height, apron);
+    for (uint32_t y = 0; y < in->height; ++y) {
+        memcpy(
+            &p->img[y * p->stride],
+            &in->img[y * in->width],
+            in->width * sizeof(gray_t)
+        );
+    }
+    padded_gray_img_fill_apron(p);
+}
+
+void padded_gray_img_fill_apron(padded_gray_img_t *p) {
+    if (p == NULL || p->img == NULL) {
+        panic("bad arguments to \"padded_gray_img_fill_apron\"");
+    }
+
+    fill_apron(
+        (uint8_t *)p->img,
+        sizeof(gray_t),
+        p->width,
+        p->height,
+        p->stride * sizeof(gray_t),
+        p->apron
+    );
+}
+
+void padded_gray_img_free(padded_gray_img_t *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    free(p->mem);
+    p->mem = NULL;
+    p->img = NULL;
+}
+
+void padded_double_img_alloc(
+    padded_double_img_t *p,
+    const uint32_t       width,
+    const uint32_t       height,
+    const uint32_t       apron
+) {
+    if (p == NULL) {
+        panic("bad arguments to \"padded_double_img_alloc\"");
+    }
+
+    size_t origin, pitch;
+    p->mem =
+        alloc_padded(sizeof(double), width, height, apron, &origin, &pitch);
+    p->img    = (double *)((uint8_t *)p->mem + origin);
+    p->width  = width;
+    p->height = height;
+    p->stride = (uint32_t)(pitch / sizeof(double));
+    p->apron  = apron;
+}
+
+void padded_double_img_from(
+    padded_double_img_t *p, const double_img_t *in, const uint32_t apron
+) {
+    if (p == NULL || in == NULL || in->img == NULL) {
+        panic("bad arguments to \"padded_double_img_from\"");
+    }
+
+    padded_double_img_alloc(p, in->width, in->height, apron);
+    for (uint32_t y = 0; y < in->height; ++y) {
+        memcpy(
+            &p->img[y * p->stride],
+            &in->img[y * in->width],
+            in->width * sizeof(double)
+        );
+    }
+    padded_double_img_fill_apron(p);
+}
+
+void padded_double_img_fill_apron(padded_double_img_t *p) {
+    if (p == NULL || p->img == NULL) {
+        panic("bad arguments to \"padded_double_img_fill_apron\"");
+    }
+
+    fill_apron(
+        (uint8_t *)p->img,
+        sizeof(double),
+        p->width,
+        p->height,
+        p->stride * sizeof(double),
+        p->apron
+    );
+}
+
+void padded_double_img_free(padded_double_img_t *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    free(p->mem);
+    p->mem = NULL;
+    p->img = NULL;
+}
@@ -0,0 +1,92 @@
+#include "row_scheduler.h"
+#include "panic.h"
+
+#include <stddef.h>
+
+void row_scheduler_init(
+    row_scheduler_t *s, const uint32_t num_workers, const uint32_t align
+) {
+    if (s == NULL || num_workers == 0 ||
+        num_workers > ROW_SCHEDULER_MAX_WORKERS) {
+        panic("bad arguments to \"row_scheduler_init\"");
+    }
+
+    s->num_workers = num_workers;
+    s->align       = (align == 0) ? 1 : align;
+    for (uint32_t i = 0; i < ROW_SCHEDULER_MAX_WORKERS; ++i) {
+        s->throughput[i] = 0.0;
+    }
+}
+
+void row_scheduler_record(
+    row_scheduler_t *s,
+    const uint32_t   worker,
+    const uint32_t   rows,
+    const uint64_t   ns
+) {
+    if (s == NULL || worker >= s->num_workers) {
+        panic("bad arguments to \"row_scheduler_record\"");
+    }
+
+    if (rows == 0 || ns == 0) {
+        return;
+    }
+
+    const double t = ((double)rows * 1e9) / (double)ns;
+
+    if (s->throughput[worker] > 0.0) {
+        s->throughput[worker] = 0.5 * (s->throughput[worker] + t);
+    } else {
+        s->throughput[worker] = t;
+    }
+}
+
+void row_scheduler_split(
+    const row_scheduler_t *s,
+    const uint32_t         begin,
+    const uint32_t         end,
+    uint32_t              *bounds
+) {
+    if (s == NULL || bounds == NULL || end < begin) {
+        panic("bad arguments to \"row_scheduler_split\"");
+    }
+
+    const uint32_t n = s->num_workers;
+
+    // unmeasured workers count as the average measured one
+    double   measured_sum = 0.0;
+    uint32_t num_measured = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (s->throughput[i] > 0.0) {
+            measured_sum += s->throughput[i];
+            num_measured += 1;
+        }
+    }
+    const double fallback =
+        (num_measured > 0) ? (measured_sum / (double)num_measured) : 1.0;
+
+    double weights[ROW_SCHEDULER_MAX_WORKERS];
+    double total = 0.0;
+    for (uint32_t i = 0; i < n; ++i) {
+        weights[i] = (s->throughput[i] > 0.0) ? s->throughput[i] : fallback;
+        total += weights[i];
+    }
+
+    // split in units of align rows, the last unit may be partial
+    const uint32_t units = (end - begin + s->align - 1) / s->align;
+
+    double cumulative = 0.0;
+    bounds[0]         = begin;
+    for (uint32_t i = 1; i < n; ++i) {
+        cumulative += weights[i - 1];
+
+        const uint32_t u = (uint32_t)((cumulative / total) * units + 0.5);
+        const uint32_t b = begin + (u * s->align);
+
+        bounds[i] = (b < end) ? b : end;
+        if (bounds[i] < bounds[i - 1]) {
+            bounds[i] = bounds[i - 1];
+        }
+    }
+    bounds[n] = end;
+}
@@ -0,0 +1,254 @@
+#include "task_pool.h"
+#include "panic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    task_pool_t *pool;
+    uint32_t     worker_id;
+} worker_arg_t;
+
+/*
+ * Takes up to grain indices from the front of the worker's own range.
+ */
+static bool take_own(
+    task_pool_t *pool, uint32_t worker_id, uint32_t *begin, uint32_t *end
+) {
+    task_range_t *own   = &pool->ranges[worker_id];
+    bool          found = false;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->begin < own->end) {
+        *begin     = own->begin;
+        *end       = (own->end - own->begin > pool->grain)
+                         ? (own->begin + pool->grain)
+                         : own->end;
+        __atomic_store_n(&own->begin, *end, __ATOMIC_RELAXED);
+        found = true;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    return found;
+}
+
+/*
+ * Moves the back half of the largest other range into the worker's own
+ * range. Returns false if there was nothing left to steal.
+ */
+static bool steal(task_pool_t *pool, uint32_t worker_id) {
+    for (;;) {
+        // pick the victim without locking, the size is re-checked below
+        uint32_t victim = worker_id;
+        uint32_t most   = 0;
+        uint32_t w, b, e;
+        for (uint32_t i = 1; i < pool->num_workers; ++i) {
+            w = (worker_id + i) % pool->num_workers;
+            b = __atomic_load_n(&pool->ranges[w].begin, __ATOMIC_RELAXED);
+            e = __atomic_load_n(&pool->ranges[w].end, __ATOMIC_RELAXED);
+            if (e > b && (e - b) > most) {
+                most   = e - b;
+                victim = w;
+            }
+        }
+        if (victim == worker_id) {
+            return false;
+        }
+
+        task_range_t *r = &pool->ranges[victim];
+        uint32_t      stolen_begin, stolen_end;
+
+        pthread_mutex_lock(&r->lock);
+        if (r->begin >= r->end) {
+            // emptied in the meantime, look again
+            pthread_mutex_unlock(&r->lock);
+            continue;
+        }
+        stolen_end   = r->end;
+        stolen_begin = r->end - ((r->end - r->begin + 1) / 2);
+        __atomic_store_n(&r->end, stolen_begin, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&r->lock);
+
+        task_range_t *own = &pool->ranges[worker_id];
+        pthread_mutex_lock(&own->lock);
+        __atomic_store_n(&own->begin, stolen_begin, __ATOMIC_RELAXED);
+        __atomic_store_n(&own->end, stolen_end, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&own->lock);
+
+        return true;
+    }
+}
+
+static void run_worker(task_pool_t *pool, uint32_t worker_id) {
+    uint32_t begin, end;
+
+    for (;;) {
+        if (take_own(pool, worker_id, &begin, &end)) {
+            pool->fn(begin, end, worker_id, pool->arg);
+        } else if (!steal(pool, worker_id)) {
+            return;
+        }
+    }
+}
+
+static void *worker_main(void *p) {
+    worker_arg_t *warg       = p;
+    task_pool_t  *pool       = warg->pool;
+    uint32_t      worker_id  = warg->worker_id;
+    uint64_t      generation = 0;
+
+    free(warg);
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && pool->generation == generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(pool, worker_id);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active -= 1;
+        if (pool->active == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void task_pool_init(task_pool_t *pool, uint32_t num_workers) {
+    if (pool == NULL) {
+        panic("bad arguments to \"task_pool_init\"");
+    }
+
+    if (num_workers == 0) {
+        long n      = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (n > 0) ? (uint32_t)n : 1;
+    }
+
+    pool->num_workers = num_workers;
+    pool->generation  = 0;
+    pool->active      = 0;
+    pool->shutdown    = 0;
+    pool->fn          = NULL;
+    pool->arg         = NULL;
+    pool->grain       = 1;
+
+    pool->ranges = aligned_alloc(
+        _Alignof(task_range_t), sizeof(task_range_t) * num_workers
+    );
+    pool->threads = malloc(sizeof(pthread_t) * num_workers);
+    if (pool->ranges == NULL || pool->threads == NULL) {
+        panic("failed to malloc");
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (uint32_t i = 0; i < num_workers; ++i) {
+        pthread_mutex_init(&pool->ranges[i].lock, NULL);
+        __atomic_store_n(&pool->ranges[i].begin, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool->ranges[i].end, 0, __ATOMIC_RELAXED);
+    }
+
+    for (uint32_t i = 1; i < num_workers; ++i) {
+        worker_arg_t *warg = malloc(sizeof(worker_arg_t));
+        if (warg == NULL) {
+            panic("failed to malloc");
+        }
+        warg->pool      = pool;
+        warg->worker_id = i;
+
+        if (pthread_create(&pool->threads[i], NULL, worker_main, warg) != 0) {
+            panic("failed to create worker thread");
+        }
+    }
+}
+
+void task_pool_destroy(task_pool_t *pool) {
+    if (pool == NULL || pool->threads == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 1; i < pool->num_workers; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < pool->num_workers; ++i) {
+        pthread_mutex_destroy(&pool->ranges[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+
+    free(pool->ranges);
+    free(pool->threads);
+    pool->ranges  = NULL;
+    pool->threads = NULL;
+}
+
+void task_pool_parallel_for(
+    task_pool_t   *pool,
+    const uint32_t begin,
+    const uint32_t end,
+    const uint32_t grain,
+    task_fn_t      fn,
+    void          *arg
+) {
+    if (pool == NULL || pool->threads == NULL || fn == NULL) {
+        panic("bad arguments to \"task_pool_parallel_for\"");
+    }
+
+    if (begin >= end) {
+        return;
+    }
+
+    const uint32_t n     = end - begin;
+    const uint32_t nw    = pool->num_workers;
+    const uint32_t chunk = n / nw;
+    const uint32_t rest  = n % nw;
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->fn    = fn;
+    pool->arg   = arg;
+    pool->grain = (grain == 0) ? 1 : grain;
+
+    // even split, the first `rest` workers get one extra index
+    uint32_t b = begin;
+    for (uint32_t i = 0; i < nw; ++i) {
+        const uint32_t e = b + chunk + ((i < rest) ? 1 : 0);
+        pthread_mutex_lock(&pool->ranges[i].lock);
+        __atomic_store_n(&pool->ranges[i].begin, b, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool->ranges[i].end, e, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&pool->ranges[i].lock);
+        b = e;
+    }
+
+    pool->active = nw - 1;
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_worker(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
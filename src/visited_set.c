@@ -0,0 +1,42 @@
+#include "visited_set.h"
+#include "panic.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+void visited_set_init(visited_set_t *set, uint32_t capacity) {
+    if (set == NULL) {
+        panic("bad arguments to \"visited_set_init\"");
+    }
+
+    set->epoch = calloc(capacity, sizeof(uint32_t));
+    if (set->epoch == NULL && capacity > 0) {
+        panic("failed to malloc");
+    }
+    set->current  = 1;
+    set->capacity = capacity;
+}
+
+void visited_set_free(visited_set_t *set) {
+    if (set == NULL) {
+        return;
+    }
+
+    free(set->epoch);
+    set->epoch    = NULL;
+    set->capacity = 0;
+}
+
+void visited_set_clear(visited_set_t *set) {
+    if (set == NULL) {
+        return;
+    }
+
+    set->current += 1;
+    if (set->current == 0) {
+        // wrapped around, old epochs could match again
+        memset(set->epoch, 0, sizeof(uint32_t) * set->capacity);
+        set->current = 1;
+    }
+}
@@ -0,0 +1,250 @@
+#include "work_size_tuning.h"
+#include "panic.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+void work_size_table_init(work_size_table_t *t) {
+    if (t == NULL) {
+        panic("bad arguments to \"work_size_table_init\"");
+    }
+
+    memset(t, 0, sizeof(*t));
+}
+
+int32_t work_size_table_load(work_size_table_t *t, const char *path) {
+    if (t == NULL || path == NULL) {
+        panic("bad arguments to \"work_size_table_load\"");
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[WORK_SIZE_KEY_LEN + 128];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+
+        char        key[WORK_SIZE_KEY_LEN];
+        work_size_t ws;
+
+        // key length must match WORK_SIZE_KEY_LEN - 1
+        const int n = sscanf(
+            line,
+            "%191s %u %zu %zu %zu %zu",
+            key,
+            &ws.work_dim,
+            &ws.global[0],
+            &ws.global[1],
+            &ws.local[0],
+            &ws.local[1]
+        );
+        if (n != 6 || ws.work_dim < 1 || ws.work_dim > 2 ||
+            ws.global[0] == 0 || ws.global[1] == 0) {
+            continue;
+        }
+
+        work_size_table_set(t, key, &ws);
+    }
+    fclose(f);
+
+    return 0;
+}
+
+int32_t work_size_table_save(const work_size_table_t *t, const char *path) {
+    if (t == NULL || path == NULL) {
+        panic("bad arguments to \"work_size_table_save\"");
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+
+    fprintf(f, "# tuned work sizes, delete this file to tune again\n");
+    fprintf(f, "# key work_dim global0 global1 local0 local1\n");
+    for (uint32_t i = 0; i < t->num_entries; ++i) {
+        const work_size_t *ws = &t->entries[i].ws;
+        fprintf(
+            f,
+            "%s %u %zu %zu %zu %zu\n",
+            t->entries[i].key,
+            ws->work_dim,
+            ws->global[0],
+            ws->global[1],
+            ws->local[0],
+            ws->local[1]
+        );
+    }
+
+    if (fclose(f) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+const work_size_t *work_size_table_find(
+    const work_size_table_t *t, const char *key
+) {
+    if (t == NULL || key == NULL) {
+        panic("bad arguments to \"work_size_table_find\"");
+    }
+
+    for (uint32_t i = 0; i < t->num_entries; ++i) {
+        if (strncmp(t->entries[i].key, key, WORK_SIZE_KEY_LEN) == 0) {
+            return &t->entries[i].ws;
+        }
+    }
+
+    return NULL;
+}
+
+void work_size_table_set(
+    work_size_table_t *t, const char *key, const work_size_t *ws
+) {
+    if (t == NULL || key == NULL || ws == NULL) {
+        panic("bad arguments to \"work_size_table_set\"");
+    }
+
+    uint32_t i = 0;
+    for (; i < t->num_entries; ++i) {
+        if (strncmp(t->entries[i].key, key, WORK_SIZE_KEY_LEN) == 0) {
+            break;
+        }
+    }
+
+    if (i == t->num_entries) {
+        if (t->num_entries == WORK_SIZE_TABLE_MAX_ENTRIES) {
+            panic("work size table is full");
+        }
+        t->num_entries += 1;
+        strncpy(t->entries[i].key, key, WORK_SIZE_KEY_LEN - 1);
+        t->entries[i].key[WORK_SIZE_KEY_LEN - 1] = 0;
+    }
+
+    t->entries[i].ws = *ws;
+}
+
+// 32-bit FNV-1a
+static uint32_t hash_string(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s != 0; ++s) {
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    }
+    return h;
+}
+
+void work_size_key(
+    char          *key,
+    const char    *kernel,
+    const char    *options,
+    const char    *device,
+    const uint32_t W,
+    const uint32_t H
+) {
+    if (key == NULL || kernel == NULL || device == NULL) {
+        panic("bad arguments to \"work_size_key\"");
+    }
+
+    if (options == NULL) {
+        snprintf(key, WORK_SIZE_KEY_LEN, "%s@%s@%ux%u", kernel, device, W, H);
+    } else {
+        snprintf(
+            key,
+            WORK_SIZE_KEY_LEN,
+            "%s#%08x@%s@%ux%u",
+            kernel,
+            hash_string(options),
+            device,
+            W,
+            H
+        );
+    }
+
+    // keys are whitespace separated in the tuning file
+    for (char *c = key; *c != 0; ++c) {
+        if (isspace((unsigned char)*c)) {
+            *c = '_';
+        }
+    }
+}
+
+static size_t round_up(const size_t n, const size_t multiple) {
+    return ((n + multiple - 1) / multiple) * multiple;
+}
+
+uint32_t work_size_candidates(
+    const work_size_kind_t kind,
+    const uint32_t         work_dim,
+    const uint32_t         n0,
+    const uint32_t         n1,
+    const uint32_t         max_local,
+    work_size_t           *out
+) {
+    if (out == NULL || n0 == 0 || work_dim < 1 || work_dim > 2 ||
+        (work_dim == 2 && n1 == 0)) {
+        panic("bad arguments to \"work_size_candidates\"");
+    }
+
+    uint32_t num = 0;
+
+    if (kind == WORK_SIZE_ROW_SECTIONS) {
+        // sections of 1, 2, 4, ... rows, the last one gets the remainder
+        for (uint32_t rows = 1;
+             rows <= n0 && rows <= WORK_SIZE_MAX_SECTION_ROWS;
+             rows *= 2) {
+            const size_t sections = n0 / rows;
+            if (num > 0 && out[num - 1].global[0] == sections) {
+                continue;
+            }
+            out[num] = (work_size_t){
+                .work_dim = 1, .global = {sections, 1}, .local = {0, 0}
+            };
+            num += 1;
+        }
+        return num;
+    }
+
+    const size_t n[2] = {n0, (work_dim == 2) ? n1 : 1};
+
+    out[num] = (work_size_t){
+        .work_dim = work_dim, .global = {n[0], n[1]}, .local = {0, 0}
+    };
+    num += 1;
+
+    if (work_dim == 1) {
+        for (size_t l = 8; l <= max_local && num < WORK_SIZE_MAX_CANDIDATES;
+             l *= 2) {
+            out[num] = (work_size_t){
+                .work_dim = 1,
+                .global   = {round_up(n[0], l), 1},
+                .local    = {l, 1}
+            };
+            num += 1;
+        }
+        return num;
+    }
+
+    // wide groups first, neighbouring work items read neighbouring pixels
+    for (size_t lx = 64; lx >= 4; lx /= 2) {
+        for (size_t ly = 1; ly <= 16; ly *= 2) {
+            const size_t l = lx * ly;
+            if (l < 16 || l > max_local || num == WORK_SIZE_MAX_CANDIDATES) {
+                continue;
+            }
+            out[num] = (work_size_t){
+                .work_dim = 2,
+                .global   = {round_up(n[0], lx), round_up(n[1], ly)},
+                .local    = {lx, ly}
+            };
+            num += 1;
+        }
+    }
+
+    return num;
+}
@@ -0,0 +1,285 @@
+#include "zncc_cost_volume.h"
+#include "panic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// used if the L2 cache size can't be queried
+#define FALLBACK_L2_CACHE_SIZE (256u * 1024u)
+// narrowest tile, below this the per tile overhead starts to show
+#define MIN_TILE_WIDTH 64u
+
+uint32_t zncc_cost_volume_scratch_size(
+    const uint32_t W,
+    const uint32_t band_height,
+    const uint32_t win_width,
+    const uint32_t win_height
+) {
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+    const uint32_t pw = W + (2 * rx);
+    const uint32_t ph = band_height + (2 * ry);
+
+    // padded rows of both images + column sums + best score of each pixel in
+    // both directions
+    return (2 * ph * pw) + pw + (2 * band_height * W);
+}
+
+uint32_t zncc_cost_volume_tile_width(
+    const uint32_t band_height,
+    const uint32_t win_width,
+    const uint32_t win_height,
+    const uint32_t max_disp
+) {
+    long l2_size = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (l2_size <= 0) {
+        l2_size = FALLBACK_L2_CACHE_SIZE;
+    }
+
+    const uint32_t ry = (win_height - 1) / 2;
+    const uint32_t ph = band_height + (2 * ry);
+
+    // doubles touched per image column while looping over d: padded rows of
+    // both images, column sum, best score in both directions and mean and
+    // inverse std dev of both images
+    const uint64_t column_bytes =
+        sizeof(double) * ((2 * ph) + 1 + (2 * band_height) + (4 * band_height));
+
+    // leave half of L2 for everything else, e.g. the output rows
+    const uint64_t columns = ((uint64_t)l2_size / 2) / column_bytes;
+
+    // right image side of the tile extends max_disp - 1 columns further
+    const uint64_t apron = max_disp + win_width;
+    if (columns <= apron + MIN_TILE_WIDTH) {
+        return MIN_TILE_WIDTH;
+    }
+    return (uint32_t)(columns - apron);
+}
+
+/*
+ * Both directions score exactly the same (xl, xr) pairs, so the search is
+ * shared. Either output can be NULL to only search one direction.
+ */
+static void cost_volume_search(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y_begin,
+    const uint32_t      y_end,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const uint32_t      tile_width,
+    double             *scratch,
+    int32_t            *out_ltr,
+    int32_t            *out_rtl
+) {
+    const uint32_t W  = left->width;
+    const uint32_t H  = left->height;
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+    const uint32_t ww = (2 * rx) + 1;
+    const uint32_t wh = (2 * ry) + 1;
+    const uint32_t pw = W + (2 * rx);
+    const uint32_t bh = y_end - y_begin;
+    const uint32_t ph = bh + (2 * ry);
+    const double   n  = (double)(ww * wh);
+
+    bool free_scratch = false;
+    if (scratch == NULL) {
+        scratch = malloc(
+            sizeof(double) *
+            zncc_cost_volume_scratch_size(W, bh, win_width, win_height)
+        );
+        if (scratch == NULL) {
+            panic("failed to malloc");
+        }
+        free_scratch = true;
+    }
+
+    double *rows_left  = scratch;
+    double *rows_right = &scratch[ph * pw];
+    double *col_sum    = &scratch[2 * ph * pw];
+    double *best_ltr   = &scratch[(2 * ph * pw) + pw];
+    double *best_rtl   = &scratch[(2 * ph * pw) + pw + (bh * W)];
+
+    const int32_t first_row = (int32_t)y_begin - (int32_t)ry;
+    copy_padded_rows(left->img, W, H, first_row, ph, rx, rows_left);
+    copy_padded_rows(right->img, W, H, first_row, ph, rx, rows_right);
+
+    for (uint32_t i = 0; i < (bh * W); ++i) {
+        best_ltr[i] = 0.0;
+        best_rtl[i] = 0.0;
+        if (out_ltr != NULL) {
+            out_ltr[(y_begin * W) + i] = 0;
+        }
+        if (out_rtl != NULL) {
+            out_rtl[(y_begin * W) + i] = 0;
+        }
+    }
+
+    const uint32_t d_end = (max_disp < W) ? max_disp : W;
+    const uint32_t tw    = (tile_width == 0 || tile_width > W) ? W : tile_width;
+
+    // tmp variables
+    uint32_t xr, x_first, u_end;
+    double   sum, inv, zncc;
+
+    // Window sums are indexed by left image column xl, the matching right
+    // image column is xl - d. Left to right search stores the result at xl,
+    // right to left at xl - d.
+    //
+    // Columns are processed in tiles of tw left image pixels, so that the
+    // rows, statistics and best scores touched while looping over d stay in
+    // cache. Disparities are still visited in increasing order for every
+    // pixel in both directions: for a right image pixel, pairs in an earlier
+    // tile always have a smaller d. Ties therefore resolve like in
+    // `calculate_zncc_row`.
+    for (uint32_t x_begin = 0; x_begin < W; x_begin += tw) {
+        const uint32_t x_end = (x_begin + tw < W) ? (x_begin + tw) : W;
+
+        for (uint32_t d = 0; d < d_end; ++d) {
+            x_first = (x_begin > d) ? x_begin : d;
+            if (x_first >= x_end) {
+                continue;
+            }
+            // padded columns covered by the windows of this tile
+            u_end = x_end + ww - 1;
+
+            // column sums of L * R for the first row of the band
+            for (uint32_t u = x_first; u < u_end; ++u) {
+                col_sum[u] = 0.0;
+                for (uint32_t k = 0; k < wh; ++k) {
+                    col_sum[u] +=
+                        rows_left[(k * pw) + u] * rows_right[(k * pw) + u - d];
+                }
+            }
+
+            for (uint32_t yb = 0; yb < bh; ++yb) {
+                if (yb > 0) {
+                    // slide column sums down by one row
+                    const double *l_in  = &rows_left[(yb + wh - 1) * pw];
+                    const double *r_in  = &rows_right[(yb + wh - 1) * pw];
+                    const double *l_out = &rows_left[(yb - 1) * pw];
+                    const double *r_out = &rows_right[(yb - 1) * pw];
+                    for (uint32_t u = x_first; u < u_end; ++u) {
+                        col_sum[u] += (l_in[u] * r_in[u - d]) -
+                                      (l_out[u] * r_out[u - d]);
+                    }
+                }
+
+                const uint32_t y          = y_begin + yb;
+                const double  *mean_left  = &left->mean[y * W];
+                const double  *mean_right = &right->mean[y * W];
+                const double  *inv_left   = &left->inv_std_dev[y * W];
+                const double  *inv_right  = &right->inv_std_dev[y * W];
+
+                sum = 0.0;
+                for (uint32_t u = x_first; u < (x_first + ww); ++u) {
+                    sum += col_sum[u];
+                }
+
+                for (uint32_t xl = x_first; xl < x_end; ++xl) {
+                    if (xl > x_first) {
+                        // slide window right by one column
+                        sum += col_sum[xl + ww - 1] - col_sum[xl - 1];
+                    }
+
+                    xr  = xl - d;
+                    inv = inv_left[xl] * inv_right[xr];
+                    if (inv == 0.0) {
+                        // flat window, scores 0 which never beats best
+                        continue;
+                    }
+
+                    zncc = (sum - (n * mean_left[xl] * mean_right[xr])) * inv;
+
+                    if (out_ltr != NULL && zncc > best_ltr[(yb * W) + xl]) {
+                        best_ltr[(yb * W) + xl] = zncc;
+                        out_ltr[(y * W) + xl]   = (int32_t)d;
+                    }
+                    if (out_rtl != NULL && zncc > best_rtl[(yb * W) + xr]) {
+                        best_rtl[(yb * W) + xr] = zncc;
+                        out_rtl[(y * W) + xr]   = (int32_t)d;
+                    }
+                }
+            }
+        }
+    }
+
+    if (free_scratch) {
+        free(scratch);
+    }
+}
+
+void calculate_zncc_cost_volume(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y_begin,
+    const uint32_t      y_end,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const int32_t       direction,
+    const uint32_t      tile_width,
+    double             *scratch,
+    int32_t            *out
+) {
+    if (left == NULL || right == NULL || out == NULL || direction == 0 ||
+        left->width != right->width || left->height != right->height ||
+        y_begin >= y_end || y_end > left->height) {
+        panic("bad arguments to \"calculate_zncc_cost_volume\"");
+    }
+
+    cost_volume_search(
+        left,
+        right,
+        y_begin,
+        y_end,
+        win_width,
+        win_height,
+        max_disp,
+        tile_width,
+        scratch,
+        (direction > 0) ? out : NULL,
+        (direction > 0) ? NULL : out
+    );
+}
+
+void calculate_zncc_cost_volume_fused(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y_begin,
+    const uint32_t      y_end,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const uint32_t      tile_width,
+    double             *scratch,
+    int32_t            *out_ltr,
+    int32_t            *out_rtl
+) {
+    if (left == NULL || right == NULL || out_ltr == NULL || out_rtl == NULL ||
+        left->width != right->width || left->height != right->height ||
+        y_begin >= y_end || y_end > left->height) {
+        panic("bad arguments to \"calculate_zncc_cost_volume_fused\"");
+    }
+
+    cost_volume_search(
+        left,
+        right,
+        y_begin,
+        y_end,
+        win_width,
+        win_height,
+        max_disp,
+        tile_width,
+        scratch,
+        out_ltr,
+        out_rtl
+    );
+}
@@ -1,6 +1,7 @@
 #include "zncc_operations.h"
 #include "coord_fifo.h"
 #include "panic.h"
+#include "visited_set.h"
 
 #include <math.h>
 #include <stdbool.h>
@@ -63,6 +64,35 @@ void extract_window(
     }
 }
 
+void extract_window_padded(
+    const padded_double_img_t *in,
+    double                    *out,
+    const uint32_t             x_offset,
+    const uint32_t             y_offset,
+    const uint32_t             win_width,
+    const uint32_t             win_height
+) {
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+
+    if (in == NULL || out == NULL || in->apron < rx || in->apron < ry) {
+        panic("bad arguments to \"extract_window_padded\"");
+    }
+
+    // top left pixel of the window, possibly in the apron
+    const double *src = in->img + (((ptrdiff_t)y_offset - ry) * in->stride) +
+        ((ptrdiff_t)x_offset - rx);
+
+    // 2 * r + 1 rows and columns like extract_window, also for even sizes
+    for (uint32_t y = 0; y <= 2 * ry; ++y) {
+        memcpy(
+            &out[y * win_width],
+            &src[y * in->stride],
+            ((2 * rx) + 1) * sizeof(double)
+        );
+    }
+}
+
 double calculate_window_mean(double *img, const uint32_t W, const uint32_t H) {
     double total = 0.0;
 
@@ -131,6 +161,16 @@ double window_dot_product(
     return sum;
 }
 
+// flat windows get 0 so they score 0 against everything, same as a window
+// which `normalize_window` leaves zero-mean but unscaled
+void invert_standard_deviation(
+    double *std_dev, double *inv_std_dev, const uint32_t N
+) {
+    for (uint32_t i = 0; i < N; ++i) {
+        inv_std_dev[i] = (std_dev[i] == 0.0) ? 0.0 : (1.0 / std_dev[i]);
+    }
+}
+
 int32_t find_nearest_nonzero_neighbour(
     int32_t      *img,
     uint32_t      W,
@@ -215,6 +255,11 @@ int32_t find_nearest_nonzero_neighbour(
         }
     }
 
+#undef VISITED
+#undef COORD_TO_IDX
+#undef COORD_PTR_TO_IDX
+#undef IN_BOUNDS
+
     int32_t ret = 0;
     if (curr != NULL) {
         ret = img[(curr->y * W) + curr->x];
@@ -228,4 +273,209 @@ int32_t find_nearest_nonzero_neighbour(
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+int32_t find_nearest_nonzero_neighbour_visited_set(
+    int32_t       *img,
+    uint32_t       W,
+    uint32_t       H,
+    uint32_t       x,
+    uint32_t       y,
+    visited_set_t *visited,
+    coord_fifo_t  *fifo
+) {
+    if (visited == NULL || fifo == NULL || fifo->storage == NULL ||
+        visited->capacity < W * H || fifo->capacity < W * H) {
+        panic(
+            "bad arguments to \"find_nearest_nonzero_neighbour_visited_set\""
+        );
+    }
+
+    if (x >= W || y >= H) {
+        return 0;
+    }
+
+    if (img[(y * W) + x] != 0) {
+        return img[(y * W) + x];
+    }
+
+    // only the pixels visited by this call are in the new epoch
+    visited_set_clear(visited);
+    fifo->read  = 0;
+    fifo->write = 0;
+
+    visited_set_insert(visited, (y * W) + x);
+    coord_t *curr = NULL;
+    coord_fifo_enqueue(fifo, (coord_t){.x = x, .y = y});
+
+// coordinates are unsigned, stepping left of 0 or above 0 wraps past W or H
+#define IN_BOUNDS(coord) (coord.x < W && coord.y < H)
+
+#define COORD_PTR_TO_IDX(coord) ((coord->y * W) + coord->x)
+#define COORD_TO_IDX(coord) ((coord.y * W) + coord.x)
+
+#define VISIT(coord)                                          \
+    if (IN_BOUNDS(coord) &&                                    \
+        !visited_set_contains(visited, COORD_TO_IDX(coord))) { \
+        visited_set_insert(visited, COORD_TO_IDX(coord));      \
+        coord_fifo_enqueue(fifo, coord);                       \
+    }
+
+    while (coord_fifo_len(fifo) > 0) {
+        curr = coord_fifo_dequeue(fifo);
+        if (curr == NULL) {
+            break;
+        }
+        if (img[COORD_PTR_TO_IDX(curr)] != 0) {
+            break;
+        }
+        // same order as `find_nearest_nonzero_neighbour`
+        coord_t right = {.x = curr->x + 1, .y = curr->y};
+        VISIT(right);
+        coord_t down = {.x = curr->x, .y = curr->y + 1};
+        VISIT(down);
+        coord_t left = {.x = curr->x - 1, .y = curr->y};
+        VISIT(left);
+        coord_t up = {.x = curr->x, .y = curr->y - 1};
+        VISIT(up);
+    }
+
+#undef VISIT
+#undef COORD_TO_IDX
+#undef COORD_PTR_TO_IDX
+#undef IN_BOUNDS
+
+    if (curr == NULL) {
+        return 0;
+    }
+    return img[(curr->y * W) + curr->x];
+}
+
+/*
+ * Distance used for pixels with no nonzero pixel found yet. Larger than any
+ * real Manhattan distance in the image, and small enough that adding 1 does
+ * not overflow.
+ */
+static inline uint32_t fill_no_source(const uint32_t W, const uint32_t H) {
+    return W + H;
+}
+
+void fill_zero_regions_rows(
+    int32_t       *img,
+    uint32_t      *dist,
+    const uint32_t W,
+    const uint32_t H,
+    const uint32_t y_begin,
+    const uint32_t y_end
+) {
+    if (img == NULL || dist == NULL || y_begin > y_end || y_end > H) {
+        panic("bad arguments to \"fill_zero_regions_rows\"");
+    }
+
+    const uint32_t none = fill_no_source(W, H);
+
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+        int32_t  *row_img  = &img[y * W];
+        uint32_t *row_dist = &dist[y * W];
+
+        // nearest nonzero pixel on the left
+        uint32_t d     = none;
+        int32_t  label = 0;
+        for (uint32_t x = 0; x < W; ++x) {
+            if (row_img[x] != 0) {
+                d     = 0;
+                label = row_img[x];
+            } else if (d != none) {
+                d += 1;
+                row_img[x] = label;
+            }
+            row_dist[x] = d;
+        }
+
+        // nearest nonzero pixel on the right, if strictly closer
+        d = none;
+        for (uint32_t x = W; x-- > 0;) {
+            if (row_dist[x] == 0) {
+                d     = 0;
+                label = row_img[x];
+            } else if (d != none) {
+                d += 1;
+                if (d < row_dist[x]) {
+                    row_dist[x] = d;
+                    row_img[x]  = label;
+                }
+            }
+        }
+    }
+}
+
+void fill_zero_regions_columns(
+    int32_t       *img,
+    uint32_t      *dist,
+    const uint32_t W,
+    const uint32_t H,
+    const uint32_t x_begin,
+    const uint32_t x_end
+) {
+    if (img == NULL || dist == NULL || x_begin > x_end || x_end > W) {
+        panic("bad arguments to \"fill_zero_regions_columns\"");
+    }
+
+    if (H == 0) {
+        return;
+    }
+
+    // the columns are swept a row at a time, so memory is accessed row-major
+    // and the inner loops vectorize
+
+    // nearest source above
+    for (uint32_t y = 1; y < H; ++y) {
+        for (uint32_t x = x_begin; x < x_end; ++x) {
+            const uint32_t d = dist[((y - 1) * W) + x] + 1;
+            if (d < dist[(y * W) + x]) {
+                dist[(y * W) + x] = d;
+                img[(y * W) + x]  = img[((y - 1) * W) + x];
+            }
+        }
+    }
+
+    // nearest source below, if strictly closer
+    for (uint32_t y = H - 1; y-- > 0;) {
+        for (uint32_t x = x_begin; x < x_end; ++x) {
+            const uint32_t d = dist[((y + 1) * W) + x] + 1;
+            if (d < dist[(y * W) + x]) {
+                dist[(y * W) + x] = d;
+                img[(y * W) + x]  = img[((y + 1) * W) + x];
+            }
+        }
+    }
+}
+
+void fill_zero_regions(
+    int32_t *img, uint32_t *dist, const uint32_t W, const uint32_t H
+) {
+    bool free_dist = false;
+
+    if (img == NULL) {
+        panic("bad arguments to \"fill_zero_regions\"");
+    }
+
+    if (W == 0 || H == 0) {
+        return;
+    }
+
+    if (dist == NULL) {
+        dist = malloc(sizeof(uint32_t) * W * H);
+        if (dist == NULL) {
+            panic("failed to malloc");
+        }
+        free_dist = true;
+    }
+
+    fill_zero_regions_rows(img, dist, W, H, 0, H);
+    fill_zero_regions_columns(img, dist, W, H, 0, W);
+
+    if (free_dist) {
+        free(dist);
+    }
+}
@@ -0,0 +1,658 @@
+#include "zncc_simd.h"
+#include "panic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ZNCC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+typedef float (*dot_fn_t)(const float *, const float *, const uint32_t);
+typedef int32_t (*dot_u8_fn_t)(const gray_t *, const gray_t *, const uint32_t);
+
+// -1 until first use, accessed atomically as drivers dispatch from threads
+static int simd_level = -1;
+
+zncc_simd_level_e zncc_simd_detect(void) {
+#ifdef ZNCC_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw")) {
+        return ZNCC_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return ZNCC_SIMD_AVX2;
+    }
+#endif
+    return ZNCC_SIMD_SCALAR;
+}
+
+zncc_simd_level_e zncc_simd_get_level(void) {
+    int level = __atomic_load_n(&simd_level, __ATOMIC_RELAXED);
+    if (level < 0) {
+        // detection gives the same result on every thread, keep a level set
+        // in the meantime
+        int unset = -1;
+        level     = (int)zncc_simd_detect();
+        if (!__atomic_compare_exchange_n(
+                &simd_level,
+                &unset,
+                level,
+                false,
+                __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED
+            )) {
+            level = unset;
+        }
+    }
+    return (zncc_simd_level_e)level;
+}
+
+void zncc_simd_set_level(zncc_simd_level_e level) {
+    const zncc_simd_level_e supported = zncc_simd_detect();
+    __atomic_store_n(
+        &simd_level,
+        (int)((level > supported) ? supported : level),
+        __ATOMIC_RELAXED
+    );
+}
+
+uint32_t zncc_simd_window_stride(
+    const uint32_t win_width, const uint32_t win_height
+) {
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+    const uint32_t n  = ((2 * rx) + 1) * ((2 * ry) + 1);
+
+    return (n + 15u) & ~15u;
+}
+
+uint32_t zncc_simd_window_stride_u8(
+    const uint32_t win_width, const uint32_t win_height
+) {
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+    const uint32_t n  = ((2 * rx) + 1) * ((2 * ry) + 1);
+
+    return (n + 31u) & ~31u;
+}
+
+uint32_t zncc_row_u8_scratch_size(
+    const uint32_t W, const uint32_t win_width, const uint32_t win_height
+) {
+    // packed windows of both images
+    return 2 * W * zncc_simd_window_stride_u8(win_width, win_height);
+}
+
+uint32_t zncc_row_f32_scratch_size(
+    const uint32_t W, const uint32_t win_width, const uint32_t win_height
+) {
+    // packed windows of both images
+    return 2 * W * zncc_simd_window_stride(win_width, win_height);
+}
+
+static ALWAYS_INLINE float dot_scalar(
+    const float *a, const float *b, const uint32_t stride
+) {
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < stride; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#ifdef ZNCC_SIMD_X86
+__attribute__((target("avx2,fma"))) static inline float dot_avx2(
+    const float *a, const float *b, const uint32_t stride
+) {
+    // two accumulators to hide FMA latency, stride is a multiple of 16
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < stride; i += 16) {
+        acc0 = _mm256_fmadd_ps(
+            _mm256_load_ps(&a[i]), _mm256_load_ps(&b[i]), acc0
+        );
+        acc1 = _mm256_fmadd_ps(
+            _mm256_load_ps(&a[i + 8]), _mm256_load_ps(&b[i + 8]), acc1
+        );
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+
+    __m128 sum = _mm_add_ps(
+        _mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1)
+    );
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx512f"))) static inline float dot_avx512(
+    const float *a, const float *b, const uint32_t stride
+) {
+    __m512 acc = _mm512_setzero_ps();
+    for (uint32_t i = 0; i < stride; i += 16) {
+        acc = _mm512_fmadd_ps(
+            _mm512_load_ps(&a[i]), _mm512_load_ps(&b[i]), acc
+        );
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+#endif
+
+float window_dot_product_f32(
+    const float *a, const float *b, const uint32_t stride
+) {
+    switch (zncc_simd_get_level()) {
+#ifdef ZNCC_SIMD_X86
+        case ZNCC_SIMD_AVX512:
+            return dot_avx512(a, b, stride);
+        case ZNCC_SIMD_AVX2:
+            return dot_avx2(a, b, stride);
+#endif
+        default:
+            return dot_scalar(a, b, stride);
+    }
+}
+
+/*
+ * Packs the normalized windows of every pixel on row y, clamped at the image
+ * borders like `extract_window`. Flat windows (inverse std dev 0) become all
+ * zeros so they score 0.
+ */
+static void pack_normalized_windows(
+    const zncc_input_t *in,
+    const uint32_t      y,
+    const uint32_t      rx,
+    const uint32_t      ry,
+    const uint32_t      stride,
+    float              *windows
+) {
+    const uint32_t W     = in->width;
+    const int32_t  max_x = (int32_t)in->width - 1;
+    const int32_t  max_y = (int32_t)in->height - 1;
+
+    // tmp variables
+    int32_t sx, sy;
+    float   mean, inv;
+    float  *win;
+
+    for (uint32_t x = 0; x < W; ++x) {
+        win  = &windows[x * stride];
+        mean = (float)in->mean[(y * W) + x];
+        inv  = (float)in->inv_std_dev[(y * W) + x];
+
+        uint32_t i = 0;
+        for (int32_t k = -(int32_t)ry; k <= (int32_t)ry; ++k) {
+            sy = (int32_t)y + k;
+            sy = (sy < 0) ? 0 : ((sy > max_y) ? max_y : sy);
+            const double *src = &in->img[sy * W];
+
+            for (int32_t j = -(int32_t)rx; j <= (int32_t)rx; ++j) {
+                sx = (int32_t)x + j;
+                sx = (sx < 0) ? 0 : ((sx > max_x) ? max_x : sx);
+                win[i++] = ((float)src[sx] - mean) * inv;
+            }
+        }
+        for (; i < stride; ++i) {
+            win[i] = 0.0f;
+        }
+    }
+}
+
+/*
+ * Disparity search over packed windows. Inlined into one function per
+ * instruction set so that the dot product gets inlined too.
+ */
+static ALWAYS_INLINE void search_row(
+    const float   *windows_left,
+    const float   *windows_right,
+    const uint32_t W,
+    const uint32_t stride,
+    const uint32_t max_disp,
+    const int32_t  direction,
+    int32_t       *out,
+    dot_fn_t       dot
+) {
+    // tmp variables
+    uint32_t xl, xr, d_end;
+    float    zncc;
+
+    for (uint32_t x = 0; x < W; ++x) {
+        float   max_sum        = 0;
+        int32_t best_disparity = 0;
+
+        // disparity can't go past the image edge
+        d_end = (direction > 0) ? (x + 1) : (W - x);
+        if (d_end > max_disp) {
+            d_end = max_disp;
+        }
+
+        for (uint32_t d = 0; d < d_end; ++d) {
+            xl = (direction > 0) ? x : (x + d);
+            xr = (direction > 0) ? (x - d) : x;
+
+            zncc = dot(
+                &windows_left[xl * stride], &windows_right[xr * stride], stride
+            );
+
+            if (zncc > max_sum) {
+                max_sum        = zncc;
+                best_disparity = (int32_t)d;
+            }
+        }
+
+        out[x] = best_disparity;
+    }
+}
+
+static void search_row_scalar(
+    const float   *windows_left,
+    const float   *windows_right,
+    const uint32_t W,
+    const uint32_t stride,
+    const uint32_t max_disp,
+    const int32_t  direction,
+    int32_t       *out
+) {
+    search_row(
+        windows_left,
+        windows_right,
+        W,
+        stride,
+        max_disp,
+        direction,
+        out,
+        dot_scalar
+    );
+}
+
+#ifdef ZNCC_SIMD_X86
+__attribute__((target("avx2,fma"))) static void search_row_avx2(
+    const float   *windows_left,
+    const float   *windows_right,
+    const uint32_t W,
+    const uint32_t stride,
+    const uint32_t max_disp,
+    const int32_t  direction,
+    int32_t       *out
+) {
+    search_row(
+        windows_left,
+        windows_right,
+        W,
+        stride,
+        max_disp,
+        direction,
+        out,
+        dot_avx2
+    );
+}
+
+__attribute__((target("avx512f"))) static void search_row_avx512(
+    const float   *windows_left,
+    const float   *windows_right,
+    const uint32_t W,
+    const uint32_t stride,
+    const uint32_t max_disp,
+    const int32_t  direction,
+    int32_t       *out
+) {
+    search_row(
+        windows_left,
+        windows_right,
+        W,
+        stride,
+        max_disp,
+        direction,
+        out,
+        dot_avx512
+    );
+}
+#endif
+
+void calculate_zncc_row_f32(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const int32_t       direction,
+    float              *scratch,
+    int32_t            *out
+) {
+    if (left == NULL || right == NULL || out == NULL || direction == 0 ||
+        left->width != right->width || left->height != right->height ||
+        y >= left->height ||
+        ((uintptr_t)scratch % ZNCC_SIMD_ALIGNMENT) != 0) {
+        panic("bad arguments to \"calculate_zncc_row_f32\"");
+    }
+
+    const uint32_t W      = left->width;
+    const uint32_t rx     = (win_width - 1) / 2;
+    const uint32_t ry     = (win_height - 1) / 2;
+    const uint32_t stride = zncc_simd_window_stride(win_width, win_height);
+
+    bool free_scratch = false;
+    if (scratch == NULL) {
+        // stride is a multiple of 16 floats, so the size is a multiple of 64
+        scratch = aligned_alloc(
+            ZNCC_SIMD_ALIGNMENT,
+            sizeof(float) * zncc_row_f32_scratch_size(W, win_width, win_height)
+        );
+        if (scratch == NULL) {
+            panic("failed to malloc");
+        }
+        free_scratch = true;
+    }
+
+    float *windows_left  = scratch;
+    float *windows_right = &scratch[W * stride];
+
+    pack_normalized_windows(left, y, rx, ry, stride, windows_left);
+    pack_normalized_windows(right, y, rx, ry, stride, windows_right);
+
+    switch (zncc_simd_get_level()) {
+#ifdef ZNCC_SIMD_X86
+        case ZNCC_SIMD_AVX512:
+            search_row_avx512(
+                windows_left, windows_right, W, stride, max_disp, direction, out
+            );
+            break;
+        case ZNCC_SIMD_AVX2:
+            search_row_avx2(
+                windows_left, windows_right, W, stride, max_disp, direction, out
+            );
+            break;
+#endif
+        default:
+            search_row_scalar(
+                windows_left, windows_right, W, stride, max_disp, direction, out
+            );
+            break;
+    }
+
+    if (free_scratch) {
+        free(scratch);
+    }
+}
+
+/*
+ * Integer variant. 81 * 255 * 255 fits easily in int32, so the window sums
+ * are exact. pmaddubsw would save the widening but saturates its int16
+ * pair sums (255 * 255 * 2 > 32767), so pixels are zero-extended to int16
+ * and multiplied with pmaddwd instead.
+ */
+
+static ALWAYS_INLINE int32_t dot_u8_scalar(
+    const gray_t *a, const gray_t *b, const uint32_t stride
+) {
+    int32_t sum = 0;
+    for (uint32_t i = 0; i < stride; ++i) {
+        sum += (int32_t)a[i] * (int32_t)b[i];
+    }
+    return sum;
+}
+
+#ifdef ZNCC_SIMD_X86
+__attribute__((target("avx2"))) static inline int32_t dot_u8_avx2(
+    const gray_t *a, const gray_t *b, const uint32_t stride
+) {
+    // stride is a multiple of 32
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < stride; i += 32) {
+        const __m256i a0 =
+            _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)&a[i]));
+        const __m256i b0 =
+            _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)&b[i]));
+        const __m256i a1 =
+            _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)&a[i + 16]));
+        const __m256i b1 =
+            _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)&b[i + 16]));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+    }
+    acc0 = _mm256_add_epi32(acc0, acc1);
+
+    __m128i sum = _mm_add_epi32(
+        _mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1)
+    );
+    sum = _mm_add_epi32(sum, _mm_unpackhi_epi64(sum, sum));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline int32_t
+dot_u8_avx512(const gray_t *a, const gray_t *b, const uint32_t stride) {
+    __m512i acc = _mm512_setzero_si512();
+    for (uint32_t i = 0; i < stride; i += 32) {
+        const __m512i a0 =
+            _mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)&a[i]));
+        const __m512i b0 =
+            _mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)&b[i]));
+        acc = _mm512_add_epi32(acc, _mm512_madd_epi16(a0, b0));
+    }
+    return _mm512_reduce_add_epi32(acc);
+}
+#endif
+
+int32_t window_dot_product_u8(
+    const gray_t *a, const gray_t *b, const uint32_t stride
+) {
+    switch (zncc_simd_get_level()) {
+#ifdef ZNCC_SIMD_X86
+        case ZNCC_SIMD_AVX512:
+            return dot_u8_avx512(a, b, stride);
+        case ZNCC_SIMD_AVX2:
+            return dot_u8_avx2(a, b, stride);
+#endif
+        default:
+            return dot_u8_scalar(a, b, stride);
+    }
+}
+
+/*
+ * Packs the raw 8-bit windows of every pixel on row y, clamped at the image
+ * borders like `extract_window`.
+ */
+static void pack_gray_windows(
+    const zncc_gray_input_t *in,
+    const uint32_t           y,
+    const uint32_t           rx,
+    const uint32_t           ry,
+    const uint32_t           stride,
+    gray_t                  *windows
+) {
+    const uint32_t W     = in->width;
+    const int32_t  max_x = (int32_t)in->width - 1;
+    const int32_t  max_y = (int32_t)in->height - 1;
+
+    // tmp variables
+    int32_t sx, sy;
+    gray_t *win;
+
+    for (uint32_t x = 0; x < W; ++x) {
+        win = &windows[x * stride];
+
+        uint32_t i = 0;
+        for (int32_t k = -(int32_t)ry; k <= (int32_t)ry; ++k) {
+            sy = (int32_t)y + k;
+            sy = (sy < 0) ? 0 : ((sy > max_y) ? max_y : sy);
+            const gray_t *src = &in->img[sy * W];
+
+            for (int32_t j = -(int32_t)rx; j <= (int32_t)rx; ++j) {
+                sx       = (int32_t)x + j;
+                sx       = (sx < 0) ? 0 : ((sx > max_x) ? max_x : sx);
+                win[i++] = src[sx];
+            }
+        }
+        for (; i < stride; ++i) {
+            win[i] = 0;
+        }
+    }
+}
+
+typedef struct {
+    const gray_t *windows_left;
+    const gray_t *windows_right;
+    const double *mean_left;
+    const double *mean_right;
+    const double *inv_left;
+    const double *inv_right;
+    double        n;
+    uint32_t      W;
+    uint32_t      stride;
+    uint32_t      max_disp;
+    int32_t       direction;
+} search_row_u8_args_t;
+
+static ALWAYS_INLINE void search_row_u8(
+    const search_row_u8_args_t *args, int32_t *out, dot_u8_fn_t dot
+) {
+    const double  *mean_left  = args->mean_left;
+    const double  *mean_right = args->mean_right;
+    const double  *inv_left   = args->inv_left;
+    const double  *inv_right  = args->inv_right;
+    const double   n          = args->n;
+    const uint32_t W          = args->W;
+    const uint32_t stride     = args->stride;
+
+    // tmp variables
+    uint32_t xl, xr, d_end;
+    double   sum, inv, zncc;
+
+    for (uint32_t x = 0; x < W; ++x) {
+        double  max_sum        = 0;
+        int32_t best_disparity = 0;
+
+        // disparity can't go past the image edge
+        d_end = (args->direction > 0) ? (x + 1) : (W - x);
+        if (d_end > args->max_disp) {
+            d_end = args->max_disp;
+        }
+
+        for (uint32_t d = 0; d < d_end; ++d) {
+            xl = (args->direction > 0) ? x : (x + d);
+            xr = (args->direction > 0) ? (x - d) : x;
+
+            inv = inv_left[xl] * inv_right[xr];
+            if (inv == 0.0) {
+                // flat window, scores 0 which never beats max_sum
+                continue;
+            }
+
+            sum = (double)dot(
+                &args->windows_left[xl * stride],
+                &args->windows_right[xr * stride],
+                stride
+            );
+
+            zncc = (sum - (n * mean_left[xl] * mean_right[xr])) * inv;
+
+            if (zncc > max_sum) {
+                max_sum        = zncc;
+                best_disparity = (int32_t)d;
+            }
+        }
+
+        out[x] = best_disparity;
+    }
+}
+
+static void search_row_u8_scalar(
+    const search_row_u8_args_t *args, int32_t *out
+) {
+    search_row_u8(args, out, dot_u8_scalar);
+}
+
+#ifdef ZNCC_SIMD_X86
+__attribute__((target("avx2"))) static void search_row_u8_avx2(
+    const search_row_u8_args_t *args, int32_t *out
+) {
+    search_row_u8(args, out, dot_u8_avx2);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void search_row_u8_avx512(
+    const search_row_u8_args_t *args, int32_t *out
+) {
+    search_row_u8(args, out, dot_u8_avx512);
+}
+#endif
+
+void calculate_zncc_row_u8(
+    const zncc_gray_input_t *left,
+    const zncc_gray_input_t *right,
+    const uint32_t           y,
+    const uint32_t           win_width,
+    const uint32_t           win_height,
+    const uint32_t           max_disp,
+    const int32_t            direction,
+    gray_t                  *scratch,
+    int32_t                 *out
+) {
+    if (left == NULL || right == NULL || out == NULL || direction == 0 ||
+        left->width != right->width || left->height != right->height ||
+        y >= left->height ||
+        ((uintptr_t)scratch % ZNCC_SIMD_ALIGNMENT) != 0) {
+        panic("bad arguments to \"calculate_zncc_row_u8\"");
+    }
+
+    const uint32_t W      = left->width;
+    const uint32_t rx     = (win_width - 1) / 2;
+    const uint32_t ry     = (win_height - 1) / 2;
+    const uint32_t stride = zncc_simd_window_stride_u8(win_width, win_height);
+
+    bool free_scratch = false;
+    if (scratch == NULL) {
+        // stride is a multiple of 32, so the size is a multiple of 64
+        scratch = aligned_alloc(
+            ZNCC_SIMD_ALIGNMENT,
+            zncc_row_u8_scratch_size(W, win_width, win_height)
+        );
+        if (scratch == NULL) {
+            panic("failed to malloc");
+        }
+        free_scratch = true;
+    }
+
+    const search_row_u8_args_t args = {
+        .windows_left  = scratch,
+        .windows_right = &scratch[W * stride],
+        .mean_left     = &left->mean[y * W],
+        .mean_right    = &right->mean[y * W],
+        .inv_left      = &left->inv_std_dev[y * W],
+        .inv_right     = &right->inv_std_dev[y * W],
+        .n             = (double)(((2 * rx) + 1) * ((2 * ry) + 1)),
+        .W             = W,
+        .stride        = stride,
+        .max_disp      = max_disp,
+        .direction     = direction
+    };
+
+    pack_gray_windows(left, y, rx, ry, stride, scratch);
+    pack_gray_windows(right, y, rx, ry, stride, &scratch[W * stride]);
+
+    switch (zncc_simd_get_level()) {
+#ifdef ZNCC_SIMD_X86
+        case ZNCC_SIMD_AVX512:
+            search_row_u8_avx512(&args, out);
+            break;
+        case ZNCC_SIMD_AVX2:
+            search_row_u8_avx2(&args, out);
+            break;
+#endif
+        default:
+            search_row_u8_scalar(&args, out);
+            break;
+    }
+
+    if (free_scratch) {
+        free(scratch);
+    }
+}
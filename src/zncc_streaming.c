@@ -0,0 +1,146 @@
+#include "zncc_streaming.h"
+#include "panic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t zncc_row_scratch_size(
+    const uint32_t W, const uint32_t win_width, const uint32_t win_height
+) {
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+
+    // padded copy of the window rows of both images
+    return 2 * ((2 * ry) + 1) * (W + (2 * rx));
+}
+
+void copy_padded_rows(
+    const double  *img,
+    const uint32_t W,
+    const uint32_t H,
+    const int32_t  first_row,
+    const uint32_t num_rows,
+    const uint32_t rx,
+    double        *rows
+) {
+    const uint32_t pw = W + (2 * rx);
+    int32_t        sy = 0;
+
+    for (uint32_t k = 0; k < num_rows; ++k) {
+        sy = first_row + (int32_t)k;
+        if (sy < 0) {
+            sy = 0;
+        } else if (sy > ((int32_t)H - 1)) {
+            sy = (int32_t)H - 1;
+        }
+
+        const double *src = &img[sy * W];
+        double       *dst = &rows[k * pw];
+
+        for (uint32_t u = 0; u < rx; ++u) {
+            dst[u]          = src[0];
+            dst[rx + W + u] = src[W - 1];
+        }
+        memcpy(&dst[rx], src, sizeof(double) * W);
+    }
+}
+
+void calculate_zncc_row(
+    const zncc_input_t *left,
+    const zncc_input_t *right,
+    const uint32_t      y,
+    const uint32_t      win_width,
+    const uint32_t      win_height,
+    const uint32_t      max_disp,
+    const int32_t       direction,
+    double             *scratch,
+    int32_t            *out
+) {
+    if (left == NULL || right == NULL || out == NULL || direction == 0 ||
+        left->width != right->width || left->height != right->height ||
+        y >= left->height) {
+        panic("bad arguments to \"calculate_zncc_row\"");
+    }
+
+    const uint32_t W  = left->width;
+    const uint32_t H  = left->height;
+    const uint32_t rx = (win_width - 1) / 2;
+    const uint32_t ry = (win_height - 1) / 2;
+    const uint32_t ww = (2 * rx) + 1;
+    const uint32_t wh = (2 * ry) + 1;
+    const uint32_t pw = W + (2 * rx);
+    const double   n  = (double)(ww * wh);
+
+    bool free_scratch = false;
+    if (scratch == NULL) {
+        scratch = malloc(
+            sizeof(double) * zncc_row_scratch_size(W, win_width, win_height)
+        );
+        if (scratch == NULL) {
+            panic("failed to malloc");
+        }
+        free_scratch = true;
+    }
+
+    double *rows_left  = scratch;
+    double *rows_right = &scratch[wh * pw];
+
+    const int32_t first_row = (int32_t)y - (int32_t)ry;
+    copy_padded_rows(left->img, W, H, first_row, wh, rx, rows_left);
+    copy_padded_rows(right->img, W, H, first_row, wh, rx, rows_right);
+
+    const double *mean_left  = &left->mean[y * W];
+    const double *mean_right = &right->mean[y * W];
+    const double *inv_left   = &left->inv_std_dev[y * W];
+    const double *inv_right  = &right->inv_std_dev[y * W];
+
+    // tmp variables
+    uint32_t xl, xr, d_end;
+    double   sum, inv, zncc;
+
+    for (uint32_t x = 0; x < W; ++x) {
+        double  max_sum        = 0;
+        int32_t best_disparity = 0;
+
+        // disparity can't go past the image edge
+        d_end = (direction > 0) ? (x + 1) : (W - x);
+        if (d_end > max_disp) {
+            d_end = max_disp;
+        }
+
+        for (uint32_t d = 0; d < d_end; ++d) {
+            xl = (direction > 0) ? x : (x + d);
+            xr = (direction > 0) ? (x - d) : x;
+
+            inv = inv_left[xl] * inv_right[xr];
+            if (inv == 0.0) {
+                // flat window, scores 0 which never beats max_sum
+                continue;
+            }
+
+            sum = 0.0;
+            for (uint32_t k = 0; k < wh; ++k) {
+                const double *l = &rows_left[(k * pw) + xl];
+                const double *r = &rows_right[(k * pw) + xr];
+                for (uint32_t j = 0; j < ww; ++j) {
+                    sum += l[j] * r[j];
+                }
+            }
+
+            zncc = (sum - (n * mean_left[xl] * mean_right[xr])) * inv;
+
+            if (zncc > max_sum) {
+                max_sum        = zncc;
+                best_disparity = (int32_t)d;
+            }
+        }
+
+        out[x] = best_disparity;
+    }
+
+    if (free_scratch) {
+        free(scratch);
+    }
+}
@@ -3,12 +3,23 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "munit.h"
 
 #include "coord_fifo.h"
 #include "image_operations.h"
+#include "image_operations_simd.h"
+#include "integral_image.h"
+#include "padded_image.h"
+#include "row_scheduler.h"
+#include "task_pool.h"
+#include "visited_set.h"
+#include "work_size_tuning.h"
+#include "zncc_cost_volume.h"
 #include "zncc_operations.h"
+#include "zncc_simd.h"
+#include "zncc_streaming.h"
 
 MunitResult test_calculate_window_mean(
     const MunitParameter params[], void* data
@@ -475,6 +486,196 @@ MunitResult test_find_nearest_nonzero_neighbour_prealloc(
     return MUNIT_OK;
 }
 
+MunitResult test_visited_set(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    visited_set_t set;
+    visited_set_init(&set, 16);
+
+    for (uint32_t i = 0; i < 16; ++i) {
+        munit_assert_false(visited_set_contains(&set, i));
+    }
+
+    visited_set_insert(&set, 3);
+    visited_set_insert(&set, 7);
+    munit_assert_true(visited_set_contains(&set, 3));
+    munit_assert_true(visited_set_contains(&set, 7));
+    munit_assert_false(visited_set_contains(&set, 4));
+
+    visited_set_clear(&set);
+    munit_assert_false(visited_set_contains(&set, 3));
+    munit_assert_false(visited_set_contains(&set, 7));
+
+    // pixel visited in the last epoch before wrap around must not be visited
+    // again when the epoch counter restarts
+    visited_set_insert(&set, 5);
+    set.current = UINT32_MAX;
+    visited_set_insert(&set, 3);
+    visited_set_clear(&set);
+    munit_assert_uint32(1, ==, set.current);
+    munit_assert_false(visited_set_contains(&set, 3));
+    munit_assert_false(visited_set_contains(&set, 5));
+
+    visited_set_free(&set);
+    munit_assert_null(set.epoch);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_find_nearest_nonzero_neighbour_visited_set(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W = 23;
+    const uint32_t H = 17;
+
+    int32_t*      map     = malloc(sizeof(int32_t) * W * H);
+    uint8_t*      visited = malloc(sizeof(uint8_t) * W * H);
+    visited_set_t set;
+    coord_fifo_t  fifo = {
+         .storage  = malloc(sizeof(coord_t) * W * H),
+         .read     = 0,
+         .write    = 0,
+         .capacity = W * H
+    };
+    visited_set_init(&set, W * H);
+
+    // sparse pseudo-random sources with a big hole
+    uint32_t state = 54321;
+    for (uint32_t i = 0; i < W * H; ++i) {
+        state  = (state * 1103515245u) + 12345u;
+        map[i] = (((state >> 16) % 8) == 0) ? (int32_t)(state % 100) + 1 : 0;
+    }
+    for (uint32_t y = 3; y < 12; ++y) {
+        for (uint32_t x = 4; x < 19; ++x) {
+            map[(y * W) + x] = 0;
+        }
+    }
+
+    // same BFS, so exactly the same result for every pixel
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            int32_t want = find_nearest_nonzero_neighbour(
+                map, W, H, x, y, visited, &fifo
+            );
+            int32_t got = find_nearest_nonzero_neighbour_visited_set(
+                map, W, H, x, y, &set, &fifo
+            );
+            munit_assert_int32(want, ==, got);
+        }
+    }
+
+    // out of bounds
+    munit_assert_int32(
+        0,
+        ==,
+        find_nearest_nonzero_neighbour_visited_set(
+            map, W, H, W, H, &set, &fifo
+        )
+    );
+
+    // no nonzero pixels
+    memset(map, 0, sizeof(int32_t) * W * H);
+    munit_assert_int32(
+        0,
+        ==,
+        find_nearest_nonzero_neighbour_visited_set(
+            map, W, H, 5, 5, &set, &fifo
+        )
+    );
+
+    visited_set_free(&set);
+    free(fifo.storage);
+    free(visited);
+    free(map);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_fill_zero_regions(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W = 37;
+    const uint32_t H = 23;
+
+    int32_t*  map    = malloc(sizeof(int32_t) * W * H);
+    int32_t*  filled = malloc(sizeof(int32_t) * W * H);
+    int32_t*  split  = malloc(sizeof(int32_t) * W * H);
+    uint32_t* dist   = malloc(sizeof(uint32_t) * W * H);
+
+    // sparse pseudo-random sources with a big hole
+    uint32_t state = 12345;
+    for (uint32_t i = 0; i < W * H; ++i) {
+        state  = (state * 1103515245u) + 12345u;
+        map[i] = (((state >> 16) % 10) == 0) ? (int32_t)(state % 100) + 1 : 0;
+    }
+    for (uint32_t y = 4; y < 15; ++y) {
+        for (uint32_t x = 6; x < 30; ++x) {
+            map[(y * W) + x] = 0;
+        }
+    }
+
+    memcpy(filled, map, sizeof(int32_t) * W * H);
+    fill_zero_regions(filled, NULL, W, H);
+
+    // passes split into chunks like when run on several threads
+    memcpy(split, map, sizeof(int32_t) * W * H);
+    for (uint32_t y = 0; y < H; y += 5) {
+        fill_zero_regions_rows(split, dist, W, H, y, (y + 5 < H) ? y + 5 : H);
+    }
+    for (uint32_t x = 0; x < W; x += 8) {
+        fill_zero_regions_columns(
+            split, dist, W, H, x, (x + 8 < W) ? x + 8 : W
+        );
+    }
+    munit_assert_memory_equal(sizeof(int32_t) * W * H, filled, split);
+
+    // each pixel has the value of a source at the smallest Manhattan distance
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            uint32_t best  = UINT32_MAX;
+            bool     found = false;
+            for (uint32_t sy = 0; sy < H; ++sy) {
+                for (uint32_t sx = 0; sx < W; ++sx) {
+                    if (map[(sy * W) + sx] == 0) {
+                        continue;
+                    }
+                    uint32_t d = (uint32_t)(abs((int)sx - (int)x) +
+                                            abs((int)sy - (int)y));
+                    if (d < best) {
+                        best  = d;
+                        found = false;
+                    }
+                    if (d == best &&
+                        map[(sy * W) + sx] == filled[(y * W) + x]) {
+                        found = true;
+                    }
+                }
+            }
+            munit_assert_true(found);
+            munit_assert_uint32(best, ==, dist[(y * W) + x]);
+        }
+    }
+
+    // all zeros stays all zeros
+    memset(filled, 0, sizeof(int32_t) * W * H);
+    fill_zero_regions(filled, dist, W, H);
+    for (uint32_t i = 0; i < W * H; ++i) {
+        munit_assert_int32(0, ==, filled[i]);
+    }
+
+    free(map);
+    free(filled);
+    free(split);
+    free(dist);
+
+    return MUNIT_OK;
+}
+
 MunitResult test_coord_fifo(const MunitParameter params[], void* data) {
     (void)params;
     (void)data;
@@ -516,9 +717,1304 @@ MunitResult test_coord_fifo(const MunitParameter params[], void* data) {
     return MUNIT_OK;
 }
 
+MunitResult test_integral_window_statistics(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W = 12;
+    const uint32_t H = 10;
+
+    double img[12 * 10];
+    for (uint32_t i = 0; i < W * H; ++i) {
+        // deterministic pattern with integer values in [0, 255]
+        img[i] = (double)((i * 97 + 13) % 256);
+    }
+
+    // also windows larger than the image, which clamp on both sides
+    const uint32_t window_sizes[] = {3, 9, 15};
+
+    double  window[15 * 15];
+    double* mean_map = malloc(sizeof(double) * W * H);
+    double* std_map  = malloc(sizeof(double) * W * H);
+    double* band_mean_map = malloc(sizeof(double) * W * H);
+    double* band_std_map  = malloc(sizeof(double) * W * H);
+    munit_assert_not_null(mean_map);
+    munit_assert_not_null(std_map);
+    munit_assert_not_null(band_mean_map);
+    munit_assert_not_null(band_std_map);
+
+    for (uint32_t i = 0; i < (sizeof(window_sizes) / sizeof(uint32_t)); ++i) {
+        const uint32_t win = window_sizes[i];
+
+        integral_image_t sat;
+        build_integral_image(img, W, H, win, win, &sat);
+        calculate_window_statistics(img, W, H, win, win, mean_map, std_map);
+
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                extract_window(img, window, x, y, win, win, W, H);
+                double expect_mean = calculate_window_mean(window, win, win);
+                double expect_std  = calculate_window_standard_deviation(
+                    window, win, win, expect_mean
+                );
+
+                double got_mean = 0.0;
+                double got_std  = 0.0;
+                integral_window_statistics(&sat, x, y, &got_mean, &got_std);
+
+                munit_assert_double_equal(expect_mean, got_mean, 9);
+                munit_assert_double_equal(expect_std, got_std, 9);
+                munit_assert_double_equal(
+                    expect_mean, mean_map[(y * W) + x], 9
+                );
+                munit_assert_double_equal(expect_std, std_map[(y * W) + x], 9);
+            }
+        }
+
+        // bands of rows, the last one partial, give the same maps
+        for (uint32_t y = 0; y < H; y += 3) {
+            const uint32_t y_end = (y + 3 < H) ? y + 3 : H;
+            integral_window_statistics_rows(
+                &sat, y, y_end, band_mean_map, band_std_map
+            );
+        }
+        munit_assert_memory_equal(
+            sizeof(double) * W * H, mean_map, band_mean_map
+        );
+        munit_assert_memory_equal(
+            sizeof(double) * W * H, std_map, band_std_map
+        );
+
+        free_integral_image(&sat);
+        munit_assert_null(sat.sum);
+        munit_assert_null(sat.sum_sq);
+    }
+
+    // constant image must have exactly zero deviation
+    for (uint32_t i = 0; i < W * H; ++i) {
+        img[i] = 42.0;
+    }
+    calculate_window_statistics(img, W, H, 9, 9, mean_map, std_map);
+    for (uint32_t i = 0; i < W * H; ++i) {
+        munit_assert_double(42.0, ==, mean_map[i]);
+        munit_assert_double(0.0, ==, std_map[i]);
+    }
+
+    free(mean_map);
+    free(std_map);
+    free(band_mean_map);
+    free(band_std_map);
+
+    return MUNIT_OK;
+}
+
+// Generates a stereo pair where the right image is the left image shifted
+// left by `shift` pixels, with pseudo-random texture so that matches are
+// unambiguous. Values are integers in [0, 255] like converted grayscale.
+void generate_stereo_pair(
+    double* left, double* right, uint32_t W, uint32_t H, uint32_t shift
+) {
+    uint32_t state = 12345;
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W + shift; ++x) {
+            state    = (state * 1103515245u) + 12345u;
+            double v = (double)((state >> 16) % 256);
+            if (x < W) {
+                left[(y * W) + x] = v;
+            }
+            if (x >= shift) {
+                right[(y * W) + (x - shift)] = v;
+            }
+        }
+    }
+}
+
+// Disparity search the way phase 4 originally did it, from normalized windows
+void reference_disparity(
+    double*  left,
+    double*  right,
+    uint32_t W,
+    uint32_t H,
+    uint32_t win,
+    uint32_t max_disp,
+    int32_t  direction,
+    int32_t* out
+) {
+    double* window_left  = malloc(sizeof(double) * win * win);
+    double* window_right = malloc(sizeof(double) * win * win);
+
+    for (uint32_t y = 0; y < H; ++y) {
+        for (uint32_t x = 0; x < W; ++x) {
+            double  max_sum        = 0;
+            int32_t best_disparity = 0;
+
+            for (uint32_t d = 0; d < max_disp; ++d) {
+                uint32_t xl = (direction > 0) ? x : (x + d);
+                uint32_t xr = (direction > 0) ? (x - d) : x;
+                if ((direction > 0 && d > x) || (direction < 0 && xl >= W)) {
+                    break;
+                }
+
+                double mean, std_dev;
+
+                extract_window(left, window_left, xl, y, win, win, W, H);
+                mean    = calculate_window_mean(window_left, win, win);
+                std_dev = calculate_window_standard_deviation(
+                    window_left, win, win, mean
+                );
+                zero_mean_window(window_left, win, win, mean);
+                normalize_window(window_left, win, win, std_dev);
+
+                extract_window(right, window_right, xr, y, win, win, W, H);
+                mean    = calculate_window_mean(window_right, win, win);
+                std_dev = calculate_window_standard_deviation(
+                    window_right, win, win, mean
+                );
+                zero_mean_window(window_right, win, win, mean);
+                normalize_window(window_right, win, win, std_dev);
+
+                double zncc =
+                    window_dot_product(window_left, window_right, win, win);
+                if (zncc > max_sum) {
+                    max_sum        = zncc;
+                    best_disparity = (int32_t)d;
+                }
+            }
+
+            out[(y * W) + x] = best_disparity;
+        }
+    }
+
+    free(window_left);
+    free(window_right);
+}
+
+// Allocates mean and inverse standard deviation maps for `img`
+zncc_input_t prepare_zncc_input(
+    double* img, uint32_t W, uint32_t H, uint32_t win
+) {
+    zncc_input_t in = {
+        .img         = img,
+        .mean        = malloc(sizeof(double) * W * H),
+        .inv_std_dev = malloc(sizeof(double) * W * H),
+        .width       = W,
+        .height      = H
+    };
+    munit_assert_not_null(in.mean);
+    munit_assert_not_null(in.inv_std_dev);
+
+    calculate_window_statistics(img, W, H, win, win, in.mean, in.inv_std_dev);
+    invert_standard_deviation(in.inv_std_dev, in.inv_std_dev, W * H);
+
+    return in;
+}
+
+void free_zncc_input(zncc_input_t* in) {
+    free(in->mean);
+    free(in->inv_std_dev);
+}
+
+MunitResult test_calculate_zncc_row(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W        = 40;
+    const uint32_t H        = 12;
+    const uint32_t WIN      = 5;
+    const uint32_t MAX_DISP = 8;
+    const uint32_t SHIFT    = 3;
+
+    double*  left   = malloc(sizeof(double) * W * H);
+    double*  right  = malloc(sizeof(double) * W * H);
+    int32_t* expect = malloc(sizeof(int32_t) * W * H);
+    int32_t* got    = malloc(sizeof(int32_t) * W * H);
+    double*  scratch =
+        malloc(sizeof(double) * zncc_row_scratch_size(W, WIN, WIN));
+
+    generate_stereo_pair(left, right, W, H, SHIFT);
+
+    // flat region, which must score 0 against everything
+    for (uint32_t x = 0; x < 10; ++x) {
+        left[(5 * W) + x] = 7.0;
+    }
+
+    zncc_input_t in_left  = prepare_zncc_input(left, W, H, WIN);
+    zncc_input_t in_right = prepare_zncc_input(right, W, H, WIN);
+
+    const int32_t directions[] = {1, -1};
+    for (uint32_t i = 0; i < 2; ++i) {
+        reference_disparity(
+            left, right, W, H, WIN, MAX_DISP, directions[i], expect
+        );
+
+        for (uint32_t y = 0; y < H; ++y) {
+            // alternate between preallocated and internal scratch memory
+            calculate_zncc_row(
+                &in_left,
+                &in_right,
+                y,
+                WIN,
+                WIN,
+                MAX_DISP,
+                directions[i],
+                (y % 2) ? scratch : NULL,
+                &got[y * W]
+            );
+        }
+
+        munit_assert_memory_equal(sizeof(int32_t) * W * H, expect, got);
+    }
+
+    // sanity check that the shift is actually found away from the edges
+    munit_assert_int32((int32_t)SHIFT, ==, expect[(2 * W) + 20]);
+
+    free_zncc_input(&in_left);
+    free_zncc_input(&in_right);
+    free(left);
+    free(right);
+    free(expect);
+    free(got);
+    free(scratch);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_calculate_zncc_cost_volume(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W        = 40;
+    const uint32_t H        = 12;
+    const uint32_t WIN      = 5;
+    const uint32_t MAX_DISP = 8;
+    const uint32_t SHIFT    = 3;
+    const uint32_t BAND     = 5;  // doesn't divide H evenly on purpose
+
+    // whole row, narrower than the disparity range, doesn't divide W evenly
+    const uint32_t tiles[] = {0, 3, 7};
+
+    munit_assert_uint32(zncc_cost_volume_tile_width(16, 9, 9, 65), >=, 64);
+
+    double*  left   = malloc(sizeof(double) * W * H);
+    double*  right  = malloc(sizeof(double) * W * H);
+    int32_t* expect = malloc(sizeof(int32_t) * W * H);
+    int32_t* got    = malloc(sizeof(int32_t) * W * H);
+    double*  scratch = malloc(
+        sizeof(double) * zncc_cost_volume_scratch_size(W, BAND, WIN, WIN)
+    );
+
+    generate_stereo_pair(left, right, W, H, SHIFT);
+
+    // flat region, which must score 0 against everything
+    for (uint32_t x = 0; x < 10; ++x) {
+        left[(5 * W) + x] = 7.0;
+    }
+
+    zncc_input_t in_left  = prepare_zncc_input(left, W, H, WIN);
+    zncc_input_t in_right = prepare_zncc_input(right, W, H, WIN);
+
+    const int32_t directions[] = {1, -1};
+    for (uint32_t i = 0; i < 2; ++i) {
+        reference_disparity(
+            left, right, W, H, WIN, MAX_DISP, directions[i], expect
+        );
+
+        // banded and tiled, with preallocated scratch memory
+        for (uint32_t t = 0; t < 3; ++t) {
+            memset(got, 0xff, sizeof(int32_t) * W * H);
+            for (uint32_t y = 0; y < H; y += BAND) {
+                uint32_t y_end = (y + BAND < H) ? (y + BAND) : H;
+                calculate_zncc_cost_volume(
+                    &in_left,
+                    &in_right,
+                    y,
+                    y_end,
+                    WIN,
+                    WIN,
+                    MAX_DISP,
+                    directions[i],
+                    tiles[t],
+                    scratch,
+                    got
+                );
+            }
+            munit_assert_memory_equal(sizeof(int32_t) * W * H, expect, got);
+        }
+
+        // whole image at once, with internal scratch memory
+        memset(got, 0xff, sizeof(int32_t) * W * H);
+        calculate_zncc_cost_volume(
+            &in_left,
+            &in_right,
+            0,
+            H,
+            WIN,
+            WIN,
+            MAX_DISP,
+            directions[i],
+            0,
+            NULL,
+            got
+        );
+        munit_assert_memory_equal(sizeof(int32_t) * W * H, expect, got);
+    }
+
+    free_zncc_input(&in_left);
+    free_zncc_input(&in_right);
+    free(left);
+    free(right);
+    free(expect);
+    free(got);
+    free(scratch);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_calculate_zncc_cost_volume_fused(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W        = 40;
+    const uint32_t H        = 12;
+    const uint32_t WIN      = 5;
+    const uint32_t MAX_DISP = 8;
+    const uint32_t SHIFT    = 3;
+    const uint32_t BAND     = 5;  // doesn't divide H evenly on purpose
+
+    // whole row, narrower than the disparity range, doesn't divide W evenly
+    const uint32_t tiles[] = {0, 3, 7};
+
+    double*  left       = malloc(sizeof(double) * W * H);
+    double*  right      = malloc(sizeof(double) * W * H);
+    int32_t* expect_ltr = malloc(sizeof(int32_t) * W * H);
+    int32_t* expect_rtl = malloc(sizeof(int32_t) * W * H);
+    int32_t* got_ltr    = malloc(sizeof(int32_t) * W * H);
+    int32_t* got_rtl    = malloc(sizeof(int32_t) * W * H);
+    double*  scratch    = malloc(
+        sizeof(double) * zncc_cost_volume_scratch_size(W, BAND, WIN, WIN)
+    );
+
+    generate_stereo_pair(left, right, W, H, SHIFT);
+
+    // flat region, which must score 0 against everything
+    for (uint32_t x = 0; x < 10; ++x) {
+        left[(5 * W) + x] = 7.0;
+    }
+
+    zncc_input_t in_left  = prepare_zncc_input(left, W, H, WIN);
+    zncc_input_t in_right = prepare_zncc_input(right, W, H, WIN);
+
+    reference_disparity(left, right, W, H, WIN, MAX_DISP, 1, expect_ltr);
+    reference_disparity(left, right, W, H, WIN, MAX_DISP, -1, expect_rtl);
+
+    // banded and tiled, with preallocated scratch memory
+    for (uint32_t t = 0; t < 3; ++t) {
+        memset(got_ltr, 0xff, sizeof(int32_t) * W * H);
+        memset(got_rtl, 0xff, sizeof(int32_t) * W * H);
+        for (uint32_t y = 0; y < H; y += BAND) {
+            uint32_t y_end = (y + BAND < H) ? (y + BAND) : H;
+            calculate_zncc_cost_volume_fused(
+                &in_left,
+                &in_right,
+                y,
+                y_end,
+                WIN,
+                WIN,
+                MAX_DISP,
+                tiles[t],
+                scratch,
+                got_ltr,
+                got_rtl
+            );
+        }
+        munit_assert_memory_equal(
+            sizeof(int32_t) * W * H, expect_ltr, got_ltr
+        );
+        munit_assert_memory_equal(
+            sizeof(int32_t) * W * H, expect_rtl, got_rtl
+        );
+    }
+
+    // whole image at once, with internal scratch memory
+    memset(got_ltr, 0xff, sizeof(int32_t) * W * H);
+    memset(got_rtl, 0xff, sizeof(int32_t) * W * H);
+    calculate_zncc_cost_volume_fused(
+        &in_left, &in_right, 0, H, WIN, WIN, MAX_DISP, 0, NULL, got_ltr, got_rtl
+    );
+    munit_assert_memory_equal(sizeof(int32_t) * W * H, expect_ltr, got_ltr);
+    munit_assert_memory_equal(sizeof(int32_t) * W * H, expect_rtl, got_rtl);
+
+    free_zncc_input(&in_left);
+    free_zncc_input(&in_right);
+    free(left);
+    free(right);
+    free(expect_ltr);
+    free(expect_rtl);
+    free(got_ltr);
+    free(got_rtl);
+    free(scratch);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_calculate_zncc_row_f32(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W        = 40;
+    const uint32_t H        = 12;
+    const uint32_t WIN      = 9;
+    const uint32_t MAX_DISP = 8;
+    const uint32_t SHIFT    = 3;
+    const uint32_t STRIDE   = zncc_simd_window_stride(WIN, WIN);
+
+    munit_assert_uint32(STRIDE, ==, 96);
+    munit_assert_uint32(zncc_simd_window_stride(5, 5), ==, 32);
+
+    double*  left    = malloc(sizeof(double) * W * H);
+    double*  right   = malloc(sizeof(double) * W * H);
+    int32_t* expect  = malloc(sizeof(int32_t) * W * H);
+    int32_t* got     = malloc(sizeof(int32_t) * W);
+    float*   scratch = aligned_alloc(
+        ZNCC_SIMD_ALIGNMENT,
+        sizeof(float) * zncc_row_f32_scratch_size(W, WIN, WIN)
+    );
+    float* a = aligned_alloc(ZNCC_SIMD_ALIGNMENT, sizeof(float) * STRIDE);
+    float* b = aligned_alloc(ZNCC_SIMD_ALIGNMENT, sizeof(float) * STRIDE);
+
+    generate_stereo_pair(left, right, W, H, SHIFT);
+
+    // flat region, which must score 0 against everything
+    for (uint32_t x = 0; x < 10; ++x) {
+        left[(5 * W) + x] = 7.0;
+    }
+
+    zncc_input_t in_left  = prepare_zncc_input(left, W, H, WIN);
+    zncc_input_t in_right = prepare_zncc_input(right, W, H, WIN);
+
+    for (uint32_t i = 0; i < STRIDE; ++i) {
+        a[i] = (float)(i % 7) - 3.0f;
+        b[i] = (float)(i % 5) * 0.5f;
+    }
+
+    const zncc_simd_level_e detected   = zncc_simd_detect();
+    const int32_t           directions[] = {1, -1};
+
+    // every implementation supported by this CPU
+    for (int level = ZNCC_SIMD_SCALAR; level <= (int)detected; ++level) {
+        zncc_simd_set_level((zncc_simd_level_e)level);
+        munit_assert_int((int)zncc_simd_get_level(), ==, level);
+
+        // small integers, so the sum is exact in any order
+        float expect_dot = 0.0f;
+        for (uint32_t i = 0; i < STRIDE; ++i) {
+            expect_dot += a[i] * b[i];
+        }
+        munit_assert_float(
+            window_dot_product_f32(a, b, STRIDE), ==, expect_dot
+        );
+
+        for (uint32_t i = 0; i < 2; ++i) {
+            reference_disparity(
+                left, right, W, H, WIN, MAX_DISP, directions[i], expect
+            );
+
+            for (uint32_t y = 0; y < H; ++y) {
+                memset(got, 0xff, sizeof(int32_t) * W);
+                calculate_zncc_row_f32(
+                    &in_left,
+                    &in_right,
+                    y,
+                    WIN,
+                    WIN,
+                    MAX_DISP,
+                    directions[i],
+                    (y % 2 == 0) ? scratch : NULL,
+                    got
+                );
+                munit_assert_memory_equal(
+                    sizeof(int32_t) * W, &expect[y * W], got
+                );
+            }
+        }
+    }
+    zncc_simd_set_level(detected);
+
+    free_zncc_input(&in_left);
+    free_zncc_input(&in_right);
+    free(left);
+    free(right);
+    free(expect);
+    free(got);
+    free(scratch);
+    free(a);
+    free(b);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_calculate_zncc_row_u8(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W        = 40;
+    const uint32_t H        = 12;
+    const uint32_t WIN      = 9;
+    const uint32_t MAX_DISP = 8;
+    const uint32_t SHIFT    = 3;
+    const uint32_t STRIDE   = zncc_simd_window_stride_u8(WIN, WIN);
+
+    munit_assert_uint32(STRIDE, ==, 96);
+    munit_assert_uint32(zncc_simd_window_stride_u8(5, 5), ==, 32);
+
+    double*  left       = malloc(sizeof(double) * W * H);
+    double*  right      = malloc(sizeof(double) * W * H);
+    gray_t*  left_gs    = malloc(sizeof(gray_t) * W * H);
+    gray_t*  right_gs   = malloc(sizeof(gray_t) * W * H);
+    int32_t* expect     = malloc(sizeof(int32_t) * W * H);
+    int32_t* expect_row = malloc(sizeof(int32_t) * W);
+    int32_t* got        = malloc(sizeof(int32_t) * W);
+    gray_t*  scratch    = aligned_alloc(
+        ZNCC_SIMD_ALIGNMENT, zncc_row_u8_scratch_size(W, WIN, WIN)
+    );
+    // aligned_alloc wants a multiple of the alignment
+    const size_t WIN_SIZE = (STRIDE + ZNCC_SIMD_ALIGNMENT - 1) &
+                            ~((size_t)ZNCC_SIMD_ALIGNMENT - 1);
+    gray_t* a = aligned_alloc(ZNCC_SIMD_ALIGNMENT, WIN_SIZE);
+    gray_t* b = aligned_alloc(ZNCC_SIMD_ALIGNMENT, WIN_SIZE);
+
+    generate_stereo_pair(left, right, W, H, SHIFT);
+
+    // flat region, which must score 0 against everything
+    for (uint32_t x = 0; x < 10; ++x) {
+        left[(5 * W) + x] = 7.0;
+    }
+
+    for (uint32_t i = 0; i < W * H; ++i) {
+        left_gs[i]  = (gray_t)left[i];
+        right_gs[i] = (gray_t)right[i];
+    }
+
+    zncc_input_t in_left  = prepare_zncc_input(left, W, H, WIN);
+    zncc_input_t in_right = prepare_zncc_input(right, W, H, WIN);
+
+    zncc_gray_input_t in_left_gs = {
+        .img         = left_gs,
+        .mean        = in_left.mean,
+        .inv_std_dev = in_left.inv_std_dev,
+        .width       = W,
+        .height      = H
+    };
+    zncc_gray_input_t in_right_gs = {
+        .img         = right_gs,
+        .mean        = in_right.mean,
+        .inv_std_dev = in_right.inv_std_dev,
+        .width       = W,
+        .height      = H
+    };
+
+    // worst case for int16 pair sums
+    int32_t expect_dot = 0;
+    for (uint32_t i = 0; i < STRIDE; ++i) {
+        a[i] = (i < 81) ? 255 : 0;
+        b[i] = (gray_t)(255 - (i % 3));
+        expect_dot += (int32_t)a[i] * (int32_t)b[i];
+    }
+
+    const zncc_simd_level_e detected     = zncc_simd_detect();
+    const int32_t           directions[] = {1, -1};
+
+    // every implementation supported by this CPU
+    for (int level = ZNCC_SIMD_SCALAR; level <= (int)detected; ++level) {
+        zncc_simd_set_level((zncc_simd_level_e)level);
+
+        munit_assert_int32(window_dot_product_u8(a, b, STRIDE), ==, expect_dot);
+
+        for (uint32_t i = 0; i < 2; ++i) {
+            reference_disparity(
+                left, right, W, H, WIN, MAX_DISP, directions[i], expect
+            );
+
+            for (uint32_t y = 0; y < H; ++y) {
+                memset(got, 0xff, sizeof(int32_t) * W);
+                calculate_zncc_row_u8(
+                    &in_left_gs,
+                    &in_right_gs,
+                    y,
+                    WIN,
+                    WIN,
+                    MAX_DISP,
+                    directions[i],
+                    (y % 2 == 0) ? scratch : NULL,
+                    got
+                );
+                munit_assert_memory_equal(
+                    sizeof(int32_t) * W, &expect[y * W], got
+                );
+
+                // integer sums are exact, so same as the double driver
+                calculate_zncc_row(
+                    &in_left,
+                    &in_right,
+                    y,
+                    WIN,
+                    WIN,
+                    MAX_DISP,
+                    directions[i],
+                    NULL,
+                    expect_row
+                );
+                munit_assert_memory_equal(sizeof(int32_t) * W, expect_row, got);
+            }
+        }
+    }
+    zncc_simd_set_level(detected);
+
+    free_zncc_input(&in_left);
+    free_zncc_input(&in_right);
+    free(left);
+    free(right);
+    free(left_gs);
+    free(right_gs);
+    free(expect);
+    free(expect_row);
+    free(got);
+    free(scratch);
+    free(a);
+    free(b);
+
+    return MUNIT_OK;
+}
+
+typedef struct {
+    uint32_t* visits;       // per index
+    uint32_t  num_workers;
+    uint32_t  bad_worker_ids;
+} task_pool_test_arg_t;
+
+void task_pool_test_fn(
+    uint32_t begin, uint32_t end, uint32_t worker_id, void* p
+) {
+    task_pool_test_arg_t* arg = p;
+
+    if (worker_id >= arg->num_workers) {
+        __atomic_fetch_add(&arg->bad_worker_ids, 1, __ATOMIC_RELAXED);
+    }
+
+    for (uint32_t i = begin; i < end; ++i) {
+        // very uneven cost, like BFS runs in big and small holes
+        volatile uint32_t spin = 0;
+        for (uint32_t k = 0; k < ((i % 17 == 0) ? 20000u : 10u); ++k) {
+            spin += k;
+        }
+        __atomic_fetch_add(&arg->visits[i], 1, __ATOMIC_RELAXED);
+    }
+}
+
+MunitResult test_task_pool(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    const uint32_t N = 1000;
+
+    uint32_t* visits = malloc(sizeof(uint32_t) * N);
+
+    const uint32_t workers[] = {1, 3, 4};
+    const uint32_t grains[]  = {0, 1, 5, 2000};
+
+    for (uint32_t w = 0; w < 3; ++w) {
+        task_pool_t pool;
+        task_pool_init(&pool, workers[w]);
+        munit_assert_uint32(pool.num_workers, ==, workers[w]);
+
+        task_pool_test_arg_t arg = {
+            .visits = visits, .num_workers = workers[w], .bad_worker_ids = 0
+        };
+
+        // same pool reused for several loops
+        for (uint32_t g = 0; g < 4; ++g) {
+            memset(visits, 0, sizeof(uint32_t) * N);
+            task_pool_parallel_for(
+                &pool, 10, N, grains[g], task_pool_test_fn, &arg
+            );
+            for (uint32_t i = 0; i < N; ++i) {
+                munit_assert_uint32(visits[i], ==, (i < 10) ? 0 : 1);
+            }
+        }
+        munit_assert_uint32(arg.bad_worker_ids, ==, 0);
+
+        // empty range
+        memset(visits, 0, sizeof(uint32_t) * N);
+        task_pool_parallel_for(&pool, 5, 5, 1, task_pool_test_fn, &arg);
+        for (uint32_t i = 0; i < N; ++i) {
+            munit_assert_uint32(visits[i], ==, 0);
+        }
+
+        task_pool_destroy(&pool);
+    }
+
+    // number of CPUs
+    task_pool_t pool;
+    task_pool_init(&pool, 0);
+    munit_assert_uint32(pool.num_workers, >=, 1);
+    task_pool_destroy(&pool);
+
+    free(visits);
+
+    return MUNIT_OK;
+}
+
 #define TEST_IMAGE_PATH_0 "./test_images/input/im0.png"
 #define TEST_IMAGE_PATH_1 "./test_images/input/im1.png"
 
+MunitResult test_row_scheduler(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    row_scheduler_t s;
+    uint32_t        bounds[ROW_SCHEDULER_MAX_WORKERS + 1];
+
+    // nothing measured, equal strips
+    row_scheduler_init(&s, 4, 8);
+    row_scheduler_split(&s, 0, 64, bounds);
+    munit_assert_uint32(0, ==, bounds[0]);
+    munit_assert_uint32(16, ==, bounds[1]);
+    munit_assert_uint32(32, ==, bounds[2]);
+    munit_assert_uint32(48, ==, bounds[3]);
+    munit_assert_uint32(64, ==, bounds[4]);
+
+    // 3x faster worker gets 3x the rows
+    row_scheduler_init(&s, 2, 8);
+    row_scheduler_record(&s, 0, 30, 1000000);
+    row_scheduler_record(&s, 1, 10, 1000000);
+    row_scheduler_split(&s, 16, 80, bounds);
+    munit_assert_uint32(16, ==, bounds[0]);
+    munit_assert_uint32(64, ==, bounds[1]);
+    munit_assert_uint32(80, ==, bounds[2]);
+
+    // unmeasured worker counts as the average measured one
+    row_scheduler_init(&s, 3, 1);
+    row_scheduler_record(&s, 0, 10, 1000);
+    row_scheduler_record(&s, 1, 30, 1000);
+    row_scheduler_split(&s, 0, 60, bounds);
+    munit_assert_uint32(10, ==, bounds[1]);
+    munit_assert_uint32(40, ==, bounds[2]);
+    munit_assert_uint32(60, ==, bounds[3]);
+
+    // measurements are averaged
+    row_scheduler_record(&s, 0, 30, 1000);
+    munit_assert_double_equal(20e6, s.throughput[0], 6);
+
+    // ragged end, boundaries stay aligned and ordered
+    const uint32_t H = 70;
+    row_scheduler_init(&s, 5, 8);
+    row_scheduler_record(&s, 0, 1, 1000);
+    row_scheduler_record(&s, 2, 100, 1000);
+    row_scheduler_split(&s, 0, H, bounds);
+    munit_assert_uint32(0, ==, bounds[0]);
+    munit_assert_uint32(H, ==, bounds[5]);
+    for (uint32_t i = 1; i < 5; ++i) {
+        munit_assert_uint32(bounds[i - 1], <=, bounds[i]);
+        munit_assert_true(bounds[i] == H || (bounds[i] % 8) == 0);
+    }
+
+    // fewer rows than workers
+    row_scheduler_init(&s, 4, 8);
+    row_scheduler_split(&s, 0, 3, bounds);
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < 4; ++i) {
+        total += bounds[i + 1] - bounds[i];
+    }
+    munit_assert_uint32(3, ==, total);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_work_size_tuning(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    work_size_t c[WORK_SIZE_MAX_CANDIDATES];
+    uint32_t    n = 0;
+
+    // sections of 1, 2, 4, ... 32 rows
+    n = work_size_candidates(WORK_SIZE_ROW_SECTIONS, 1, 504, 735, 256, c);
+    munit_assert_uint32(6, ==, n);
+    munit_assert_size(504, ==, c[0].global[0]);
+    munit_assert_size(252, ==, c[1].global[0]);
+    munit_assert_size(15, ==, c[5].global[0]);
+    munit_assert_size(0, ==, c[5].local[0]);
+
+    // no duplicates for short images
+    n = work_size_candidates(WORK_SIZE_ROW_SECTIONS, 1, 3, 10, 256, c);
+    munit_assert_uint32(2, ==, n);
+    munit_assert_size(3, ==, c[0].global[0]);
+    munit_assert_size(1, ==, c[1].global[0]);
+
+    // runtime choice first, then global sizes rounded up to the local size
+    n = work_size_candidates(WORK_SIZE_PER_ITEM, 1, 100, 0, 32, c);
+    munit_assert_uint32(4, ==, n);
+    munit_assert_size(0, ==, c[0].local[0]);
+    munit_assert_size(100, ==, c[0].global[0]);
+    munit_assert_size(8, ==, c[1].local[0]);
+    munit_assert_size(104, ==, c[1].global[0]);
+    munit_assert_size(112, ==, c[2].global[0]);
+    munit_assert_size(128, ==, c[3].global[0]);
+
+    n = work_size_candidates(WORK_SIZE_PER_ITEM, 2, 735, 504, 64, c);
+    munit_assert_uint32(1, <, n);
+    for (uint32_t i = 1; i < n; ++i) {
+        munit_assert_uint32(2, ==, c[i].work_dim);
+        munit_assert_size(64, >=, c[i].local[0] * c[i].local[1]);
+        munit_assert_size(0, ==, c[i].global[0] % c[i].local[0]);
+        munit_assert_size(0, ==, c[i].global[1] % c[i].local[1]);
+        munit_assert_size(735, <=, c[i].global[0]);
+        munit_assert_size(504, <=, c[i].global[1]);
+    }
+
+    // keys have no whitespace
+    char key[WORK_SIZE_KEY_LEN];
+    work_size_key(
+        key, "grayscale_kernel", NULL, "pthread cpu/5.0/8cu", 735, 504
+    );
+    munit_assert_string_equal(
+        "grayscale_kernel@pthread_cpu/5.0/8cu@735x504", key
+    );
+
+    // build options are part of the key
+    char key_a[WORK_SIZE_KEY_LEN];
+    char key_b[WORK_SIZE_KEY_LEN];
+    work_size_key(key_a, "k", "-Werror", "dev", 735, 504);
+    work_size_key(key_b, "k", "-Werror -DGRAYSCALE_8BIT", "dev", 735, 504);
+    munit_assert_string_not_equal(key_a, key_b);
+    munit_assert_string_not_equal(key, key_a);
+
+    // set replaces entries with the same key
+    work_size_table_t t;
+    work_size_table_init(&t);
+    munit_assert_null(work_size_table_find(&t, key));
+
+    work_size_table_set(&t, key, &c[1]);
+    work_size_table_set(&t, "other", &c[0]);
+    work_size_table_set(&t, key, &c[2]);
+    munit_assert_uint32(2, ==, t.num_entries);
+    munit_assert_size(
+        c[2].local[0], ==, work_size_table_find(&t, key)->local[0]
+    );
+
+    // file round trip
+    const char *path = "./test_work_sizes.txt";
+    munit_assert_int32(0, ==, work_size_table_save(&t, path));
+
+    work_size_table_t loaded;
+    work_size_table_init(&loaded);
+    munit_assert_int32(0, ==, work_size_table_load(&loaded, path));
+    remove(path);
+
+    munit_assert_uint32(2, ==, loaded.num_entries);
+    const work_size_t *ws = work_size_table_find(&loaded, key);
+    munit_assert_not_null(ws);
+    // field by field, the struct has padding
+    munit_assert_uint32(c[2].work_dim, ==, ws->work_dim);
+    for (uint32_t i = 0; i < 2; ++i) {
+        munit_assert_size(c[2].global[i], ==, ws->global[i]);
+        munit_assert_size(c[2].local[i], ==, ws->local[i]);
+    }
+
+    munit_assert_int32(-1, ==, work_size_table_load(&loaded, path));
+
+    return MUNIT_OK;
+}
+
+MunitResult test_downscale_to_grayscale(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    const uint32_t Wi = 28;
+    const uint32_t Hi = 20;
+    const uint32_t W  = Wi / 4;
+    const uint32_t H  = Hi / 4;
+
+    rgba_img_t in = {.img = NULL, .width = Wi, .height = Hi};
+    in.img        = malloc(Wi * Hi * sizeof(rgba_t));
+    munit_assert_not_null(in.img);
+    for (uint32_t i = 0; i < Wi * Hi; ++i) {
+        in.img[i] = (rgba_t){
+            .R = (uint8_t)(i * 37), .G = (uint8_t)(i * 101), .B = (uint8_t)i
+        };
+    }
+
+    // reference, one pass and one image per step
+    rgba_img_t   ds = {.img = NULL, .width = W, .height = H};
+    gray_img_t   gs = {.img = NULL};
+    double_img_t f  = {.img = NULL};
+    scale_down_image(&in, &ds);
+    convert_to_grayscale(&ds, &gs);
+    convert_to_double(&gs, &f);
+
+    gray_t* out_gs     = malloc(W * H * sizeof(gray_t));
+    float*  out_float  = malloc(W * H * sizeof(float));
+    double* out_double = malloc(W * H * sizeof(double));
+    munit_assert_not_null(out_gs);
+    munit_assert_not_null(out_float);
+    munit_assert_not_null(out_double);
+
+    downscale_to_grayscale(&in, out_gs, GS, W, H, 0, H);
+    // row ranges can be done separately
+    downscale_to_grayscale(&in, out_float, GS_FLOAT, W, H, 0, 2);
+    downscale_to_grayscale(&in, out_float, GS_FLOAT, W, H, 2, H);
+    downscale_to_grayscale(&in, out_double, GS_DOUBLE, W, H, 0, H);
+
+    for (uint32_t i = 0; i < W * H; ++i) {
+        munit_assert_uint8(gs.img[i], ==, out_gs[i]);
+        munit_assert_float((float)gs.img[i], ==, out_float[i]);
+        munit_assert_double(f.img[i], ==, out_double[i]);
+    }
+
+    free(in.img);
+    free(ds.img);
+    free(gs.img);
+    free(f.img);
+    free(out_gs);
+    free(out_float);
+    free(out_double);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_image_operations_simd(
+    const MunitParameter params[], void* data
+) {
+    (void)params;
+    (void)data;
+
+    // smaller than the filter, odd sizes with SIMD remainders, scale 1 and 4
+    const uint32_t sizes[][4] = {
+        {3,   2,  3,   2 },
+        {37,  23, 37,  23},
+        {83,  41, 20,  10},
+        {256, 64, 64,  16},
+    };
+    const image_simd_level_e detected = image_simd_detect();
+
+    task_pool_t pool;
+    task_pool_init(&pool, 3);
+
+    // every color against the double formula, one image per red value
+    {
+        rgba_img_t in  = {.img = NULL, .width = 256, .height = 256};
+        in.img         = malloc(256 * 256 * sizeof(rgba_t));
+        gray_t* expect = malloc(256 * 256 * sizeof(gray_t));
+        munit_assert_not_null(in.img);
+        munit_assert_not_null(expect);
+
+        for (int level = IMAGE_SIMD_SCALAR; level <= (int)detected; ++level) {
+            image_simd_set_level((image_simd_level_e)level);
+            munit_assert_int((int)image_simd_get_level(), ==, level);
+
+            for (uint32_t r = 0; r < 256; ++r) {
+                for (uint32_t i = 0; i < 256 * 256; ++i) {
+                    in.img[i] = (rgba_t){
+                        .R = (uint8_t)r,
+                        .G = (uint8_t)(i & 0xff),
+                        .B = (uint8_t)(i >> 8),
+                        .A = 255
+                    };
+                    expect[i] = (gray_t)(
+                        (SCALE_R * (double)r) + (SCALE_G * (double)(i & 0xff)) +
+                        (SCALE_B * (double)(i >> 8))
+                    );
+                }
+
+                gray_img_t got = {.img = NULL};
+                convert_to_grayscale_parallel(
+                    &in, &got, (r % 2 == 0) ? &pool : NULL
+                );
+                munit_assert_memory_equal(256 * 256, expect, got.img);
+                free(got.img);
+            }
+        }
+
+        free(in.img);
+        free(expect);
+    }
+
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        const uint32_t Wi = sizes[s][0];
+        const uint32_t Hi = sizes[s][1];
+
+        rgba_img_t in = {.img = NULL, .width = Wi, .height = Hi};
+        in.img        = malloc(Wi * Hi * sizeof(rgba_t));
+        munit_assert_not_null(in.img);
+        for (uint32_t i = 0; i < Wi * Hi; ++i) {
+            in.img[i] = (rgba_t){
+                .R = (uint8_t)(i * 37),
+                .G = (uint8_t)(i * 101),
+                .B = (uint8_t)(i * 7),
+                .A = (uint8_t)i
+            };
+        }
+
+        rgba_img_t ds = {
+            .img = NULL, .width = sizes[s][2], .height = sizes[s][3]
+        };
+        gray_img_t gs       = {.img = NULL};
+        gray_img_t filtered = {.img = NULL};
+        scale_down_image(&in, &ds);
+        convert_to_grayscale(&in, &gs);
+        apply_filter(&gs, &filtered);
+
+        for (int level = IMAGE_SIMD_SCALAR; level <= (int)detected; ++level) {
+            image_simd_set_level((image_simd_level_e)level);
+
+            for (uint32_t p = 0; p < 2; ++p) {
+                task_pool_t* tp = (p == 0) ? NULL : &pool;
+
+                rgba_img_t got_ds = {
+                    .img = NULL, .width = ds.width, .height = ds.height
+                };
+                gray_img_t got_gs       = {.img = NULL};
+                gray_img_t got_filtered = {.img = NULL};
+                scale_down_image_parallel(&in, &got_ds, tp);
+                convert_to_grayscale_parallel(&in, &got_gs, tp);
+                apply_filter_parallel(&gs, &got_filtered, tp);
+
+                munit_assert_memory_equal(
+                    ds.width * ds.height * sizeof(rgba_t), ds.img, got_ds.img
+                );
+                munit_assert_uint32(gs.width, ==, got_gs.width);
+                munit_assert_uint32(gs.height, ==, got_gs.height);
+                munit_assert_memory_equal(Wi * Hi, gs.img, got_gs.img);
+                munit_assert_uint32(filtered.width, ==, got_filtered.width);
+                munit_assert_uint32(filtered.height, ==, got_filtered.height);
+                munit_assert_memory_equal(
+                    Wi * Hi, filtered.img, got_filtered.img
+                );
+
+                free(got_ds.img);
+                free(got_gs.img);
+                free(got_filtered.img);
+            }
+        }
+
+        free(in.img);
+        free(ds.img);
+        free(gs.img);
+        free(filtered.img);
+    }
+
+    // largest filter sums, where the division by multiplying is closest to
+    // being off by one
+    {
+        gray_img_t in = {.img = NULL, .width = 40, .height = 8};
+        in.img        = malloc(40 * 8);
+        munit_assert_not_null(in.img);
+        for (uint32_t i = 0; i < 40 * 8; ++i) {
+            in.img[i] = (gray_t)(255 - (i % 3));
+        }
+
+        gray_img_t expect = {.img = NULL};
+        apply_filter(&in, &expect);
+
+        for (int level = IMAGE_SIMD_SCALAR; level <= (int)detected; ++level) {
+            image_simd_set_level((image_simd_level_e)level);
+
+            gray_img_t got = {.img = NULL};
+            apply_filter_parallel(&in, &got, &pool);
+            munit_assert_memory_equal(40 * 8, expect.img, got.img);
+            free(got.img);
+        }
+
+        free(in.img);
+        free(expect.img);
+    }
+
+    image_simd_set_level(detected);
+    task_pool_destroy(&pool);
+
+    return MUNIT_OK;
+}
+
+MunitResult test_box_filter(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    const uint32_t sizes[][2] = {
+        {1,  1 },
+        {3,  2 },
+        {37, 23},
+        {64, 9 },
+    };
+    const uint32_t radii[] = {0, 1, 2, 5, 20};
+
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        const uint32_t W     = sizes[s][0];
+        const uint32_t H     = sizes[s][1];
+        const int32_t  max_x = (int32_t)W - 1;
+        const int32_t  max_y = (int32_t)H - 1;
+
+        gray_img_t in = {.img = NULL, .width = W, .height = H};
+        in.img        = malloc(W * H * sizeof(gray_t));
+        munit_assert_not_null(in.img);
+        for (uint32_t i = 0; i < W * H; ++i) {
+            in.img[i] = (gray_t)((i * 37) ^ (i >> 3));
+        }
+
+        for (uint32_t k = 0; k < sizeof(radii) / sizeof(radii[0]); ++k) {
+            const int32_t  R    = (int32_t)radii[k];
+            const uint32_t area = (uint32_t)((2 * R + 1) * (2 * R + 1));
+
+            gray_img_t got = {.img = NULL};
+            apply_box_filter(&in, &got, radii[k]);
+            munit_assert_uint32(W, ==, got.width);
+            munit_assert_uint32(H, ==, got.height);
+
+            // every tap clamped to the image
+            for (int32_t y = 0; y < (int32_t)H; ++y) {
+                for (int32_t x = 0; x < (int32_t)W; ++x) {
+                    uint32_t v = 0;
+                    for (int32_t dy = -R; dy <= R; ++dy) {
+                        int32_t py = y + dy;
+                        py = (py < 0) ? 0 : ((py > max_y) ? max_y : py);
+                        for (int32_t dx = -R; dx <= R; ++dx) {
+                            int32_t px = x + dx;
+                            px = (px < 0) ? 0 : ((px > max_x) ? max_x : px);
+                            v += in.img[(py * W) + px];
+                        }
+                    }
+                    munit_assert_uint8(
+                        (gray_t)(v / area), ==, got.img[(y * W) + x]
+                    );
+                }
+            }
+
+            free(got.img);
+        }
+
+        // apply_filter is the 5x5 case
+        gray_img_t expect = {.img = NULL};
+        gray_img_t got    = {.img = NULL};
+        apply_box_filter(&in, &expect, SMOOTHING_KERNEL_RADIUS);
+        apply_filter(&in, &got);
+        munit_assert_memory_equal(W * H, expect.img, got.img);
+
+        free(expect.img);
+        free(got.img);
+        free(in.img);
+    }
+
+    return MUNIT_OK;
+}
+
+MunitResult test_padded_image(const MunitParameter params[], void* data) {
+    (void)params;
+    (void)data;
+
+    const uint32_t W = 23;
+    const uint32_t H = 11;
+    const uint32_t A = 6;
+
+    gray_img_t   gs = {.img = NULL, .width = W, .height = H};
+    double_img_t d  = {.img = NULL, .width = W, .height = H};
+    gs.img          = malloc(W * H * sizeof(gray_t));
+    d.img           = malloc(W * H * sizeof(double));
+    munit_assert_not_null(gs.img);
+    munit_assert_not_null(d.img);
+    for (uint32_t i = 0; i < W * H; ++i) {
+        gs.img[i] = (gray_t)((i * 37) ^ (i >> 3));
+        d.img[i]  = (double)gs.img[i] * 0.5;
+    }
+
+    padded_gray_img_t   pg;
+    padded_double_img_t pd;
+    padded_gray_img_from(&pg, &gs, A);
+    padded_double_img_from(&pd, &d, A);
+
+    // aligned rows, apron holds the clamped pixels
+    munit_assert_size(0, ==, (pg.stride * sizeof(gray_t)) % 64);
+    munit_assert_size(0, ==, (pd.stride * sizeof(double)) % 64);
+    const int32_t max_x = (int32_t)W - 1;
+    const int32_t max_y = (int32_t)H - 1;
+    const int32_t sg    = (int32_t)pg.stride;
+    const int32_t sd    = (int32_t)pd.stride;
+    for (int32_t y = -(int32_t)A; y <= max_y + (int32_t)A; ++y) {
+        munit_assert_size(0, ==, (uintptr_t)&pg.img[y * sg] % 64);
+        munit_assert_size(0, ==, (uintptr_t)&pd.img[y * sd] % 64);
+
+        const int32_t cy = (y < 0) ? 0 : ((y > max_y) ? max_y : y);
+        for (int32_t x = -(int32_t)A; x <= max_x + (int32_t)A; ++x) {
+            const int32_t cx = (x < 0) ? 0 : ((x > max_x) ? max_x : x);
+            munit_assert_uint8(gs.img[(cy * W) + cx], ==, pg.img[(y * sg) + x]);
+            munit_assert_double(d.img[(cy * W) + cx], ==, pd.img[(y * sd) + x]);
+        }
+    }
+
+    // windows match extract_window, including even sizes
+    const uint32_t windows[][2] = {
+        {9, 9},
+        {4, 7},
+        {1, 1},
+    };
+    double expect[81];
+    double got[81];
+    for (uint32_t k = 0; k < sizeof(windows) / sizeof(windows[0]); ++k) {
+        const uint32_t ww = windows[k][0];
+        const uint32_t wh = windows[k][1];
+
+        for (uint32_t y = 0; y < H; ++y) {
+            for (uint32_t x = 0; x < W; ++x) {
+                memset(expect, 0, sizeof(expect));
+                memset(got, 0, sizeof(got));
+                extract_window(d.img, expect, x, y, ww, wh, W, H);
+                extract_window_padded(&pd, got, x, y, ww, wh);
+                munit_assert_memory_equal(sizeof(expect), expect, got);
+            }
+        }
+    }
+
+    // box filters match the clamping versions for radii below the apron
+    for (uint32_t r = 0; r < A; ++r) {
+        gray_img_t expect_f = {.img = NULL};
+        gray_img_t got_f    = {.img = NULL};
+        apply_box_filter(&gs, &expect_f, r);
+        apply_box_filter_padded(&pg, &got_f, r);
+        munit_assert_uint32(W, ==, got_f.width);
+        munit_assert_uint32(H, ==, got_f.height);
+        munit_assert_memory_equal(W * H, expect_f.img, got_f.img);
+        free(expect_f.img);
+        free(got_f.img);
+    }
+    {
+        gray_img_t expect_f = {.img = NULL};
+        gray_img_t got_f    = {.img = NULL};
+        apply_filter(&gs, &expect_f);
+        apply_filter_padded(&pg, &got_f);
+        munit_assert_memory_equal(W * H, expect_f.img, got_f.img);
+        free(expect_f.img);
+        free(got_f.img);
+    }
+
+    padded_gray_img_free(&pg);
+    padded_double_img_free(&pd);
+    munit_assert_null(pg.mem);
+    free(gs.img);
+    free(d.img);
+
+    return MUNIT_OK;
+}
+
 MunitResult test_image_loading(const MunitParameter params[], void* data) {
     (void)params;
     (void)data;
@@ -752,6 +2248,134 @@ int main(int argc, char* argv[MUNIT_ARRAY_PARAM(argc + 1)]) {
             MUNIT_TEST_OPTION_NONE,
             NULL
         },
+        {
+            "find_nearest_nonzero_neighbour_visited_set",
+            test_find_nearest_nonzero_neighbour_visited_set,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "visited_set",
+            test_visited_set,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "fill_zero_regions",
+            test_fill_zero_regions,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "integral_window_statistics",
+            test_integral_window_statistics,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "calculate_zncc_row",
+            test_calculate_zncc_row,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "calculate_zncc_cost_volume",
+            test_calculate_zncc_cost_volume,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "calculate_zncc_cost_volume_fused",
+            test_calculate_zncc_cost_volume_fused,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "calculate_zncc_row_f32",
+            test_calculate_zncc_row_f32,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "calculate_zncc_row_u8",
+            test_calculate_zncc_row_u8,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "task_pool",
+            test_task_pool,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "row_scheduler",
+            test_row_scheduler,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "test_work_size_tuning",
+            test_work_size_tuning,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "test_downscale_to_grayscale",
+            test_downscale_to_grayscale,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "test_image_operations_simd",
+            test_image_operations_simd,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "test_box_filter",
+            test_box_filter,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
+        {
+            "test_padded_image",
+            test_padded_image,
+            NULL,
+            NULL,
+            MUNIT_TEST_OPTION_NONE,
+            NULL
+        },
         {
             "test_image_loading",
             test_image_loading,